@@ -0,0 +1,160 @@
+#ifndef ACCOUNT_TABLE_HPP
+#define ACCOUNT_TABLE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdlib.h>
+#include <unordered_map>
+
+#include "risk_limits.hpp"
+
+// Add delta to value, saturating at the int64_t bounds.
+inline void saturatingAdd(std::atomic<int64_t> &value, Notional delta)
+{
+    int64_t current = value.load(std::memory_order_relaxed);
+    while (delta != 0 && !value.compare_exchange_weak(current, (int64_t)std::max<Notional>(std::min<Notional>(current + delta, INT64_MAX), INT64_MIN),
+                                                     std::memory_order_relaxed))
+        ;
+}
+
+// Exposure headroom of one trading account over every instrument, shared by
+// the engines of every shard. Changes are reserved with a compare-exchange,
+// so the account limit holds however the account's listings are sharded.
+struct Account
+{
+    uint64_t id = 0;
+    // Dense, keys the account's positions in each engine.
+    uint32_t index = 0;
+    std::atomic<int64_t> buyHeadroom{INT64_MAX}, sellHeadroom{INT64_MAX};
+    // Saturate at the int64_t bounds, account notional sums are not exact.
+    std::atomic<int64_t> buyNotionalHeadroom{INT64_MAX}, sellNotionalHeadroom{INT64_MAX};
+
+    // Take the quantity and notional delta from the side's headroom, false
+    // (and nothing taken) if either does not fit.
+    bool reserve(bool buy, int64_t delta, int64_t notional)
+    {
+        if (!reserve(buy ? buyHeadroom : sellHeadroom, delta))
+            return false;
+        if (reserve(buy ? buyNotionalHeadroom : sellNotionalHeadroom, notional))
+            return true;
+        consume(buy, -delta);
+        return false;
+    }
+
+    // Take delta from the side's headroom unchecked (negative gives it back).
+    void consume(bool buy, int64_t delta)
+    {
+        if (delta != 0)
+            (buy ? buyHeadroom : sellHeadroom).fetch_sub(delta, std::memory_order_relaxed);
+    }
+
+    void consumeNotional(bool buy, Notional delta) { saturatingAdd(buy ? buyNotionalHeadroom : sellNotionalHeadroom, -delta); }
+
+private:
+    static bool reserve(std::atomic<int64_t> &headroom, int64_t delta)
+    {
+        int64_t current = headroom.load(std::memory_order_relaxed);
+        do
+        {
+            if (delta > current)
+                return false;
+        } while (!headroom.compare_exchange_weak(current, current - delta, std::memory_order_relaxed));
+        return true;
+    }
+};
+
+// Firm-wide aggregates over every account, instrument and shard, moved by
+// the engines as each order, modify, rollback and trade lands: open buy and
+// sell quantity and notional, and the net position and notional (the sum of
+// the instruments'). The portfolio limit is checked against `headroom`, an
+// account over every account whose exposure is the open side plus the long
+// (short) net position of each instrument over all accounts.
+struct Portfolio
+{
+    Account headroom;
+    std::atomic<int64_t> buyQty{0}, sellQty{0}, netPos{0};
+    std::atomic<int64_t> buyNotional{0}, sellNotional{0}, netNotional{0};
+
+    void open(bool buy, int64_t delta, Notional notional)
+    {
+        (buy ? buyQty : sellQty).fetch_add(delta, std::memory_order_relaxed);
+        saturatingAdd(buy ? buyNotional : sellNotional, notional);
+    }
+
+    void trade(int64_t tradeQty, Notional notionalChange)
+    {
+        netPos.fetch_add(tradeQty, std::memory_order_relaxed);
+        saturatingAdd(netNotional, notionalChange);
+    }
+};
+
+// Accounts by id, registered by the I/O threads when a session logs on and
+// by the engines when they recover orders. Accounts are never freed, so
+// connections and orders hold plain pointers. Account 0 holds the sessions
+// which never logged on.
+class AccountTable
+{
+public:
+    AccountTable(const RiskLimits *l) : limits(l)
+    {
+        Limit limit = limits->forPortfolio();
+        portfolio.headroom.buyHeadroom.store(limit.buy, std::memory_order_relaxed);
+        portfolio.headroom.sellHeadroom.store(limit.sell, std::memory_order_relaxed);
+        portfolio.headroom.buyNotionalHeadroom.store(limit.buyNotional, std::memory_order_relaxed);
+        portfolio.headroom.sellNotionalHeadroom.store(limit.sellNotional, std::memory_order_relaxed);
+    }
+
+    Account *findOrRegister(uint64_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<Account> &account = accounts[id];
+        if (!account)
+        {
+            Limit limit = limits->forAccount(id);
+            account.reset(new Account());
+            account->id = id;
+            account->index = accounts.size() - 1;
+            account->buyHeadroom.store(limit.buy, std::memory_order_relaxed);
+            account->sellHeadroom.store(limit.sell, std::memory_order_relaxed);
+            account->buyNotionalHeadroom.store(limit.buyNotional, std::memory_order_relaxed);
+            account->sellNotionalHeadroom.store(limit.sellNotional, std::memory_order_relaxed);
+        }
+        return account.get();
+    }
+
+    Portfolio &getPortfolio() { return portfolio; }
+
+    // Move every account and the portfolio to new limits, shifting their
+    // headroom by the change of their limit. Orders racing the shift see the
+    // old or the new headroom.
+    void setLimits(const RiskLimits *newLimits)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &entry : accounts)
+        {
+            Account &account = *entry.second;
+            shift(account, limits->forAccount(account.id), newLimits->forAccount(account.id));
+        }
+        shift(portfolio.headroom, limits->forPortfolio(), newLimits->forPortfolio());
+        limits = newLimits;
+    }
+
+private:
+    static void shift(Account &account, const Limit &before, const Limit &after)
+    {
+        account.consume(true, before.buy - after.buy);
+        account.consume(false, before.sell - after.sell);
+        account.consumeNotional(true, (Notional)before.buyNotional - after.buyNotional);
+        account.consumeNotional(false, (Notional)before.sellNotional - after.sellNotional);
+    }
+
+    const RiskLimits *limits;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::unique_ptr<Account>> accounts;
+    Portfolio portfolio;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ADMIN_SERVER_HPP
+#define ADMIN_SERVER_HPP
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Out-of-band admin endpoint, served by its own thread so it never competes
+// with the event loops. Listens on a loopback TCP port and/or a Unix socket
+// and answers one request per connection, either a plain text command line
+// (e.g. `echo metrics | nc -U admin.sock`) or an HTTP GET of /<command>
+// (e.g. a Prometheus scrape of /metrics).
+class AdminServer
+{
+public:
+    // Produces the response body of a command from its arguments.
+    typedef std::function<std::string(const std::string &arguments)> Command;
+
+    ~AdminServer();
+
+    void addCommand(const std::string &name, Command command) { commands[name] = command; }
+    bool listenTcp(int port);
+    bool listenUnix(const std::string &path);
+    void start();
+
+private:
+    void handleClient(int clientSocket);
+    bool runCommand(const std::string &line, std::string &response);
+
+    std::map<std::string, Command> commands;
+    std::vector<int> listeners;
+    std::string unixPath;
+    std::thread thread;
+};
+
+#endif
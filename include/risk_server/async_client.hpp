@@ -0,0 +1,125 @@
+#ifndef ASYNC_CLIENT_HPP
+#define ASYNC_CLIENT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "client.hpp"
+#include "message.hpp"
+
+// Pipelined RiskClient: messages are encoded into a reusable send buffer and
+// sent without waiting, replies are matched back to their message by sequence
+// number and order id (shards may answer out of order) and delivered to a
+// callback or a future. Not thread-safe: drive it from one thread, either
+// with poll() or from the caller's event loop with descriptor(), flush() and
+// receive(). Callbacks and futures complete on that thread. Messages added
+// with addToBatch are sent as one Batch frame by submitBatch.
+class AsyncRiskClient
+{
+public:
+    // Called with the reply, or with NULL if the connection closed first.
+    typedef std::function<void(const OrderResponse *response)> Callback;
+    // Called with the entries of a BatchResponse, or with NULL if the
+    // connection closed first.
+    typedef std::function<void(const BatchResponse::Entry *entries, uint16_t count)> BatchCallback;
+
+    AsyncRiskClient(uint64_t port, Transport transport = Transport::TCP);
+    explicit AsyncRiskClient(const std::string &socketPath);
+
+    /*
+    * Append a NewOrder, DeleteOrder, ModifyOrderQuantity or Trade to the
+    * batch being built, messageType is set.
+    *
+    * Returns
+    * -------
+    * added : bool
+    *     false if it does not fit in the batch frame, submit the batch first.
+    */
+    template <typename Message>
+    bool addToBatch(const Message &message)
+    {
+        static_assert(EngineMessages::at(Message::MESSAGE_TYPE).size == sizeof(Message), "Only engine messages can be batched");
+        if (sizeof(Batch) + batchBuffer.size() + sizeof(Message) > UINT16_MAX || batchCount == UINT16_MAX)
+            return false;
+        Message batched = message;
+        batched.messageType = Message::MESSAGE_TYPE;
+        size_t tail = batchBuffer.size();
+        batchBuffer.resize(tail + sizeof(Message));
+        std::memcpy(batchBuffer.data() + tail, &batched, sizeof(Message));
+        batchCount++;
+        return true;
+    }
+
+    bool connected() const { return open; }
+    int descriptor() const { return client->descriptor(); }
+    size_t inFlight() const { return pending.size(); }
+    bool pendingSend() const { return sendHead < sendBuffer.size(); }
+    // Over shared memory only readability needs watching, the server rings
+    // once it freed ring space.
+    bool sharedMemory() const { return client->sharedMemory(); }
+    uint64_t unmatched() const { return unmatchedReplies; }
+
+    void submitBatch(BatchCallback callback);
+    std::future<std::vector<BatchResponse::Entry>> submitBatch();
+    void submitDeleteOrder(const DeleteOrder &order);
+    void submitLogon(const Logon &logon);
+    void submitModifyOrderQuantity(const ModifyOrderQuantity &order, Callback callback);
+    std::future<OrderResponse> submitModifyOrderQuantity(const ModifyOrderQuantity &order);
+    void submitNewOrder(const NewOrder &order, Callback callback);
+    std::future<OrderResponse> submitNewOrder(const NewOrder &order);
+    void submitTrade(const Trade &trade);
+
+    bool flush();
+    size_t poll(int timeoutMillis);
+    size_t receive();
+
+private:
+    // Large enough for the biggest frame (Header + 65535 byte payload).
+    static constexpr size_t RECEIVE_BUFFER_SIZE = 1 << 17;
+
+    // Awaited reply: an OrderResponse for orderId, or a BatchResponse.
+    struct Pending
+    {
+        uint64_t orderId;
+        Callback callback;
+        BatchCallback batchCallback;
+    };
+
+    static Callback fulfil(std::shared_ptr<std::promise<OrderResponse>> promise);
+
+    void close();
+
+    /*
+    * Append one frame to the send buffer.
+    *
+    * Returns
+    * -------
+    * sequenceNumber : uint32_t
+    *     Sequence number of the frame, the reply carries it + 1.
+    */
+    template <typename Message>
+    uint32_t encode(const Message &message)
+    {
+        size_t tail = sendBuffer.size();
+        sendBuffer.resize(tail + sizeof(Header) + sizeof(Message));
+        RiskClient::encodeMessage(sendBuffer.data() + tail, nextSequence, message);
+        return nextSequence++;
+    }
+
+    std::unique_ptr<RiskClient> client;
+    std::vector<char> sendBuffer, receiveBuffer, batchBuffer;
+    uint16_t batchCount = 0;
+    size_t sendHead = 0, receiveTail = 0;
+    uint32_t nextSequence = 0;
+    std::unordered_map<uint32_t, Pending> pending;
+    uint64_t unmatchedReplies = 0;
+    bool open = true;
+};
+
+#endif
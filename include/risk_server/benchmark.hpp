@@ -0,0 +1,92 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "async_client.hpp"
+#include "message.hpp"
+#include "metrics.hpp"
+
+// Settings of a benchmark run, parsed from the command line in bench_main.
+struct BenchmarkOptions
+{
+    size_t connections = 8;
+    // Seconds of load, replies still in flight are then drained.
+    double duration = 10;
+    // Messages per second over all connections, 0 runs closed-loop.
+    double rate = 0;
+    // Messages awaiting a reply per connection in closed-loop mode.
+    size_t window = 16;
+    // Listings the orders and trades are spread over.
+    std::vector<uint64_t> listings;
+    // Relative weights of NewOrder, DeleteOrder, ModifyOrderQuantity and Trade.
+    uint32_t mix[4] = {70, 15, 10, 5};
+    uint64_t maxQuantity = 10, maxPrice = 100;
+    uint64_t seed = 1;
+    Transport transport = Transport::TCP;
+    // Connect to the server's Unix socket instead of the port (TCP framing).
+    std::string socketPath;
+};
+
+// Load generator driving many AsyncRiskClient connections from one thread.
+// Open-loop mode sends on a fixed schedule whatever the replies, and measures
+// latency from the time each message was due so a stalled server cannot hide
+// its queueing (coordinated omission). Closed-loop mode keeps a fixed window
+// of messages in flight and corrects its latencies afterwards by back-filling
+// the samples a steady sender would have seen during each stall.
+class RiskBenchmark
+{
+public:
+    RiskBenchmark(uint64_t port, const BenchmarkOptions &o);
+
+    void report(std::ostream &out) const;
+    void run();
+
+private:
+    static constexpr uint64_t DRAIN_NANOS = 2000000000ull;
+
+    struct Session
+    {
+        std::unique_ptr<AsyncRiskClient> client;
+        uint64_t nextOrderId = 0, nextSendAt = 0;
+        std::vector<uint64_t> liveOrders;
+    };
+
+    // Bucket counts as in LatencyHistogram, kept by the single benchmark thread.
+    struct Histogram
+    {
+        std::vector<uint64_t> buckets = std::vector<uint64_t>(LatencyHistogram::BUCKETS);
+        uint64_t count = 0, sum = 0, max = 0;
+
+        void record(uint64_t nanos, uint64_t times = 1)
+        {
+            buckets[LatencyHistogram::bucketFor(nanos)] += times;
+            count += times;
+            sum += nanos * times;
+            max = std::max(max, nanos);
+        }
+    };
+
+    void checkConnected(const Session &session) const;
+    void correctCoordinatedOmission();
+    void recordReply(Session &session, const OrderResponse *response, uint64_t dueAt, uint64_t sentAt, bool newOrder);
+    void sendNext(Session &session, uint64_t dueAt);
+
+    BenchmarkOptions options;
+    std::vector<Session> sessions;
+    std::mt19937_64 random;
+    uint64_t startedAt = 0, stoppedAt = 0, sendInterval = 0;
+    size_t inFlight = 0;
+
+    uint64_t sent[4] = {}, replies[2] = {};
+    // Latencies from the time each message was due and from its actual send.
+    Histogram corrected, uncorrected;
+};
+
+#endif
@@ -3,31 +3,92 @@
 
 #include <stdio.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <string>
+#include <vector>
 #include "strings.hpp"
 #include "message.hpp"
+#include "shm_channel.hpp"
+
+// How frames travel between a client and the server: over the TCP
+// connection, or through a shared memory segment when both run on the same
+// host (the connection then only carries doorbells).
+enum class Transport
+{
+    TCP,
+    SHARED_MEMORY,
+};
 
 class RiskClient
 {
 public:
-    RiskClient(uint64_t p);
+    RiskClient(uint64_t p, Transport transport = Transport::TCP);
+    // Connected to the server's Unix socket (--socket) instead of PORT.
+    explicit RiskClient(const std::string &socketPath);
+    ~RiskClient()
+    {
+        channel.reset();
+        close(mSocket);
+    }
     char *createDeleteOrderMessage(std::shared_ptr<Header> Header);
     char *createModifyOrderQuantityMessage(std::shared_ptr<Header> header);
     char *createNewOrderMessage(std::shared_ptr<Header> header);
     char *createTradeMessage(std::shared_ptr<Header> header);
     bool sendMessage(Header &header, char *message, bool replyExpected);
 
+    // Connected socket, for callers multiplexing several clients. Over
+    // shared memory it becomes readable when replies (or ring space) are
+    // available.
+    int descriptor() const { return mSocket; }
+    ssize_t receive(char *buffer, size_t size);
+    bool sharedMemory() const { return channel != NULL; }
+    ssize_t transmit(const char *buffer, size_t size);
+
+    /*
+    * Write one frame (header then payload) of a message to `frame`, which
+    * must hold sizeof(Header) + sizeof(Message) bytes.
+    *
+    * Returns
+    * -------
+    * size : size_t
+    *     Size of the frame.
+    */
+    template <typename Message>
+    static size_t encodeMessage(char *frame, uint32_t sequenceNumber, const Message &message)
+    {
+        Header header;
+        header.version = 0;
+        header.payloadSize = sizeof(Message);
+        header.sequenceNumber = sequenceNumber;
+        header.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        std::memcpy(frame, &header, sizeof(Header));
+        std::memcpy(frame + sizeof(Header), &message, sizeof(Message));
+        return sizeof(Header) + sizeof(Message);
+    }
+
     void runCLI();
 
 private:
+    void attachSharedMemory();
     void initSocket();
+    void initUnixSocket();
+    bool receiveExactly(char *buffer, size_t size);
+    bool transmitAll(const char *buffer, size_t size);
 
     uint64_t PORT;
+    std::string socketPath;
     struct sockaddr_in mAddress;
     int mSocket;
+    std::unique_ptr<SharedMemoryChannel> channel;
+    // Reused by the create*Message calls.
+    std::vector<char> messageBuffer;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#ifndef CONNECTION_HPP
+#define CONNECTION_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+#include "account_table.hpp"
+#include "message.hpp"
+#include "order_validation.hpp"
+#include "shm_channel.hpp"
+
+// Batch routed to the shards, answered once every entry came back.
+struct PendingBatch
+{
+    uint32_t sequenceNumber = 0;
+    uint16_t remaining = 0;
+    std::vector<BatchResponse::Entry> entries;
+};
+
+// Per-client socket state. The receive buffer is linear: bytes between
+// recvHead and recvTail are received but not yet decoded, partial frames
+// stay buffered until the rest arrives. Replies are built in place in the
+// send buffer and flushed once per event loop pass. Once the client attached
+// a shared memory segment, both buffers are filled from and drained to its
+// rings instead of the socket.
+struct Connection
+{
+    // Large enough for the biggest frame (Header + 65535 byte payload).
+    static constexpr size_t RECV_BUFFER_SIZE = 128 * 1024;
+    // Decoding stops once a reply no longer fits, until writes drain.
+    static constexpr size_t SEND_BUFFER_SIZE = 256 * 1024;
+
+    int socketDescriptor = -1;
+    // Set once the client moved the connection to shared memory.
+    std::unique_ptr<SharedMemoryChannel> channel;
+    // Segment attached but not used until the answer left the socket.
+    std::unique_ptr<SharedMemoryChannel> attached;
+    // Unique for the server's lifetime, unlike descriptors which are reused.
+    uint64_t session = 0;
+    // Set by the session's Logon, account 0 until then.
+    Account *account = NULL;
+    // Address accept returned, logged again on disconnect since the peer
+    // may be gone by then.
+    struct sockaddr_storage peer = {};
+    // Bytes of the replies owed by shards, kept free in the send buffer.
+    size_t replyBytesInFlight = 0;
+    // Batches split over the shards, by id.
+    std::unordered_map<uint32_t, PendingBatch> batches;
+    uint32_t nextBatch = 1;
+    // Steady clock ns of the last read and of the oldest unsent reply, set
+    // while metrics are recorded.
+    uint64_t receivedAt = 0, firstUnsentAt = 0;
+    std::vector<char> recvBuffer, sendBuffer;
+    size_t recvHead = 0, recvTail = 0;
+    // NewOrders of the complete frames validated but not yet decoded, by
+    // offset in the receive buffer, and their validity. Frames up to
+    // recvHead + validated were scanned, later ones are validated as they
+    // complete.
+    std::vector<uint32_t> orderOffsets;
+    std::vector<Validity> orderValidity;
+    size_t validated = 0;
+    size_t sendHead = 0, sendTail = 0;
+    bool flushQueued = false, readPaused = false;
+    bool readInterest = true, writeInterest = false;
+
+    Connection() {}
+    Connection(int fd) : socketDescriptor(fd), recvBuffer(RECV_BUFFER_SIZE), sendBuffer(SEND_BUFFER_SIZE) {}
+
+    char *readPointer() { return recvBuffer.data() + recvHead; }
+    size_t readable() const { return recvTail - recvHead; }
+    char *writePointer() { return recvBuffer.data() + recvTail; }
+    size_t writable() const { return recvBuffer.size() - recvTail; }
+
+    // Move the undecoded bytes, and the offsets of their NewOrders, to the
+    // front of the buffer.
+    void compact()
+    {
+        if (recvHead == 0)
+            return;
+        size_t pending = readable();
+        if (pending > 0)
+            std::memmove(recvBuffer.data(), readPointer(), pending);
+        for (uint32_t &offset : orderOffsets)
+            offset -= recvHead;
+        recvHead = 0;
+        recvTail = pending;
+    }
+
+    char *sendPointer() { return sendBuffer.data() + sendHead; }
+    size_t pendingSend() const { return sendTail - sendHead; }
+
+    // Space for an outgoing frame at the send tail, NULL if it does not fit.
+    char *reserveSend(size_t size)
+    {
+        if (sendBuffer.size() - sendTail < size && sendHead > 0)
+        {
+            size_t pending = pendingSend();
+            if (pending > 0)
+                std::memmove(sendBuffer.data(), sendPointer(), pending);
+            sendHead = 0;
+            sendTail = pending;
+        }
+        if (sendBuffer.size() - sendTail < size)
+            return NULL;
+        return sendBuffer.data() + sendTail;
+    }
+    void commitSend(size_t size) { sendTail += size; }
+};
+
+#endif
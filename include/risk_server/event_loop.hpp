@@ -0,0 +1,183 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <stdlib.h>
+#include <sys/select.h>
+#include <sys/types.h>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#endif
+
+// Notification backend used by the server's event loop: readiness (select,
+// epoll) or completions (io_uring).
+enum class IOBackend
+{
+    SELECT,
+    EPOLL,
+    IO_URING,
+};
+
+struct IOEvent
+{
+    int fd;
+    bool readable;
+    bool writable;
+    // Set when the loop already received from a connection: size bytes at
+    // data, valid until the next wait, 0 at end of stream or -errno.
+    bool received = false;
+    const char *data = NULL;
+    ssize_t size = 0;
+};
+
+// One non-blocking send of a batch, result is the bytes sent or -errno.
+struct IOSend
+{
+    int fd;
+    const char *buffer;
+    size_t size;
+    ssize_t result;
+};
+
+class EventLoop
+{
+public:
+    virtual ~EventLoop() {}
+    virtual bool add(int fd) = 0;
+    // Register a client connection, received by the loop if it receives().
+    virtual bool addConnection(int fd) { return add(fd); }
+    virtual void modify(int fd, bool readInterest, bool writeInterest) = 0;
+    // Whether connections are read by the loop rather than the caller.
+    virtual bool receives() const { return false; }
+    virtual void remove(int fd) = 0;
+    virtual void send(std::vector<IOSend> &sends);
+    virtual int wait(std::vector<IOEvent> &events) = 0;
+
+    static std::unique_ptr<EventLoop> create(IOBackend backend, uint32_t sqPollMillis = 0);
+};
+
+// Level-triggered fallback, rebuilds the fd_set on every wait.
+class SelectEventLoop : public EventLoop
+{
+public:
+    bool add(int fd) override;
+    void modify(int fd, bool readInterest, bool writeInterest) override;
+    void remove(int fd) override;
+    int wait(std::vector<IOEvent> &events) override;
+
+private:
+    std::set<int> readDescriptors, writeDescriptors;
+    fd_set readDescriptorSet, writeDescriptorSet;
+};
+
+#ifdef __linux__
+// Edge-triggered epoll, only ready descriptors are reported.
+class EpollEventLoop : public EventLoop
+{
+public:
+    EpollEventLoop();
+    ~EpollEventLoop();
+    bool add(int fd) override;
+    void modify(int fd, bool readInterest, bool writeInterest) override;
+    void remove(int fd) override;
+    int wait(std::vector<IOEvent> &events) override;
+
+    bool valid() const { return epollDescriptor >= 0; }
+
+private:
+    static constexpr int MAX_EVENTS = 256;
+    int epollDescriptor;
+    struct epoll_event readyEvents[MAX_EVENTS];
+};
+
+// io_uring driven by raw syscalls. Connections are read by a multishot recv
+// each, into a ring of buffers provided to the kernel, so a connection costs
+// no syscall to read and the data comes with its completion. Listeners are
+// watched with multishot polls, stalled writes with one-shot polls, and the
+// sends of a batch are submitted and reaped with one io_uring_enter. With
+// sqPollMillis, a kernel thread polls the submission queue and only sleeps
+// after that many idle milliseconds.
+class IoUringEventLoop : public EventLoop
+{
+public:
+    IoUringEventLoop(uint32_t sqPollMillis);
+    ~IoUringEventLoop();
+    bool add(int fd) override;
+    bool addConnection(int fd) override;
+    void modify(int fd, bool readInterest, bool writeInterest) override;
+    bool receives() const override { return true; }
+    void remove(int fd) override;
+    void send(std::vector<IOSend> &sends) override;
+    int wait(std::vector<IOEvent> &events) override;
+
+    bool valid() const { return ringDescriptor >= 0; }
+
+private:
+    static constexpr unsigned SQ_ENTRIES = 256, CQ_ENTRIES = 4096;
+    static constexpr unsigned BUFFER_COUNT = 256, BUFFER_SIZE = 16 * 1024;
+    static constexpr uint16_t BUFFER_GROUP = 0;
+
+    // Request kinds, the low bits of an SQE's user_data.
+    enum Kind : uint64_t
+    {
+        POLL_READ,
+        RECV,
+        POLL_WRITE,
+        SEND,
+        CANCEL,
+    };
+
+    // Requests armed on a descriptor. Completions of an earlier generation
+    // belong to a closed descriptor whose number was reused.
+    struct Watch
+    {
+        uint32_t generation = 0;
+        bool registered = false, connection = false;
+        bool readInterest = false, writeInterest = false;
+        bool readArmed = false, readCancelling = false;
+        bool writeArmed = false, writeCancelling = false;
+    };
+
+    static uint64_t userData(Kind kind, int fd, uint32_t generation) { return (uint64_t)generation << 32 | (uint64_t)fd << 3 | kind; }
+
+    void arm(int fd);
+    void cancel(uint64_t target);
+    void complete(const struct io_uring_cqe &cqe, std::vector<IOEvent> &events, std::vector<uint16_t> &held, std::vector<IOSend> *sends);
+    int enter(unsigned minComplete, unsigned flags = 0);
+    struct io_uring_sqe *nextSqe();
+    void reap(std::vector<IOEvent> &events, std::vector<uint16_t> &held, std::vector<IOSend> *sends);
+    void recycle(uint16_t buffer);
+    bool start(int fd, bool connection);
+    Watch &watch(int fd);
+
+    int ringDescriptor = -1;
+    bool sqPoll = false;
+    unsigned sqEntries = 0;
+    void *sqMap = NULL, *cqMap = NULL, *sqeMap = NULL;
+    size_t sqMapSize = 0, cqMapSize = 0, sqeMapSize = 0;
+    unsigned *sqHead = NULL, *sqTail = NULL, *sqMask = NULL, *sqArray = NULL, *sqFlags = NULL;
+    unsigned *cqHead = NULL, *cqTail = NULL, *cqMask = NULL;
+    struct io_uring_sqe *sqes = NULL;
+    struct io_uring_cqe *cqes = NULL;
+    unsigned sqLocalTail = 0;
+    // Provided buffer ring and the buffers it hands out.
+    struct io_uring_buf_ring *bufferRing = NULL;
+    char *buffers = NULL;
+    uint16_t bufferTail = 0;
+    // Buffers of the events last returned, recycled on the next wait.
+    std::vector<uint16_t> delivered;
+    // Connections whose recv ended for lack of buffers, re-armed on the next wait.
+    std::vector<int> starved;
+    // Completions reaped while a send batch was waited on.
+    std::vector<IOEvent> deferred;
+    std::vector<uint16_t> deferredBuffers;
+    std::vector<Watch> watches;
+};
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef FLAT_HASH_MAP_HPP
+#define FLAT_HASH_MAP_HPP
+
+#include <cstdint>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash map keyed on full 64-bit ids, values are stored inline
+// in the slot array so a lookup touches one slot in the common case. Linear
+// probing with backward-shift deletion, so erasing never leaves tombstones.
+// Pointers returned by find/insert are invalidated by any insert or erase.
+template <typename Value>
+class FlatHashMap
+{
+public:
+    FlatHashMap() { rehash(MIN_CAPACITY); }
+
+    Value *find(uint64_t key)
+    {
+        for (size_t i = indexFor(key);; i = (i + 1) & mask)
+        {
+            Slot &slot = slots[i];
+            if (!slot.occupied)
+                return NULL;
+            if (slot.key == key)
+                return &slot.value;
+        }
+    }
+
+    bool contains(uint64_t key) { return find(key) != NULL; }
+
+    // Insert the value if the key is absent, returns the stored value and
+    // true if it was inserted.
+    std::pair<Value *, bool> insert(uint64_t key, const Value &value)
+    {
+        if ((count + 1) * MAX_LOAD_DENOMINATOR > slots.size() * MAX_LOAD_NUMERATOR)
+            rehash(slots.size() * 2);
+
+        for (size_t i = indexFor(key);; i = (i + 1) & mask)
+        {
+            Slot &slot = slots[i];
+            if (!slot.occupied)
+            {
+                slot.key = key;
+                slot.value = value;
+                slot.occupied = true;
+                count++;
+                return {&slot.value, true};
+            }
+            if (slot.key == key)
+                return {&slot.value, false};
+        }
+    }
+
+    bool erase(uint64_t key)
+    {
+        size_t i = indexFor(key);
+        while (true)
+        {
+            if (!slots[i].occupied)
+                return false;
+            if (slots[i].key == key)
+                break;
+            i = (i + 1) & mask;
+        }
+
+        // Shift back every following entry that is displaced from its home
+        // slot, so probe sequences stay unbroken without tombstones.
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; slots[j].occupied; j = (j + 1) & mask)
+        {
+            size_t home = indexFor(slots[j].key);
+            if (((j - home) & mask) >= ((j - hole) & mask))
+            {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole].occupied = false;
+        count--;
+        return true;
+    }
+
+    // Pre-size the table so the given number of entries never triggers a rehash.
+    void reserve(size_t entries)
+    {
+        size_t capacity = MIN_CAPACITY;
+        while (entries * MAX_LOAD_DENOMINATOR > capacity * MAX_LOAD_NUMERATOR)
+            capacity *= 2;
+        if (capacity > slots.size())
+            rehash(capacity);
+    }
+
+    size_t size() const { return count; }
+
+    template <typename Function>
+    void forEach(Function function)
+    {
+        for (Slot &slot : slots)
+        {
+            if (slot.occupied)
+                function(slot.key, slot.value);
+        }
+    }
+
+private:
+    static constexpr size_t MIN_CAPACITY = 16;
+    static constexpr size_t MAX_LOAD_NUMERATOR = 7, MAX_LOAD_DENOMINATOR = 10;
+
+    struct Slot
+    {
+        uint64_t key;
+        Value value;
+        bool occupied = false;
+    };
+
+    // 64-bit finalizer (MurmurHash3 fmix64), sequential ids spread evenly.
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    size_t indexFor(uint64_t key) const { return hash(key) & mask; }
+
+    void rehash(size_t capacity)
+    {
+        std::vector<Slot> previous(capacity);
+        previous.swap(slots);
+        mask = capacity - 1;
+        count = 0;
+        for (Slot &slot : previous)
+        {
+            if (slot.occupied)
+                insert(slot.key, slot.value);
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t mask = 0, count = 0;
+};
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <errno.h>
+#include <functional>
+#include <mutex>
+#include <stdlib.h>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+
+// When appended records are forced to disk. Records live in a shared file
+// mapping, so without a sync they survive a process crash but not a power
+// loss or kernel crash.
+enum class JournalSync : uint8_t
+{
+    BATCH,    // Before the replies of each batch of handled messages are sent.
+    INTERVAL, // Every JournalOptions::intervalMillis, by a background thread.
+    NONE,     // Left to the kernel's writeback.
+};
+
+// Journal settings, parsed from the command line in server_main.
+struct JournalOptions
+{
+    std::string directory; // Empty disables journaling.
+    JournalSync sync = JournalSync::BATCH;
+    uint32_t intervalMillis = 10;
+    // Seconds between snapshots of the engine, 0 disables them.
+    uint32_t snapshotSeconds = 60;
+};
+
+// Point in a journal: a segment and a byte offset in it.
+struct JournalPosition
+{
+    uint32_t segment = 0;
+    uint64_t offset = 0;
+};
+
+// One accepted state transition of a risk engine, fixed size so the journal
+// is a plain array of records. A zero type marks the end of the records.
+struct JournalRecord
+{
+    enum class Type : uint8_t
+    {
+        END,
+        NEW_ORDER,
+        DELETE_ORDER, // Also written for orders rolled back on disconnect.
+        MODIFY_ORDER, // quantity is the new quantity.
+        TRADE,        // orderId is the trade id.
+    };
+
+    uint32_t checksum; // FNV-1a of the remaining bytes.
+    Type type;
+    char side;
+    uint16_t reserved;
+    uint64_t orderId;
+    uint64_t listingId;
+    int64_t quantity;
+    uint64_t price;
+    uint64_t account; // Of the order, or of the traded order.
+} __attribute__((__packed__));
+static_assert(sizeof(JournalRecord) == 48, "The JournalRecord size is not correct");
+
+// First bytes of every segment file.
+struct JournalSegmentHeader
+{
+    static constexpr uint32_t MAGIC = 0x4c4e524a; // "JRNL"
+    static constexpr uint16_t VERSION = 2;
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t engines; // Engines the listings were partitioned over.
+    uint32_t engine;
+    uint32_t segment;
+} __attribute__((__packed__));
+static_assert(sizeof(JournalSegmentHeader) == 16, "The JournalSegmentHeader size is not correct");
+
+// Snapshot of an engine (<directory>/engine-<engine>.snapshot): this header,
+// `instruments` SnapshotInstrument, `accountPositions` SnapshotAccountPosition
+// and `orders` SnapshotOrder back to back.
+// It holds the effect of every journal record before the journal position.
+struct SnapshotHeader
+{
+    static constexpr uint32_t MAGIC = 0x50414e53; // "SNAP"
+    static constexpr uint16_t VERSION = 3;
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t engines;
+    uint32_t engine;
+    uint32_t journalSegment;
+    uint64_t journalOffset;
+    uint64_t instruments;
+    uint64_t accountPositions;
+    uint64_t orders;
+} __attribute__((__packed__));
+static_assert(sizeof(SnapshotHeader) == 48, "The SnapshotHeader size is not correct");
+
+struct SnapshotInstrument
+{
+    uint64_t listingId;
+    uint64_t buyQty;
+    uint64_t sellQty;
+    int64_t netPos;
+    // Notionals (price x quantity) of the open orders and the net position.
+    __int128 buyNotional;
+    __int128 sellNotional;
+    __int128 netNotional;
+} __attribute__((__packed__));
+static_assert(sizeof(SnapshotInstrument) == 80, "The SnapshotInstrument size is not correct");
+
+struct SnapshotAccountPosition
+{
+    uint64_t account;
+    uint64_t listingId;
+    uint64_t buyQty;
+    uint64_t sellQty;
+    int64_t netPos;
+    __int128 buyNotional;
+    __int128 sellNotional;
+    __int128 netNotional;
+} __attribute__((__packed__));
+static_assert(sizeof(SnapshotAccountPosition) == 88, "The SnapshotAccountPosition size is not correct");
+
+struct SnapshotOrder
+{
+    uint64_t orderId;
+    uint64_t listingId;
+    uint64_t quantity;
+    uint64_t price;
+    uint64_t account;
+    char side;
+} __attribute__((__packed__));
+static_assert(sizeof(SnapshotOrder) == 41, "The SnapshotOrder size is not correct");
+
+// Buffered writer of the snapshot process. It never allocates: the process
+// is forked from a multi-threaded server, whose allocator locks may be held
+// by threads which do not exist in the child.
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(int d) : descriptor(d) {}
+
+    bool write(const void *data, size_t size)
+    {
+        if (used + size > sizeof(buffer) && !flush())
+            return false;
+        std::memcpy(buffer + used, data, size);
+        used += size;
+        return true;
+    }
+
+    bool flush()
+    {
+        for (size_t written = 0; written < used;)
+        {
+            ssize_t result = ::write(descriptor, buffer + written, used - written);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0)
+                return false;
+            written += result;
+        }
+        used = 0;
+        return true;
+    }
+
+private:
+    int descriptor;
+    size_t used = 0;
+    char buffer[1 << 16];
+};
+
+// Append-only write-ahead journal of one risk engine, replayed on startup to
+// recover its open orders and positions. Records are copied into
+// preallocated, memory-mapped segment files (<directory>/engine-<engine>-
+// <segment>.journal) and a full segment is closed for a new one. Appends
+// come from the engine's thread only, commit() and the interval thread may
+// run on others.
+//
+// Snapshots bound the replay: the engine's thread forks and the child writes
+// the copy-on-write image of the engine to a new snapshot, then deletes the
+// segments it covers. Startup restores the snapshot and replays the tail.
+class Journal
+{
+public:
+    static constexpr size_t SEGMENT_SIZE = 64 << 20;
+
+    // Restores an engine from the mapped snapshot.
+    typedef std::function<void(const SnapshotHeader &header, const SnapshotInstrument *instruments, const SnapshotAccountPosition *accountPositions, const SnapshotOrder *orders)> Restore;
+    // Writes the engine to a snapshot, header and all, in the forked child.
+    typedef std::function<bool(SnapshotWriter &writer, SnapshotHeader &header)> Write;
+
+    Journal(const JournalOptions &o, uint32_t e, uint32_t n) : options(o), engine(e), engines(n) {}
+    ~Journal();
+
+    void append(JournalRecord &record);
+    void commit();
+    bool commitsPerBatch() const { return options.sync == JournalSync::BATCH; }
+    bool loadSnapshot(const Restore &restore, JournalPosition &from);
+    bool open(const std::function<void(const JournalRecord &)> &apply, const JournalPosition &from, size_t &replayed);
+    void snapshot(const Write &write);
+    bool snapshotDue() const;
+
+    static uint32_t checksum(const JournalRecord &record);
+
+private:
+    static uint64_t now();
+
+    std::string segmentPath(uint32_t segment) const;
+    std::string snapshotPath() const;
+    bool mapSegment(uint32_t segment, bool create);
+    void rotate();
+    void sync(size_t end);
+    void syncPeriodically();
+    void unmapSegment();
+
+    JournalOptions options;
+    uint32_t engine = 0, engines = 1;
+    int descriptor = -1;
+    uint32_t segment = 0;
+    char *mapping = NULL;
+    // Bytes of the segment holding records, and the prefix forced to disk.
+    std::atomic<size_t> tail{0}, synced{0};
+    // Held by syncs and rotations, so a sync never sees an unmapped segment.
+    std::mutex syncMutex;
+
+    std::thread syncThread;
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool stopping = false;
+
+    // Oldest segment on disk, and the position of the last snapshot forked.
+    uint32_t firstSegment = 0;
+    JournalPosition snapshotted;
+    pid_t snapshotProcess = -1;
+    std::atomic<uint64_t> nextSnapshotAt{0};
+};
+
+#endif
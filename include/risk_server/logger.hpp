@@ -0,0 +1,132 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runtime log levels, a record is written if its level <= the current level.
+enum class LogLevel : uint8_t
+{
+    OFF = 0,
+    ERR = 1,
+    WARN = 2,
+    SUCC = 3,
+    LOG = 4,
+};
+
+// Event codes, each maps to a definition in strings.hpp.
+enum class LogEvent : uint16_t
+{
+    ORDER_ALREADY_EXISTS,
+    ORDER_DOES_NOT_EXIST,
+    INVALID_DATA,
+    UNKNOWN_LISTING,
+    NEW_ORDER_CREATED,
+    ORDER_DELETED,
+    ORDER_QUANTITY_MODIFIED,
+    TRADE_EXECUTED,
+    NEW_ORDER_REJECTED,
+    MODIFY_ORDER_REJECTED,
+    NEW_CONNECTION,
+    DISCONNECTED,
+    RECORDS_DROPPED,
+    ORDER_POOL_GROWN,
+    COUNT, // Number of events, keep last.
+};
+
+// Fixed-size binary record, formatted to text by the logger thread.
+struct LogRecord
+{
+    uint64_t timestamp;
+    uint64_t orderId;
+    uint64_t listingId;
+    int64_t quantity;
+    LogEvent event;
+};
+
+// Single-producer single-consumer ring of log records. Each producing thread
+// owns one queue, the logger thread is the only consumer.
+struct LogQueue
+{
+    static constexpr uint64_t CAPACITY = 1 << 16;
+
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    uint64_t cachedHead = 0;
+    std::atomic<uint64_t> dropped{0};
+    // Occurrences of every event, written by the owning thread only.
+    std::atomic<uint64_t> events[(size_t)LogEvent::COUNT] = {};
+    LogRecord records[CAPACITY];
+
+    void count(LogEvent event)
+    {
+        std::atomic<uint64_t> &counter = events[(size_t)event];
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    bool push(const LogRecord &record);
+};
+
+class Logger
+{
+public:
+    static Logger &instance();
+    ~Logger();
+
+    static const char *name(LogEvent event);
+    static const char *text(LogEvent event);
+    static LogLevel levelOf(LogEvent event)
+    {
+        if (event <= LogEvent::UNKNOWN_LISTING)
+            return LogLevel::ERR;
+        if (event <= LogEvent::TRADE_EXECUTED)
+            return LogLevel::SUCC;
+        if (event <= LogEvent::MODIFY_ORDER_REJECTED)
+            return LogLevel::WARN;
+        return LogLevel::LOG;
+    }
+
+    uint64_t eventCount(LogEvent event);
+
+    // Hot path: every event is counted whatever the level, a disabled level
+    // then costs one relaxed load.
+    void log(LogEvent event, uint64_t orderId = 0, uint64_t listingId = 0, int64_t quantity = 0)
+    {
+        LogQueue &queue = threadQueue();
+        queue.count(event);
+        if (levelOf(event) > level.load(std::memory_order_relaxed))
+            return;
+        record(queue, event, orderId, listingId, quantity);
+    }
+    void setLevel(LogLevel newLevel) { level.store(newLevel, std::memory_order_relaxed); }
+
+private:
+    Logger();
+    bool drain();
+    bool drainQueue(LogQueue &queue);
+    void format(const LogRecord &record);
+    void record(LogQueue &queue, LogEvent event, uint64_t orderId, uint64_t listingId, int64_t quantity);
+    LogQueue *registerQueue();
+
+    // The calling thread's queue, registered with the logger thread on first use.
+    LogQueue &threadQueue()
+    {
+        if (localQueue == NULL)
+            localQueue = registerQueue();
+        return *localQueue;
+    }
+
+    static thread_local LogQueue *localQueue;
+
+    std::atomic<LogLevel> level{LogLevel::LOG};
+    std::atomic<bool> running{true};
+    std::mutex queuesMutex;
+    std::vector<std::unique_ptr<LogQueue>> queues;
+    uint64_t totalDropped = 0; // Guarded by queuesMutex.
+    std::thread consumer;
+};
+
+#endif
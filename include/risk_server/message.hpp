@@ -1,9 +1,43 @@
 #ifndef MESSAGE_HPP
 #define MESSAGE_HPP
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+// Many sub-messages in one frame: the payload is this struct followed by
+// `count` NewOrder, DeleteOrder, ModifyOrderQuantity or Trade messages back to
+// back, each sized by its own messageType. Sub-messages are handled in order
+// and answered by a single BatchResponse.
+struct Batch
+{
+    static constexpr uint16_t MESSAGE_TYPE = 6;
+    uint16_t messageType;
+    uint16_t count;
+} __attribute__((__packed__));
+static_assert(sizeof(Batch) == 4, "The Batch size is not correct");
+
+// Reply to a Batch: this struct followed by `count` entries, one per NewOrder
+// and ModifyOrderQuantity sub-message in batch order.
+struct BatchResponse
+{
+    static constexpr uint16_t MESSAGE_TYPE = 7;
+    struct Entry
+    {
+        uint64_t orderId;
+        uint16_t status; // OrderResponse::Status
+    } __attribute__((__packed__));
+    uint16_t messageType;
+    uint16_t count;
+} __attribute__((__packed__));
+static_assert(sizeof(BatchResponse) == 4, "The BatchResponse size is not correct");
+static_assert(sizeof(BatchResponse::Entry) == 10, "The BatchResponse::Entry size is not correct");
+
 struct DeleteOrder
 {
     static constexpr uint16_t MESSAGE_TYPE = 2;
+    static constexpr bool REPLIED = false;
     uint16_t messageType;
     uint64_t orderId;
 } __attribute__((__packed__));
@@ -18,10 +52,22 @@ struct Header
 } __attribute__((__packed__));
 static_assert(sizeof(Header) == 16, "The Header size is not correct");
 
+// Binds the session to a trading account, whose limits its later orders are
+// checked against. Not answered; sessions which never log on trade as
+// account 0.
+struct Logon
+{
+    static constexpr uint16_t MESSAGE_TYPE = 8;
+    uint16_t messageType;
+    uint64_t account;
+} __attribute__((__packed__));
+static_assert(sizeof(Logon) == 10, "The Logon size is not correct");
+
 // Modify order quatity
 struct ModifyOrderQuantity
 {
     static constexpr uint16_t MESSAGE_TYPE = 3;
+    static constexpr bool REPLIED = true;
     uint16_t messageType;
     uint64_t orderId;
     uint64_t newQuantity;
@@ -31,6 +77,7 @@ static_assert(sizeof(ModifyOrderQuantity) == 18, "The ModifyOrderQuantity size i
 struct NewOrder
 {
     static constexpr uint16_t MESSAGE_TYPE = 1;
+    static constexpr bool REPLIED = true;
     uint16_t messageType;
     uint64_t listingId;
     uint64_t orderId;
@@ -54,9 +101,22 @@ struct OrderResponse
 } __attribute__((__packed__));
 static_assert(sizeof(OrderResponse) == 12, "The OrderResponse size is not correct");
 
+// Moves the connection to a shared memory segment the client created, named
+// by `name` (NUL-terminated). Answered on the socket with an OrderResponse
+// for order id 0, ACCEPTED if the server attached the segment; every later
+// frame then goes through it. Only valid before any other answered message.
+struct SharedMemoryAttach
+{
+    static constexpr uint16_t MESSAGE_TYPE = 9;
+    uint16_t messageType;
+    char name[32];
+} __attribute__((__packed__));
+static_assert(sizeof(SharedMemoryAttach) == 34, "The SharedMemoryAttach size is not correct");
+
 struct Trade
 {
     static constexpr uint16_t MESSAGE_TYPE = 4;
+    static constexpr bool REPLIED = false;
     uint16_t messageType;
     uint64_t listingId;
     uint64_t tradeId;
@@ -65,4 +125,77 @@ struct Trade
 } __attribute__((__packed__));
 static_assert(sizeof(Trade) == 34, "The Trade size is not correct");
 
+// Compile-time registry of message types: each message declares its
+// MESSAGE_TYPE and whether it is REPLIED to with an OrderResponse, and the
+// registry lays out their sizes and reply flags in a table indexed by type,
+// so a lookup is one bounded load however many types are registered.
+template <typename... Messages>
+class MessageRegistry
+{
+public:
+    struct Entry
+    {
+        uint16_t size;
+        bool replied;
+    };
+    // One past the highest registered type.
+    static constexpr uint16_t TYPES = std::max({Messages::MESSAGE_TYPE...}) + 1;
+
+    // Size and reply flag of a message type, size 0 if it is not registered.
+    static constexpr Entry at(uint16_t messageType) { return messageType < TYPES ? ENTRIES[messageType] : Entry{0, false}; }
+
+private:
+    static constexpr std::array<Entry, TYPES> entries()
+    {
+        std::array<Entry, TYPES> table{};
+        ((table[Messages::MESSAGE_TYPE] = Entry{sizeof(Messages), Messages::REPLIED}), ...);
+        return table;
+    }
+
+    static constexpr std::array<Entry, TYPES> ENTRIES = entries();
+};
+
+// Messages handled by the risk engine, the ones a Batch can carry.
+typedef MessageRegistry<NewOrder, DeleteOrder, ModifyOrderQuantity, Trade> EngineMessages;
+
+/*
+* Size of a message which a Batch can carry, 0 for any other type.
+*/
+inline uint16_t batchedMessageSize(uint16_t messageType)
+{
+    return EngineMessages::at(messageType).size;
+}
+
+/*
+* Check the framing of a Batch payload and count its answered sub-messages.
+*
+* Returns
+* -------
+* replies : int
+*     Number of BatchResponse entries owed, -1 if the sub-messages do not
+*     exactly fill the payload or one of them cannot be batched.
+*/
+inline int batchReplies(const char *payload, uint16_t payloadSize)
+{
+    Batch batch;
+    if (payloadSize < sizeof(Batch))
+        return -1;
+    std::memcpy(&batch, payload, sizeof(Batch));
+    size_t offset = sizeof(Batch);
+    int replies = 0;
+    for (uint16_t i = 0; i < batch.count; i++)
+    {
+        uint16_t messageType;
+        if (offset + sizeof(messageType) > payloadSize)
+            return -1;
+        std::memcpy(&messageType, payload + offset, sizeof(messageType));
+        EngineMessages::Entry entry = EngineMessages::at(messageType);
+        if (entry.size == 0 || offset + entry.size > payloadSize)
+            return -1;
+        replies += entry.replied;
+        offset += entry.size;
+    }
+    return offset == payloadSize ? replies : -1;
+}
+
 #endif
\ No newline at end of file
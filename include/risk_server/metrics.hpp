@@ -0,0 +1,121 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "message.hpp"
+
+// Latency stages measured per message.
+enum class LatencyStage : uint8_t
+{
+    RECEIVE_TO_DECODE, // Socket read returned until the frame is decoded.
+    RISK_CHECK,        // Message handled by the risk engine.
+    REPLY_SEND,        // Oldest unsent reply queued until the send buffer drained.
+    COUNT,
+};
+
+// Message types counted on receipt, anything unknown or malformed is INVALID.
+enum class MessageKind : uint8_t
+{
+    NEW_ORDER,
+    DELETE_ORDER,
+    MODIFY_ORDER_QUANTITY,
+    TRADE,
+    BATCH,
+    LOGON,
+    SHARED_MEMORY_ATTACH,
+    INVALID,
+    COUNT,
+};
+
+// HDR-style log-linear histogram of nanosecond latencies: every power of two
+// is split into 2^SUB_BUCKET_BITS linear buckets, so any recorded value is
+// reported within ~3%. Written by a single thread with relaxed atomics and
+// read concurrently without locks.
+class LatencyHistogram
+{
+public:
+    static constexpr uint32_t SUB_BUCKET_BITS = 5;
+    static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    // Values up to 2^MAX_MAGNITUDE ns (~18 minutes), larger ones are clamped.
+    static constexpr uint32_t MAX_MAGNITUDE = 40;
+    static constexpr size_t BUCKETS = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static size_t bucketFor(uint64_t nanos);
+    static uint64_t highestValueIn(size_t bucket);
+    static uint64_t valueAtQuantile(const uint64_t *buckets, uint64_t count, uint64_t max, double quantile);
+
+    void record(uint64_t nanos)
+    {
+        increment(buckets[bucketFor(nanos)], 1);
+        increment(count, 1);
+        increment(sum, nanos);
+        if (nanos > max.load(std::memory_order_relaxed))
+            max.store(nanos, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+    std::atomic<uint64_t> count{0}, sum{0}, max{0};
+
+private:
+    static void increment(std::atomic<uint64_t> &counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+};
+
+// Counters and histograms of one recording thread.
+struct ThreadMetrics
+{
+    std::atomic<uint64_t> messages[(size_t)MessageKind::COUNT] = {};
+    std::atomic<uint64_t> replies[2] = {}; // Indexed by OrderResponse::Status.
+    LatencyHistogram latencies[(size_t)LatencyStage::COUNT];
+};
+
+// Process-wide metrics registry. Each recording thread (I/O workers, shards)
+// owns a ThreadMetrics so recording never contends, the admin endpoint sums
+// them on read. Recording is off until an admin endpoint enables it.
+class Metrics
+{
+public:
+    static Metrics &instance();
+
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool enabled() const { return recording.load(std::memory_order_relaxed); }
+    void enable() { recording.store(true, std::memory_order_relaxed); }
+
+    void countMessage(const char *payload, uint16_t payloadSize);
+    void countReply(OrderResponse::Status status);
+    void recordLatency(LatencyStage stage, uint64_t nanos) { threadMetrics().latencies[(size_t)stage].record(nanos); }
+
+    std::string prometheusText();
+
+private:
+    Metrics() {}
+    ThreadMetrics *registerThread();
+
+    ThreadMetrics &threadMetrics()
+    {
+        if (localMetrics == NULL)
+            localMetrics = registerThread();
+        return *localMetrics;
+    }
+
+    static thread_local ThreadMetrics *localMetrics;
+
+    std::atomic<bool> recording{false};
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadMetrics>> threads;
+};
+
+#endif
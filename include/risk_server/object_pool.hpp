@@ -0,0 +1,82 @@
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP
+
+#include <cstdint>
+#include <memory>
+#include <stdlib.h>
+#include <vector>
+
+// Occupancy statistics of an ObjectPool.
+struct PoolStats
+{
+    size_t live = 0, capacity = 0, highWater = 0;
+    uint64_t allocations = 0, releases = 0;
+};
+
+// Typed pool of objects allocated in fixed-size slabs. Objects are addressed
+// by stable 32-bit handles which stay valid until released, slabs are never
+// freed or moved, and released handles are reused LIFO so hot objects stay
+// in cache.
+template <typename T>
+class ObjectPool
+{
+public:
+    static constexpr uint32_t INVALID_HANDLE = UINT32_MAX;
+
+    uint32_t allocate()
+    {
+        if (freeHandles.empty())
+            addSlab();
+        uint32_t handle = freeHandles.back();
+        freeHandles.pop_back();
+
+        stats.allocations++;
+        stats.live++;
+        if (stats.live > stats.highWater)
+            stats.highWater = stats.live;
+        return handle;
+    }
+
+    void release(uint32_t handle)
+    {
+        freeHandles.push_back(handle);
+        stats.releases++;
+        stats.live--;
+    }
+
+    T &operator[](uint32_t handle) { return slabs[handle >> SLAB_SHIFT][handle & SLAB_MASK]; }
+
+    // Pre-allocate slabs so the given number of live objects never grows the pool.
+    void reserve(size_t objects)
+    {
+        // Sized once, growing it slab by slab would copy it every time.
+        if (stats.capacity < objects)
+            freeHandles.reserve(freeHandles.size() + objects - stats.capacity + SLAB_SIZE);
+        while (stats.capacity < objects)
+            addSlab();
+    }
+
+    const PoolStats &getStats() const { return stats; }
+
+private:
+    static constexpr uint32_t SLAB_SHIFT = 12;
+    static constexpr uint32_t SLAB_SIZE = 1 << SLAB_SHIFT;
+    static constexpr uint32_t SLAB_MASK = SLAB_SIZE - 1;
+
+    void addSlab()
+    {
+        uint32_t first = slabs.size() << SLAB_SHIFT;
+        slabs.emplace_back(new T[SLAB_SIZE]());
+        freeHandles.reserve(freeHandles.size() + SLAB_SIZE);
+        // Pushed in reverse so handles are handed out in ascending order.
+        for (uint32_t i = SLAB_SIZE; i > 0; i--)
+            freeHandles.push_back(first + i - 1);
+        stats.capacity += SLAB_SIZE;
+    }
+
+    std::vector<std::unique_ptr<T[]>> slabs;
+    std::vector<uint32_t> freeHandles;
+    PoolStats stats;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef ORDER_DIRECTORY_HPP
+#define ORDER_DIRECTORY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdlib.h>
+
+#include "flat_hash_map.hpp"
+
+// Maps open order ids to the shard owning them, so Delete and Modify messages
+// which only carry an order id can be routed. I/O threads claim an id when a
+// NewOrder is routed and erase it when a Delete is routed, shards release a
+// claim when the order is rejected or its session closes. Every claim gets a
+// unique number so a late release never drops a newer claim on a reused id.
+// Ids are spread over striped locks to keep threads off a single mutex.
+class OrderDirectory
+{
+public:
+    static constexpr uint32_t NO_CLAIM = 0;
+
+    // Claim the order id for the shard, NO_CLAIM if the id is already open.
+    uint32_t claim(uint64_t orderId, uint32_t shard)
+    {
+        uint32_t number = nextClaim.fetch_add(1, std::memory_order_relaxed);
+        if (number == NO_CLAIM)
+            number = nextClaim.fetch_add(1, std::memory_order_relaxed);
+
+        Stripe &stripe = stripeFor(orderId);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        return stripe.entries.insert(orderId, {shard, number}).second ? number : NO_CLAIM;
+    }
+
+    // The shard owning the order id, false if the id is not open.
+    bool find(uint64_t orderId, uint32_t &shard)
+    {
+        Stripe &stripe = stripeFor(orderId);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Entry *entry = stripe.entries.find(orderId);
+        if (entry == NULL)
+            return false;
+        shard = entry->shard;
+        return true;
+    }
+
+    // Close the order id, returns the shard which owned it.
+    bool erase(uint64_t orderId, uint32_t &shard)
+    {
+        Stripe &stripe = stripeFor(orderId);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Entry *entry = stripe.entries.find(orderId);
+        if (entry == NULL)
+            return false;
+        shard = entry->shard;
+        stripe.entries.erase(orderId);
+        return true;
+    }
+
+    // Close the order id if it is still held by the given claim.
+    void release(uint64_t orderId, uint32_t claim)
+    {
+        if (claim == NO_CLAIM)
+            return;
+        Stripe &stripe = stripeFor(orderId);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Entry *entry = stripe.entries.find(orderId);
+        if (entry != NULL && entry->claim == claim)
+            stripe.entries.erase(orderId);
+    }
+
+    void reserve(size_t orders)
+    {
+        for (Stripe &stripe : stripes)
+            stripe.entries.reserve(orders / STRIPES + 1);
+    }
+
+private:
+    static constexpr size_t STRIPE_SHIFT = 6;
+    static constexpr size_t STRIPES = 1 << STRIPE_SHIFT;
+
+    struct Entry
+    {
+        uint32_t shard, claim;
+    };
+
+    struct alignas(64) Stripe
+    {
+        std::mutex mutex;
+        FlatHashMap<Entry> entries;
+    };
+
+    // Top bits of a multiplicative hash, independent of the map's own slot hash.
+    Stripe &stripeFor(uint64_t orderId) { return stripes[(orderId * 0x9e3779b97f4a7c15ULL) >> (64 - STRIPE_SHIFT)]; }
+
+    Stripe stripes[STRIPES];
+    std::atomic<uint32_t> nextClaim{1};
+};
+
+#endif
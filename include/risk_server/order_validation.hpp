@@ -0,0 +1,48 @@
+#ifndef ORDER_VALIDATION_HPP
+#define ORDER_VALIDATION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdlib.h>
+
+#include "message.hpp"
+
+// Outcome of the field checks of a NewOrder, for the handlers of orders
+// validated before they reached the engine.
+enum class Validity : uint8_t
+{
+    UNCHECKED,
+    VALID,
+    INVALID,
+};
+
+// Field checks of NewOrder records which need no risk state: a price, a
+// quantity within MAX_QUANTITY, a notional within int64_t and a 'B' or 'S'
+// side. Many records are checked at once with AVX2 or SSE4.1 when the CPU
+// has them (chosen once at startup), or one by one otherwise.
+class OrderValidator
+{
+public:
+    // Largest order, modify or trade quantity, keeps every exposure sum
+    // within int64_t.
+    static constexpr uint64_t MAX_QUANTITY = INT32_MAX;
+
+    // Whether quantity x price fits int64_t, true of every order, modify and
+    // trade accepted, so notional changes are exact.
+    static bool validNotional(uint64_t quantity, uint64_t price)
+    {
+        int64_t notional;
+        return price <= INT64_MAX && !__builtin_mul_overflow((int64_t)quantity, (int64_t)price, &notional);
+    }
+
+    static bool valid(const NewOrder &order)
+    {
+        return order.orderPrice > 0 && order.orderQuantity > 0 && order.orderQuantity <= MAX_QUANTITY &&
+               validNotional(order.orderQuantity, order.orderPrice) && (order.side == 'B' || order.side == 'S');
+    }
+
+    static const char *instructionSet();
+    static void validate(const char *base, const uint32_t *offsets, size_t count, Validity *validity);
+};
+
+#endif
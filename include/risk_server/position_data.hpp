@@ -2,31 +2,133 @@
 #define POSITION_DATA_HPP
 
 #include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "account_table.hpp"
+#include "flat_hash_map.hpp"
+#include "risk_limits.hpp"
 
 struct Order
 {
     char side;
     uint64_t orderId, financialInstrumentId, qty, price;
+    uint32_t instrumentIndex = 0; // Dense index of financialInstrumentId in the PositionTable
+    uint32_t claim = 0;           // OrderDirectory claim on orderId, sharded mode only
+    Account *account = NULL;
+    uint32_t accountPosition = 0; // Index of the account's position in the instrument
+    // Owning session (0 for recovered orders) and the pool handles of its
+    // previous and next live orders, UINT32_MAX at either end.
+    uint64_t session = 0;
+    uint32_t previousInSession = UINT32_MAX, nextInSession = UINT32_MAX;
 
     Order() {}
     Order(uint64_t id, uint64_t instrument, uint64_t qty, uint64_t price, char side)
         : orderId(id), financialInstrumentId(instrument), qty(qty), price(price), side(side) {}
 };
 
-class PositionData
+// Quantities and notionals of a position: its open buy and sell orders and
+// its net traded position, valued at average cost.
+struct Exposure
+{
+    uint64_t buyQty = 0, sellQty = 0;
+    int64_t netPos = 0;
+    Notional buyNotional = 0, sellNotional = 0, netNotional = 0;
+};
+
+// Position of one account in one instrument, with the headroom left under
+// its account x instrument limit.
+struct AccountPosition
+{
+    Account *account;
+    uint32_t instrument;
+    Exposure exposure;
+    int64_t buyHeadroom = INT64_MAX, sellHeadroom = INT64_MAX;
+    Notional buyNotionalHeadroom = INT64_MAX, sellNotionalHeadroom = INT64_MAX;
+};
+
+// Struct-of-arrays position data of every instrument. Listing ids map to
+// dense indices once, after which every risk check is an indexed array
+// access. The listing universe is either loaded at startup (fixed) or
+// registered on first use.
+//
+// The hypothetical buy (sell) exposure of a position is its open buy (sell)
+// quantity plus its long (short) net position, and likewise in notional:
+// open buy (sell) price x quantity plus the long (short) net notional. Each
+// level of the limit hierarchy keeps limit - exposure as headroom, so a check
+// is a compare of the quantity and notional change against the instrument,
+// account x instrument, account and portfolio headroom, and accepting it
+// subtracts the change from each and adds it to the portfolio aggregates.
+class PositionTable
 {
 public:
-    bool addPosition(std::shared_ptr<Order> order, uint64_t BUY_THRESHOLD, uint64_t SELL_THRESHOLD);
-    uint64_t modifyPosition(std::shared_ptr<Order> order, uint64_t newQty, uint64_t BUY_THRESHOLD, uint64_t SELL_THRESHOLD);
-    void rollbackPosition(std::shared_ptr<Order> order);
-    void trade(int64_t tradeQty);
+    static constexpr uint32_t INVALID_INSTRUMENT = UINT32_MAX;
+
+    PositionTable(const RiskLimits *l, Portfolio &p) : limits(l), portfolio(p) {}
+
+    bool loadUniverse(const std::string &path);
+    uint32_t findInstrument(uint64_t listingId);
+    uint32_t findOrRegisterAccountPosition(Account *account, uint32_t instrument);
+    uint32_t findOrRegisterInstrument(uint64_t listingId);
+    size_t size() const { return listingIds.size(); }
+    size_t accountPositionCount() const { return accountPositions.size(); }
+
+    // Calls function(listingId, exposure) for every instrument.
+    template <typename Function>
+    void forEachInstrument(Function function) const
+    {
+        for (size_t i = 0; i < listingIds.size(); i++)
+        {
+            Exposure exposure;
+            exposure.buyQty = buyQty[i];
+            exposure.sellQty = sellQty[i];
+            exposure.netPos = netPos[i];
+            exposure.buyNotional = buyNotional[i];
+            exposure.sellNotional = sellNotional[i];
+            exposure.netNotional = netNotional[i];
+            function(listingIds[i], exposure);
+        }
+    }
+
+    // Calls function(account, listingId, exposure) for every account
+    // position.
+    template <typename Function>
+    void forEachAccountPosition(Function function) const
+    {
+        for (const AccountPosition &position : accountPositions)
+            function(position.account->id, listingIds[position.instrument], position.exposure);
+    }
+
+    void restoreAccountPosition(uint32_t accountPosition, const Exposure &exposure);
+    void restorePosition(uint32_t instrument, const Exposure &exposure);
+    void setLimits(const RiskLimits *newLimits);
+
+    bool addPosition(Order &order, bool checked = true);
+    bool modifyPosition(Order &order, uint64_t newQty, bool checked = true);
+    void rollbackPosition(Order &order);
+    void rollbackPositions(uint32_t accountPosition, bool buy, int64_t qty, Notional notional);
+    void trade(uint32_t instrument, uint32_t accountPosition, int64_t tradeQty, uint64_t tradePrice);
 
 private:
-    uint64_t instrument_id = 0, buyQty = 0, sellQty = 0;
-    int64_t netPos = 0;
-    uint64_t calcHypotheticalBuy() const;
-    uint64_t calcHypotheticalSell() const;
+    bool changePosition(Order &order, int64_t delta, bool checked);
+    void moveOpen(AccountPosition &position, bool buy, int64_t delta, Notional notional, bool reserved);
+    uint32_t registerInstrument(uint64_t listingId);
+    void resetHeadroom(AccountPosition &position);
+    void resetHeadroom(uint32_t instrument);
+
+    const RiskLimits *limits;
+    Portfolio &portfolio;
+    bool fixedUniverse = false;
+    FlatHashMap<uint32_t> listingId2Instrument;
+    std::vector<uint64_t> listingIds, buyQty, sellQty;
+    std::vector<int64_t> netPos, buyHeadroom, sellHeadroom;
+    std::vector<Notional> buyNotional, sellNotional, netNotional, buyNotionalHeadroom, sellNotionalHeadroom;
+    // Keyed by account index << 32 | instrument.
+    FlatHashMap<uint32_t> accountPositionIndex;
+    std::vector<AccountPosition> accountPositions;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,110 @@
+#ifndef RISK_ENGINE_HPP
+#define RISK_ENGINE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdlib.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "account_table.hpp"
+#include "flat_hash_map.hpp"
+#include "journal.hpp"
+#include "logger.hpp"
+#include "message.hpp"
+#include "object_pool.hpp"
+#include "order_directory.hpp"
+#include "order_validation.hpp"
+#include "position_data.hpp"
+#include "risk_limits.hpp"
+
+// Risk state and message handlers for a set of listings: open orders,
+// positions and the orders of every session. Not thread-safe, an engine is
+// owned by the I/O thread when unsharded or by one RiskShard thread.
+class RiskEngine
+{
+public:
+    RiskEngine(LimitsRegistry &l, AccountTable &a, size_t orderCapacity) : limits(l), accounts(a), positions(l.current(), a.getPortfolio())
+    {
+        orderId2Order.reserve(orderCapacity);
+        orders.reserve(orderCapacity);
+        reader = limits.addReader();
+        adoptLimits();
+    }
+
+    uint16_t handleBatch(uint64_t session, Account *account, char *buffer, Header &header, BatchResponse::Entry *entries, const Validity *validity = NULL);
+    bool handleMessage(uint64_t session, Account *account, OrderResponse &orderResponse, char *buffer, Header &header, uint32_t claim = OrderDirectory::NO_CLAIM,
+                       Validity validity = Validity::UNCHECKED);
+    Journal *getJournal() const { return journal; }
+    bool loadUniverse(const std::string &path) { return positions.loadUniverse(path); }
+    bool recover(Journal *engineJournal, uint32_t shard, size_t &restored, size_t &replayed);
+    // Move to reloaded limits, if any. Called between messages by the
+    // engine's owner, a relaxed load when nothing changed.
+    void refreshLimits()
+    {
+        if (limits.version() != limitsVersion)
+            adoptLimits();
+    }
+    void removeUser(uint64_t session);
+    void setDirectory(OrderDirectory *orderDirectory) { directory = orderDirectory; }
+    void snapshotIfDue();
+
+private:
+    // Arguments of a message, passed on to its handler.
+    struct MessageContext
+    {
+        uint64_t session;
+        Account *account;
+        OrderResponse &orderResponse;
+        uint32_t claim;
+        // Of a NewOrder whose fields the I/O thread already checked.
+        Validity validity;
+    };
+    typedef void (RiskEngine::*Handler)(const char *payload, MessageContext &context);
+
+    // Hand a handler a typed view of a payload whose size was checked. The
+    // messages are packed, so the view needs no alignment.
+    template <typename Message, void (RiskEngine::*handler)(const Message &, MessageContext &)>
+    void dispatch(const char *payload, MessageContext &context)
+    {
+        (this->*handler)(*reinterpret_cast<const Message *>(payload), context);
+    }
+
+    // Handler of every EngineMessages type, indexed by message type.
+    static const std::array<Handler, EngineMessages::TYPES> HANDLERS;
+
+    void adoptLimits();
+    uint32_t allocateOrder(const Order &order);
+    void appendToJournal(JournalRecord::Type type, const Order &order);
+    void applyRecord(const JournalRecord &record, uint32_t shard);
+    void createNewOrder(const NewOrder &newOrder, MessageContext &context);
+    void deleteExistingOrder(const DeleteOrder &deleteOrder, MessageContext &context);
+    void executeTrade(const Trade &trade, MessageContext &context);
+    void linkOrder(uint64_t session, uint32_t handle);
+    void modifyExistingOrder(const ModifyOrderQuantity &modifyOrderQuantity, MessageContext &context);
+    void releaseClaim(uint64_t orderId, uint32_t claim);
+    void restoreSnapshot(const SnapshotHeader &header, const SnapshotInstrument *instruments, const SnapshotAccountPosition *accountPositions,
+                         const SnapshotOrder *snapshotOrders, uint32_t shard);
+    void unlinkOrder(uint32_t handle);
+    bool writeSnapshot(SnapshotWriter &writer, SnapshotHeader &header);
+
+    LimitsRegistry &limits;
+    size_t reader = 0;
+    uint64_t limitsVersion = 0;
+    AccountTable &accounts;
+    // Pool handle of the newest live order of each session, the head of the
+    // session's list threaded through its orders.
+    FlatHashMap<uint32_t> session2Orders;
+    // Handles of a disconnected session's orders, kept to reuse the storage.
+    std::vector<uint32_t> rollbackHandles;
+    FlatHashMap<uint32_t> orderId2Order;
+    ObjectPool<Order> orders;
+    PositionTable positions;
+    OrderDirectory *directory = NULL;
+    Journal *journal = NULL;
+    Logger &logger = Logger::instance();
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef RISK_LIMITS_HPP
+#define RISK_LIMITS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Price x quantity amount. The notional of one order or trade is checked to
+// fit int64_t, so sums of them are exact in 128 bits.
+typedef __int128 Notional;
+
+// Buy and sell limits on the hypothetical quantity and notional exposure at
+// one level of the hierarchy, INT64_MAX is unlimited.
+struct Limit
+{
+    int64_t buy = INT64_MAX, sell = INT64_MAX;
+    int64_t buyNotional = INT64_MAX, sellNotional = INT64_MAX;
+
+    Limit() {}
+    Limit(uint64_t b, uint64_t s, uint64_t bn = UINT64_MAX, uint64_t sn = UINT64_MAX)
+        : buy(std::min<uint64_t>(b, INT64_MAX)), sell(std::min<uint64_t>(s, INT64_MAX)),
+          buyNotional(std::min<uint64_t>(bn, INT64_MAX)), sellNotional(std::min<uint64_t>(sn, INT64_MAX)) {}
+};
+
+// Limit hierarchy checked on every NewOrder and Modify:
+// - instrument: exposure of every account in the instrument, the global
+//   limit (the server's thresholds) unless the instrument has its own;
+// - account: exposure of the account over every instrument (and shard);
+// - account x instrument: exposure of the account in the instrument;
+// - portfolio: exposure of every account over every instrument.
+// Account and portfolio levels are unlimited unless configured. Limits are looked up when
+// a position is first registered or the limits are reloaded, and kept next
+// to it as headroom. A table is immutable once published.
+class RiskLimits
+{
+public:
+    RiskLimits(uint64_t buy, uint64_t sell) : global(buy, sell) {}
+
+    Limit forAccount(uint64_t account) const;
+    Limit forAccountInstrument(uint64_t account, uint64_t listingId) const;
+    Limit forInstrument(uint64_t listingId) const;
+    Limit forPortfolio() const { return portfolio; }
+    uint64_t getVersion() const { return version; }
+    bool load(const std::string &path);
+
+private:
+    friend class LimitsRegistry;
+
+    uint64_t version = 0;
+    Limit global, portfolio;
+    std::unordered_map<uint64_t, Limit> instruments, accounts;
+    std::map<std::pair<uint64_t, uint64_t>, Limit> accountInstruments;
+};
+
+// The current RiskLimits, replaced whole on reload (read-copy-update). The
+// engines (readers) read it without locks and move to a new table between
+// messages, then announce the version they hold; a replaced table is freed
+// once every reader announced a later one (epoch reclamation).
+class LimitsRegistry
+{
+public:
+    LimitsRegistry(uint64_t buy, uint64_t sell) : table(new RiskLimits(buy, sell)) {}
+    ~LimitsRegistry();
+
+    size_t addReader();
+    void announce(size_t reader, uint64_t version) { readers[reader].store(version, std::memory_order_release); }
+    const RiskLimits *current() const { return table.load(std::memory_order_acquire); }
+    void publish(RiskLimits *limits);
+    uint64_t version() const { return publishedVersion.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<const RiskLimits *> table;
+    std::atomic<uint64_t> publishedVersion{0};
+    // Held by publishers and reader registration.
+    std::mutex mutex;
+    std::deque<std::atomic<uint64_t>> readers;
+    std::vector<std::unique_ptr<const RiskLimits>> retired;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef RISK_SHARD_HPP
+#define RISK_SHARD_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "message.hpp"
+#include "metrics.hpp"
+#include "order_directory.hpp"
+#include "risk_engine.hpp"
+#include "spsc_queue.hpp"
+
+// Message routed by an I/O thread to the shard owning its listing.
+struct ShardRequest
+{
+    enum class Kind : uint8_t
+    {
+        MESSAGE,
+        CLOSE_SESSION,
+    };
+    Kind kind = Kind::MESSAGE;
+    int socketDescriptor = -1;
+    uint32_t claim = OrderDirectory::NO_CLAIM;
+    // Batch of the connection the message belongs to (0 if none) and its
+    // entry in the batch's response.
+    uint32_t batch = 0;
+    uint16_t entry = 0;
+    // Of a NewOrder, as checked by the I/O thread.
+    Validity validity = Validity::UNCHECKED;
+    uint64_t session = 0;
+    Account *account = NULL;
+    Header header;
+    char payload[sizeof(NewOrder)]; // Largest routed payload, malformed ones are truncated.
+};
+
+// Reply frame built by a shard for the connection which sent the message.
+struct ShardReply
+{
+    int socketDescriptor;
+    uint32_t batch;
+    uint16_t entry;
+    uint64_t session;
+    Header header;
+    OrderResponse orderResponse;
+};
+
+// Wakes an I/O thread blocked in its event loop once replies are queued. The
+// read end is registered in the event loop, at most one byte is in flight
+// until the I/O thread clears it.
+class ShardWakeup
+{
+public:
+    ShardWakeup();
+    ~ShardWakeup();
+
+    void clear();
+    int descriptor() const { return readDescriptor; }
+    void signal();
+
+private:
+    int readDescriptor = -1, writeDescriptor = -1;
+    std::atomic<bool> pending{false};
+};
+
+// Thread owning the RiskEngine of one slice of the listings. Each I/O thread
+// (producer) has its own pair of SPSC rings to the shard: requests in and
+// replies out, so no ring ever has more than one writer. The shard spins
+// briefly when idle, then sleeps until a producer pushes.
+class RiskShard
+{
+public:
+    static constexpr size_t QUEUE_CAPACITY = 1 << 14;
+
+    RiskShard(LimitsRegistry &limits, AccountTable &accounts, size_t orderCapacity, OrderDirectory &directory, const std::vector<ShardWakeup *> &producers);
+    ~RiskShard();
+
+    bool loadUniverse(const std::string &path) { return engine.loadUniverse(path); }
+    bool popReply(size_t producer, ShardReply &reply) { return channels[producer]->replies.pop(reply); }
+    bool push(size_t producer, const ShardRequest &request);
+    bool recover(Journal *journal, uint32_t shard, size_t &restored, size_t &replayed) { return engine.recover(journal, shard, restored, replayed); }
+    void start();
+
+private:
+    static constexpr int SPIN_POLLS = 4096;
+
+    struct Channel
+    {
+        SpscQueue<ShardRequest> requests{QUEUE_CAPACITY};
+        SpscQueue<ShardReply> replies{QUEUE_CAPACITY};
+        ShardWakeup *wakeup = NULL;
+    };
+
+    bool hasRequests() const;
+    bool processChannel(Channel &channel);
+    void pushReply(Channel &channel, const ShardReply &reply);
+    void run();
+    void sleep();
+
+    RiskEngine engine;
+    std::vector<std::unique_ptr<Channel>> channels;
+    // Replies held until the journal records of their batch are committed.
+    std::vector<ShardReply> uncommitted;
+    std::thread thread;
+    std::atomic<bool> running{true}, sleeping{false};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+};
+
+#endif
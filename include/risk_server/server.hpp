@@ -1,54 +1,126 @@
 #ifndef SERVER_HPP
 #define SERVER_HPP
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <netinet/in.h>
 #include <set>
 #include <stdlib.h>
+#include <string>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <tuple>
 #include <unistd.h>
 #include <unordered_map>
 #include <vector>
 
+#include "account_table.hpp"
+#include "admin_server.hpp"
+#include "connection.hpp"
+#include "event_loop.hpp"
+#include "journal.hpp"
+#include "logger.hpp"
 #include "message.hpp"
-#include "position_data.hpp"
+#include "metrics.hpp"
+#include "order_directory.hpp"
+#include "risk_engine.hpp"
+#include "risk_limits.hpp"
+#include "risk_shard.hpp"
+#include "server_worker.hpp"
 #include "strings.hpp"
 
+// macOS has no MSG_NOSIGNAL, SIGPIPE is ignored in server_main instead.
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Optional startup settings, parsed from the command line in server_main.
+struct ServerOptions
+{
+#ifdef __linux__
+    IOBackend ioBackend = IOBackend::EPOLL;
+#else
+    IOBackend ioBackend = IOBackend::SELECT;
+#endif
+    // Idle milliseconds of io_uring's submission polling thread, 0 for none.
+    uint32_t sqPollMillis = 0;
+    // Workers with their own listener, event loop and connections.
+    size_t ioThreads = 1;
+    // Unix stream socket served next to PORT, for clients on the same host.
+    std::string socketPath;
+    // Pending connections queued by each listener.
+    int backlog = SOMAXCONN;
+    size_t orderCapacity = 0;
+    // Risk engine threads, 0 runs the engine on the I/O threads.
+    size_t shards = 0;
+    std::string universePath;
+    // Limit hierarchy file, the thresholds are the global limit without one.
+    std::string limitsPath;
+    // Seconds between checks of the limits file for changes, 0 disables.
+    uint32_t limitsWatchSeconds = 1;
+    // Admin endpoints serving the metrics, recording is off without one.
+    int adminPort = 0;
+    std::string adminSocketPath;
+    // Write-ahead journal of every engine, replayed on startup.
+    JournalOptions journal;
+};
+
+// Risk state shared by the I/O workers: the engine, behind a mutex when
+// several workers share it, or the shards and their order directory.
 class RiskServer
 {
 public:
-    RiskServer(uint64_t b, uint64_t s, int p) : BUY_THRESHOLD(b), SELL_THRESHOLD(s), PORT(p) {}
-    void addUser(uint64_t newSocket);
-    void addMasterAndChildSockets();
-    void closeConnection(int newSocket);
-
-    void createNewOrder(int socketDescriptor, char *buffer, Header &header, OrderResponse &orderResponse);
-    void deleteExistingOrder(char *buffer, Header &header);
-    void executeTrade(char *buffer, Header &header);
-
-    void handleClientSocketIOOperations();
-    bool handleMessage(int socketDescriptor, OrderResponse &orderResponse, char *buffer, Header &header);
-    void handleNewConnection(int newSocket, struct sockaddr_in address);
+    RiskServer(uint64_t b, uint64_t s, int p, const ServerOptions &o);
+    ~RiskServer();
+    void initAdminServer();
     void initListenerSocket();
-    
-    void modifyExistingOrder(char *buffer, Header &header, OrderResponse &orderResponse);
-
-    void removeUser(uint64_t socketDescriptor);
+    void initUnixSocket();
+    uint64_t newSession();
+    std::string portfolioText();
+    void recoverJournals();
+    bool reloadLimits(const std::string &path);
+    uint32_t shardFor(uint64_t listingId) const { return listingId % shards.size(); }
 
 private:
+    friend class ServerWorker;
+
+    void watchLimits();
+
     uint64_t BUY_THRESHOLD = 0, SELL_THRESHOLD = 0;
     int PORT = 0;
-    std::unordered_map<int, std::vector<uint64_t> *> userId2Order;
-    std::unordered_map<int, std::shared_ptr<Order>> orderId2Order;
-    std::unordered_map<int, std::shared_ptr<PositionData>> instrumentId2PositionData;
-    fd_set socketDescriptorSet;
-    int masterSocket, mAddressLen, maxDescriptor;
-    struct sockaddr_in mAddress;
-    std::set<int> clientSocket;
+    // Listener bound to options.socketPath, shared by every worker's loop.
+    int unixSocket = -1;
+    ServerOptions options;
+    LimitsRegistry limits;
+    AccountTable accounts;
+    // Serializes reloads from the admin thread and the limits watcher.
+    std::mutex reloadMutex;
+    std::thread limitsWatcher;
+    std::mutex watchMutex;
+    std::condition_variable watchCondition;
+    bool stopping = false;
+    // Outlive the engines appending to them.
+    std::vector<std::unique_ptr<Journal>> journals;
+    std::unique_ptr<RiskEngine> engine;
+    std::mutex engineMutex;
+    OrderDirectory directory;
+    std::vector<std::unique_ptr<ServerWorker>> workers;
+    std::vector<std::unique_ptr<RiskShard>> shards;
+    std::atomic<uint64_t> nextSession{1};
+    AdminServer admin;
 };
 
-#endif
\ No newline at end of file
+#endif
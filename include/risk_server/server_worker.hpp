@@ -0,0 +1,80 @@
+#ifndef SERVER_WORKER_HPP
+#define SERVER_WORKER_HPP
+
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+#include "connection.hpp"
+#include "event_loop.hpp"
+#include "logger.hpp"
+#include "message.hpp"
+#include "metrics.hpp"
+#include "order_validation.hpp"
+#include "risk_shard.hpp"
+
+class RiskServer;
+
+// One I/O thread of the risk server: its own listener, event loop and
+// connections. Messages are handled on the shared engine or routed to the
+// shards, as producer number `index`.
+class ServerWorker
+{
+public:
+    ServerWorker(RiskServer &s, size_t i) : server(s), index(i) {}
+
+    void acceptNewConnections(int listener);
+    void addUser(uint64_t newSocket, const struct sockaddr_storage &address);
+    void closeConnection(int newSocket);
+    void completeBatchEntry(Connection &connection, uint32_t batch, uint16_t entry, const OrderResponse &orderResponse);
+    ShardWakeup *createShardWakeup();
+
+    void decodeFrames(Connection &connection);
+    void deliverShardReplies();
+
+    void flushConnection(Connection &connection);
+    void flushPendingConnections();
+
+    bool handleBatch(Connection &connection, char *response, char *payload, Header &header, int replies, const Validity *validity);
+    void handleClientSocketIO(int socketDescriptor);
+    void handleLogon(Connection &connection, char *payload, Header &header);
+    void handleNewConnection(int newSocket, const struct sockaddr_storage &address);
+    void handleReceived(int socketDescriptor, const char *data, ssize_t size);
+    bool handleSharedMemoryAttach(Connection &connection, OrderResponse &orderResponse, char *payload, Header &header);
+    void handleSharedMemoryIO(Connection &connection);
+    void initListenerSocket(bool reusePort);
+    void logPeer(LogEvent event, int socketDescriptor, const struct sockaddr_storage &address);
+
+    void queueFlush(Connection &connection);
+    void removeUser(uint64_t session);
+    bool routeMessage(Connection &connection, OrderResponse &orderResponse, char *buffer, Header &header, uint32_t batch = 0, uint16_t entry = 0,
+                      Validity validity = Validity::UNCHECKED);
+    void routeToShard(uint32_t shard, const ShardRequest &request);
+    void run();
+    void updateInterest(Connection &connection);
+    void validateOrders(Connection &connection);
+
+private:
+    RiskServer &server;
+    size_t index = 0;
+    std::unique_ptr<EventLoop> eventLoop;
+    int masterSocket = -1;
+    // Held open to accept and shed one connection when descriptors run out,
+    // so the backlog drains; exhausted is set until an accept succeeds again.
+    int spareDescriptor = -1;
+    bool descriptorsExhausted = false;
+    Logger &logger = Logger::instance();
+    Metrics &metrics = Metrics::instance();
+    std::unordered_map<int, Connection> connections;
+    std::vector<int> pendingFlush;
+    // Connections of the batch being flushed, and their sends.
+    std::vector<int> flushing;
+    std::vector<IOSend> sends;
+    std::unique_ptr<ShardWakeup> shardWakeup;
+};
+
+#endif
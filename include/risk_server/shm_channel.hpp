@@ -0,0 +1,77 @@
+#ifndef SHM_CHANNEL_HPP
+#define SHM_CHANNEL_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+
+#include "message.hpp"
+
+// Byte ring between exactly one writing and one reading process, carrying
+// the same Header + payload frames as a socket. Head and tail only grow, so
+// their difference is the bytes buffered. A side about to sleep sets its
+// waiting flag and re-checks the ring, the other side clears the flag and
+// rings the doorbell once it wrote (or freed) bytes.
+struct SharedMemoryRing
+{
+    static constexpr size_t CAPACITY = 256 * 1024;
+
+    // Reader owned.
+    alignas(64) std::atomic<uint64_t> head{0};
+    std::atomic<uint32_t> writerWaiting{0};
+
+    // Writer owned. The reader starts out waiting, its first frame rings.
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint32_t> readerWaiting{1};
+
+    alignas(64) char data[CAPACITY];
+};
+static_assert((SharedMemoryRing::CAPACITY & (SharedMemoryRing::CAPACITY - 1)) == 0, "The ring capacity must be a power of two");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared atomics must be lock-free to work across processes");
+
+// Segment mapped by a client and the server, one ring each way.
+struct SharedMemorySegment
+{
+    static constexpr uint32_t MAGIC = 0x52534d31; // "RSM1"
+
+    uint32_t magic = MAGIC;
+    uint32_t capacity = SharedMemoryRing::CAPACITY;
+    SharedMemoryRing requests, replies;
+};
+
+// Same-host transport of one connection: frames go through a shared memory
+// segment created by the client (shm_open) and attached by the server, the
+// connection's socket stays open to ring doorbells (one byte, only sent to
+// a sleeping peer) and to tell either side when the other one closed.
+class SharedMemoryChannel
+{
+public:
+    // Longest segment name, including the terminating NUL.
+    static constexpr size_t NAME_SIZE = sizeof(SharedMemoryAttach::name);
+
+    ~SharedMemoryChannel();
+
+    static std::unique_ptr<SharedMemoryChannel> attach(int socketDescriptor, const char *name);
+    static std::unique_ptr<SharedMemoryChannel> create(int socketDescriptor, std::string &name);
+
+    bool clearDoorbells();
+    // Whether the inbound ring holds bytes, without arming a doorbell.
+    bool readable() const { return inbound.tail.load(std::memory_order_acquire) != inbound.head.load(std::memory_order_relaxed); }
+    size_t receive(char *buffer, size_t size);
+    size_t send(const char *buffer, size_t size);
+
+private:
+    SharedMemoryChannel(int s, SharedMemorySegment *segment, bool server)
+        : socketDescriptor(s), segment(segment), inbound(server ? segment->requests : segment->replies),
+          outbound(server ? segment->replies : segment->requests) {}
+
+    void ringDoorbell();
+
+    int socketDescriptor;
+    SharedMemorySegment *segment;
+    SharedMemoryRing &inbound, &outbound;
+};
+
+#endif
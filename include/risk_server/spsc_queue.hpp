@@ -0,0 +1,71 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <stdlib.h>
+#include <vector>
+
+// Bounded lock-free ring between exactly one producing and one consuming
+// thread. Each side caches the other side's index so the shared cache line
+// is only read when the ring looks full or empty.
+template <typename T>
+class SpscQueue
+{
+public:
+    // The capacity is rounded up to a power of two.
+    explicit SpscQueue(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    // Producer side, false if the ring is full.
+    bool push(const T &item)
+    {
+        uint64_t currentTail = tail.load(std::memory_order_relaxed);
+        if (currentTail - cachedHead > mask)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (currentTail - cachedHead > mask)
+                return false;
+        }
+        slots[currentTail & mask] = item;
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, false if the ring is empty.
+    bool pop(T &item)
+    {
+        uint64_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (currentHead == cachedTail)
+                return false;
+        }
+        item = slots[currentHead & mask];
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    // Consumer owned.
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t cachedTail = 0;
+
+    // Producer owned.
+    alignas(64) std::atomic<uint64_t> tail{0};
+    uint64_t cachedHead = 0;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #define ERR_ORDER_ALREADY_EXISTS "ERR 01 <ORDER_ID_ALREADY_EXISTS>"
 #define ERR_ORDER_DOES_NOT_EXIST "ERR 02 <ORDER_DOES_NOT_EXIST>"
 #define ERR_INVALID_DATA "ERR 03 <ERR_INVALID_DATA>"
+#define ERR_UNKNOWN_LISTING "ERR 04 <UNKNOWN_LISTING>"
 
 #define MESSAGE_ACCEPTED "ACCEPTED"
 #define MESSAGE_REJECTED "REJECTED"
@@ -16,4 +17,9 @@
 #define WARN_NEW_ORDER_REJECTED "WARN 01 <NEW_ORDER_REJECTED>"
 #define WARN_MODIFY_ORDER_REJECTED "WARN 02 <WARN_MODIFY_ORDER_REJECTED>"
 
+#define LOG_NEW_CONNECTION "LOG New Connection"
+#define LOG_DISCONNECTED "LOG Disconnected"
+#define LOG_RECORDS_DROPPED "LOG <RECORDS_DROPPED>"
+#define LOG_ORDER_POOL_GROWN "LOG <ORDER_POOL_GROWN>"
+
 #endif
\ No newline at end of file
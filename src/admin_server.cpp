@@ -0,0 +1,243 @@
+#include "../include/risk_server/admin_server.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <errno.h>
+#include <exception>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+AdminServer::~AdminServer()
+{
+    if (thread.joinable())
+        thread.detach();
+    if (!unixPath.empty())
+        unlink(unixPath.c_str());
+}
+
+/*
+* Read one request from an admin client, run the command and write the
+* response before closing the connection.
+*
+* Parameters
+* ----------
+* clientSocket : int
+*     The admin client's socket descriptor.
+*/
+void AdminServer::handleClient(int clientSocket)
+{
+    // A stalled client must not block the admin thread for long.
+    struct timeval timeout = {1, 0};
+    setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find('\n') == std::string::npos && request.size() < 8192)
+    {
+        ssize_t valread = read(clientSocket, buffer, sizeof(buffer));
+        if (valread < 0 && errno == EINTR)
+            continue;
+        if (valread <= 0)
+            break;
+        request.append(buffer, valread);
+    }
+    std::string line = request.substr(0, request.find('\n'));
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+
+    std::string response;
+    if (line.compare(0, 4, "GET ") == 0)
+    {
+        // HTTP: GET /<command>[?arguments] HTTP/1.x
+        std::string target = line.substr(4, line.find(' ', 4) - 4);
+        std::string status = "200 OK", body;
+        if (target.empty() || target[0] != '/')
+        {
+            status = "400 Bad Request";
+            body = "ERR request target must start with /\n";
+        }
+        else
+        {
+            std::string command = target.substr(1);
+            std::replace(command.begin(), command.end(), '?', ' ');
+            if (!runCommand(command, body))
+                status = "404 Not Found";
+        }
+        std::ostringstream http;
+        http << "HTTP/1.0 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+        response = http.str();
+    }
+    else
+        runCommand(line, response);
+
+    size_t sent = 0;
+    while (sent < response.size())
+    {
+        ssize_t written = send(clientSocket, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            break;
+        sent += written;
+    }
+    close(clientSocket);
+}
+
+/*
+* Listen for admin clients on a loopback TCP port.
+*
+* Parameters
+* ----------
+* port : int
+*     The admin port.
+*
+* Returns
+* -------
+* listening : bool
+*     true if the port was bound, false otherwise.
+*/
+bool AdminServer::listenTcp(int port)
+{
+    int adminSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (adminSocket < 0)
+        return false;
+    int opt = 1;
+    setsockopt(adminSocket, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt));
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(adminSocket, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(adminSocket, 16) < 0)
+    {
+        close(adminSocket);
+        return false;
+    }
+    listeners.push_back(adminSocket);
+    return true;
+}
+
+/*
+* Listen for admin clients on a Unix socket, replacing a stale socket file.
+*
+* Parameters
+* ----------
+* path : std::string
+*     Path of the socket file.
+*
+* Returns
+* -------
+* listening : bool
+*     true if the socket was bound, false otherwise.
+*/
+bool AdminServer::listenUnix(const std::string &path)
+{
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    if (path.size() >= sizeof(address.sun_path))
+        return false;
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int adminSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (adminSocket < 0)
+        return false;
+    unlink(path.c_str());
+    if (bind(adminSocket, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(adminSocket, 16) < 0)
+    {
+        close(adminSocket);
+        return false;
+    }
+    listeners.push_back(adminSocket);
+    unixPath = path;
+    return true;
+}
+
+/*
+* Run a command line: the first word names the command, the rest are its
+* arguments. A command failing with an exception answers an error, it never
+* reaches the admin thread.
+*
+* Parameters
+* ----------
+* line : std::string
+*     The command line.
+* response : std::string
+*     Reference to the response to fill.
+*
+* Returns
+* -------
+* found : bool
+*     true if the command exists, false otherwise.
+*/
+bool AdminServer::runCommand(const std::string &line, std::string &response)
+{
+    size_t split = line.find(' ');
+    std::string name = line.substr(0, split);
+    std::string arguments = split == std::string::npos ? "" : line.substr(split + 1);
+
+    auto it = commands.find(name);
+    if (it == commands.end())
+    {
+        response = "ERR unknown command. Commands:";
+        for (auto &command : commands)
+            response += " " + command.first;
+        response += "\n";
+        return false;
+    }
+    try
+    {
+        response = it->second(arguments);
+    }
+    catch (const std::exception &error)
+    {
+        response = std::string("ERR ") + error.what() + "\n";
+    }
+    return true;
+}
+
+/*
+* Serve admin clients on a background thread.
+*/
+void AdminServer::start()
+{
+    thread = std::thread([this]() {
+        std::vector<struct pollfd> descriptors;
+        for (int listener : listeners)
+            descriptors.push_back({listener, POLLIN, 0});
+
+        while (true)
+        {
+            if (poll(descriptors.data(), descriptors.size(), -1) < 0)
+            {
+                if (errno != EINTR)
+                    std::cerr << "ERR 00 <ADMIN_POLL>" << std::endl;
+                continue;
+            }
+            for (struct pollfd &descriptor : descriptors)
+            {
+                if (!(descriptor.revents & POLLIN))
+                    continue;
+                int clientSocket = accept(descriptor.fd, NULL, NULL);
+                if (clientSocket >= 0)
+                    handleClient(clientSocket);
+            }
+        }
+    });
+}
@@ -0,0 +1,347 @@
+#include "../include/risk_server/async_client.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+
+AsyncRiskClient::AsyncRiskClient(uint64_t port, Transport transport) : client(new RiskClient(port, transport)), receiveBuffer(RECEIVE_BUFFER_SIZE)
+{
+    // Pipelined frames must not wait for the previous reply's ACK.
+    int opt = 1;
+    setsockopt(client->descriptor(), IPPROTO_TCP, TCP_NODELAY, (char *)&opt, sizeof(opt));
+    fcntl(client->descriptor(), F_SETFL, fcntl(client->descriptor(), F_GETFL, 0) | O_NONBLOCK);
+}
+
+AsyncRiskClient::AsyncRiskClient(const std::string &socketPath) : client(new RiskClient(socketPath)), receiveBuffer(RECEIVE_BUFFER_SIZE)
+{
+    fcntl(client->descriptor(), F_SETFL, fcntl(client->descriptor(), F_GETFL, 0) | O_NONBLOCK);
+}
+
+/*
+* Mark the connection closed and complete every pending message with NULL.
+*/
+void AsyncRiskClient::close()
+{
+    open = false;
+    std::unordered_map<uint32_t, Pending> failed;
+    failed.swap(pending);
+    for (auto &entry : failed)
+    {
+        if (entry.second.batchCallback)
+            entry.second.batchCallback(NULL, 0);
+        else
+            entry.second.callback(NULL);
+    }
+}
+
+/*
+* Send as much of the buffered frames as the socket accepts.
+*
+* Returns
+* -------
+* drained : bool
+*     true if nothing is left to send, false if the socket is full (wait for
+*     it to be writable) or the connection closed.
+*/
+bool AsyncRiskClient::flush()
+{
+    while (open && sendHead < sendBuffer.size())
+    {
+        ssize_t written = client->transmit(sendBuffer.data() + sendHead, sendBuffer.size() - sendHead);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return false;
+        if (written <= 0)
+        {
+            close();
+            return false;
+        }
+        sendHead += written;
+    }
+    // Keeps its capacity, so steady-state encoding does not allocate.
+    sendBuffer.clear();
+    sendHead = 0;
+    return open;
+}
+
+/*
+* Callback completing a promise, the connection closing sets an exception.
+*/
+AsyncRiskClient::Callback AsyncRiskClient::fulfil(std::shared_ptr<std::promise<OrderResponse>> promise)
+{
+    return [promise](const OrderResponse *response) {
+        if (response != NULL)
+            promise->set_value(*response);
+        else
+            promise->set_exception(std::make_exception_ptr(std::runtime_error("connection closed")));
+    };
+}
+
+/*
+* Flush, wait for replies (or for the socket to accept the rest) and deliver
+* them.
+*
+* Parameters
+* ----------
+* timeoutMillis : int
+*     Longest wait, -1 waits indefinitely.
+*
+* Returns
+* -------
+* delivered : size_t
+*     Number of replies delivered.
+*/
+size_t AsyncRiskClient::poll(int timeoutMillis)
+{
+    if (!open)
+        return 0;
+    bool drained = flush();
+    // Replies already in the ring rang no doorbell, reading it empty arms one.
+    if (client->sharedMemory())
+    {
+        size_t delivered = receive();
+        if (delivered > 0 || !open)
+            return delivered;
+    }
+    struct pollfd descriptor = {client->descriptor(), (short)(POLLIN | (drained || client->sharedMemory() ? 0 : POLLOUT)), 0};
+    if (::poll(&descriptor, 1, timeoutMillis) <= 0)
+        return 0;
+    if ((descriptor.revents & POLLOUT) || client->sharedMemory())
+        flush();
+    return receive();
+}
+
+/*
+* Read the available replies and deliver each to its message's callback.
+* Replies matching no pending message (wrong sequence number or order id)
+* are counted and dropped.
+*
+* Returns
+* -------
+* delivered : size_t
+*     Number of replies delivered.
+*/
+size_t AsyncRiskClient::receive()
+{
+    size_t delivered = 0;
+    while (open)
+    {
+        ssize_t valread = client->receive(receiveBuffer.data() + receiveTail, receiveBuffer.size() - receiveTail);
+        if (valread < 0 && errno == EINTR)
+            continue;
+        if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (valread <= 0)
+        {
+            close();
+            break;
+        }
+        receiveTail += valread;
+
+        size_t head = 0;
+        while (open && head + sizeof(Header) <= receiveTail)
+        {
+            Header header;
+            std::memcpy(&header, receiveBuffer.data() + head, sizeof(Header));
+            size_t frameSize = sizeof(Header) + header.payloadSize;
+            if (head + frameSize > receiveTail)
+                break;
+            const char *payload = receiveBuffer.data() + head + sizeof(Header);
+            head += frameSize;
+
+            uint16_t messageType = 0;
+            if (header.payloadSize >= sizeof(messageType))
+                std::memcpy(&messageType, payload, sizeof(messageType));
+            auto it = pending.find(header.sequenceNumber - 1);
+            if (messageType == OrderResponse::MESSAGE_TYPE && header.payloadSize == sizeof(OrderResponse))
+            {
+                OrderResponse response;
+                std::memcpy(&response, payload, sizeof(OrderResponse));
+                if (it == pending.end() || !it->second.callback || it->second.orderId != response.orderId)
+                {
+                    unmatchedReplies++;
+                    continue;
+                }
+                // Removed first so the callback may submit further messages.
+                Callback callback = std::move(it->second.callback);
+                pending.erase(it);
+                callback(&response);
+            }
+            else if (messageType == BatchResponse::MESSAGE_TYPE && header.payloadSize >= sizeof(BatchResponse))
+            {
+                BatchResponse response;
+                std::memcpy(&response, payload, sizeof(BatchResponse));
+                if (header.payloadSize != sizeof(BatchResponse) + response.count * sizeof(BatchResponse::Entry) ||
+                    it == pending.end() || !it->second.batchCallback)
+                {
+                    unmatchedReplies++;
+                    continue;
+                }
+                BatchCallback callback = std::move(it->second.batchCallback);
+                pending.erase(it);
+                callback(reinterpret_cast<const BatchResponse::Entry *>(payload + sizeof(BatchResponse)), response.count);
+            }
+            else
+            {
+                // Not a reply this client understands, framing is suspect.
+                std::cerr << ERR_INVALID_DATA << std::endl;
+                close();
+                break;
+            }
+            delivered++;
+        }
+        std::memmove(receiveBuffer.data(), receiveBuffer.data() + head, receiveTail - head);
+        receiveTail -= head;
+    }
+    return delivered;
+}
+
+/*
+* Send the messages added with addToBatch as one Batch frame and start a new
+* batch.
+*
+* Parameters
+* ----------
+* callback : BatchCallback
+*     Called with the batch response, one entry per NewOrder and Modify in
+*     the order they were added.
+*/
+void AsyncRiskClient::submitBatch(BatchCallback callback)
+{
+    if (!open)
+    {
+        batchBuffer.clear();
+        batchCount = 0;
+        return callback(NULL, 0);
+    }
+    Batch batch;
+    batch.messageType = Batch::MESSAGE_TYPE;
+    batch.count = batchCount;
+    Header header;
+    header.version = 0;
+    header.payloadSize = sizeof(Batch) + batchBuffer.size();
+    header.sequenceNumber = nextSequence;
+    header.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    size_t tail = sendBuffer.size();
+    sendBuffer.resize(tail + sizeof(Header) + header.payloadSize);
+    std::memcpy(sendBuffer.data() + tail, &header, sizeof(Header));
+    std::memcpy(sendBuffer.data() + tail + sizeof(Header), &batch, sizeof(Batch));
+    std::memcpy(sendBuffer.data() + tail + sizeof(Header) + sizeof(Batch), batchBuffer.data(), batchBuffer.size());
+    pending[nextSequence++] = {0, Callback(), std::move(callback)};
+    batchBuffer.clear();
+    batchCount = 0;
+}
+
+std::future<std::vector<BatchResponse::Entry>> AsyncRiskClient::submitBatch()
+{
+    std::shared_ptr<std::promise<std::vector<BatchResponse::Entry>>> promise(new std::promise<std::vector<BatchResponse::Entry>>());
+    submitBatch([promise](const BatchResponse::Entry *entries, uint16_t count) {
+        if (entries != NULL)
+            promise->set_value(std::vector<BatchResponse::Entry>(entries, entries + count));
+        else
+            promise->set_exception(std::make_exception_ptr(std::runtime_error("connection closed")));
+    });
+    return promise->get_future();
+}
+
+/*
+* Queue a delete order message, which the server does not answer.
+*
+* Parameters
+* ----------
+* order : DeleteOrder
+*     The message, messageType is set.
+*/
+void AsyncRiskClient::submitDeleteOrder(const DeleteOrder &order)
+{
+    DeleteOrder message = order;
+    message.messageType = DeleteOrder::MESSAGE_TYPE;
+    encode(message);
+}
+
+/*
+* Queue a logon message, orders submitted after it are checked against the
+* account's limits.
+*
+* Parameters
+* ----------
+* logon : Logon
+*     The message, messageType is set.
+*/
+void AsyncRiskClient::submitLogon(const Logon &logon)
+{
+    Logon message = logon;
+    message.messageType = Logon::MESSAGE_TYPE;
+    encode(message);
+}
+
+/*
+* Queue a modify order quantity message.
+*
+* Parameters
+* ----------
+* order : ModifyOrderQuantity
+*     The message, messageType is set.
+* callback : Callback
+*     Called with the reply.
+*/
+void AsyncRiskClient::submitModifyOrderQuantity(const ModifyOrderQuantity &order, Callback callback)
+{
+    if (!open)
+        return callback(NULL);
+    ModifyOrderQuantity message = order;
+    message.messageType = ModifyOrderQuantity::MESSAGE_TYPE;
+    pending[encode(message)] = {message.orderId, std::move(callback), BatchCallback()};
+}
+
+std::future<OrderResponse> AsyncRiskClient::submitModifyOrderQuantity(const ModifyOrderQuantity &order)
+{
+    std::shared_ptr<std::promise<OrderResponse>> promise(new std::promise<OrderResponse>());
+    submitModifyOrderQuantity(order, fulfil(promise));
+    return promise->get_future();
+}
+
+/*
+* Queue a new order message.
+*
+* Parameters
+* ----------
+* order : NewOrder
+*     The message, messageType is set.
+* callback : Callback
+*     Called with the reply.
+*/
+void AsyncRiskClient::submitNewOrder(const NewOrder &order, Callback callback)
+{
+    if (!open)
+        return callback(NULL);
+    NewOrder message = order;
+    message.messageType = NewOrder::MESSAGE_TYPE;
+    pending[encode(message)] = {message.orderId, std::move(callback), BatchCallback()};
+}
+
+std::future<OrderResponse> AsyncRiskClient::submitNewOrder(const NewOrder &order)
+{
+    std::shared_ptr<std::promise<OrderResponse>> promise(new std::promise<OrderResponse>());
+    submitNewOrder(order, fulfil(promise));
+    return promise->get_future();
+}
+
+/*
+* Queue a trade message, which the server does not answer.
+*
+* Parameters
+* ----------
+* trade : Trade
+*     The message, messageType is set.
+*/
+void AsyncRiskClient::submitTrade(const Trade &trade)
+{
+    Trade message = trade;
+    message.messageType = Trade::MESSAGE_TYPE;
+    encode(message);
+}
@@ -0,0 +1,117 @@
+#include "../include/risk_server/benchmark.hpp"
+
+#include <fstream>
+#include <signal.h>
+
+/*
+* Runner code for the load-generating benchmark.
+*
+* Arguments
+* ---------
+*   PORT
+*       uint64_t
+*
+* Options
+* -------
+*   --connections=<connections>
+*       Client connections, all driven from one thread (default 8).
+*   --duration=<seconds>
+*       Seconds of load (default 10).
+*   --rate=<messages per second>
+*       Open-loop: send at this fixed rate over all connections whatever the
+*       replies (default 0, closed-loop).
+*   --window=<messages>
+*       Closed-loop: messages awaiting a reply per connection (default 16).
+*   --listings=<count>
+*       Spread orders and trades over listing ids 1..count (default 64).
+*   --universe=<path>
+*       Spread them over the listing ids of a universe file instead.
+*   --mix=<new>,<delete>,<modify>,<trade>
+*       Relative weights of the message types (default 70,15,10,5).
+*   --max-quantity=<quantity>, --max-price=<price>
+*       Orders and trades draw their quantity and price from 1..max
+*       (default 10 and 100).
+*   --seed=<seed>
+*       Seed of the message generator (default 1).
+*   --transport=<tcp|shm>
+*       Send over TCP or over a shared memory segment per connection, the
+*       server must run on the same host (default tcp).
+*   --socket=<path>
+*       Connect to the server's Unix socket (--socket) instead of the port.
+*/
+int main(int argc, char *argv[])
+{
+    int PORT;
+    if (argc >= 2)
+    {
+        PORT = std::atoi(argv[1]);
+    }
+    else
+    {
+        std::cerr << "Arguments not provided. Valid arguments: ... <port>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    BenchmarkOptions options;
+    size_t listings = 64;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option.rfind("--connections=", 0) == 0)
+            options.connections = std::strtoull(option.c_str() + strlen("--connections="), NULL, 10);
+        else if (option.rfind("--duration=", 0) == 0)
+            options.duration = std::strtod(option.c_str() + strlen("--duration="), NULL);
+        else if (option.rfind("--rate=", 0) == 0)
+            options.rate = std::strtod(option.c_str() + strlen("--rate="), NULL);
+        else if (option.rfind("--window=", 0) == 0)
+            options.window = std::strtoull(option.c_str() + strlen("--window="), NULL, 10);
+        else if (option.rfind("--listings=", 0) == 0)
+            listings = std::strtoull(option.c_str() + strlen("--listings="), NULL, 10);
+        else if (option.rfind("--universe=", 0) == 0)
+        {
+            std::ifstream file(option.substr(strlen("--universe=")));
+            if (!file)
+            {
+                std::cerr << "ERR 00 <UNIVERSE_FILE>" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            std::string line;
+            while (std::getline(file, line))
+            {
+                line = line.substr(0, line.find('#'));
+                if (line.find_first_of("0123456789") != std::string::npos)
+                    options.listings.push_back(std::strtoull(line.c_str(), NULL, 10));
+            }
+        }
+        else if (option.rfind("--mix=", 0) == 0 &&
+                 sscanf(option.c_str() + strlen("--mix="), "%u,%u,%u,%u", &options.mix[0], &options.mix[1], &options.mix[2], &options.mix[3]) == 4)
+            continue;
+        else if (option.rfind("--max-quantity=", 0) == 0)
+            options.maxQuantity = std::max<uint64_t>(std::strtoull(option.c_str() + strlen("--max-quantity="), NULL, 10), 1);
+        else if (option.rfind("--max-price=", 0) == 0)
+            options.maxPrice = std::max<uint64_t>(std::strtoull(option.c_str() + strlen("--max-price="), NULL, 10), 1);
+        else if (option.rfind("--seed=", 0) == 0)
+            options.seed = std::strtoull(option.c_str() + strlen("--seed="), NULL, 10);
+        else if (option == "--transport=tcp" || option == "--transport=shm")
+            options.transport = option == "--transport=shm" ? Transport::SHARED_MEMORY : Transport::TCP;
+        else if (option.rfind("--socket=", 0) == 0)
+            options.socketPath = option.substr(strlen("--socket="));
+        else
+        {
+            std::cerr << "Invalid option " << option << ". Valid options: --connections=<connections> --duration=<seconds> --rate=<messages per second> --window=<messages> --listings=<count> --universe=<path> --mix=<new>,<delete>,<modify>,<trade> --max-quantity=<quantity> --max-price=<price> --seed=<seed> --transport=<tcp|shm> --socket=<path>" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (options.listings.empty())
+    {
+        for (size_t listing = 1; listing <= std::max<size_t>(listings, 1); listing++)
+            options.listings.push_back(listing);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::unique_ptr<RiskBenchmark> benchmark(new RiskBenchmark(PORT, options));
+    benchmark->run();
+    benchmark->report(std::cout);
+    return 0;
+}
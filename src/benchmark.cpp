@@ -0,0 +1,284 @@
+#include "../include/risk_server/benchmark.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+
+RiskBenchmark::RiskBenchmark(uint64_t port, const BenchmarkOptions &o) : options(o), random(o.seed)
+{
+    sessions.resize(std::max<size_t>(options.connections, 1));
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        if (options.socketPath.empty())
+            sessions[i].client.reset(new AsyncRiskClient(port, options.transport));
+        else
+            sessions[i].client.reset(new AsyncRiskClient(options.socketPath));
+        // Order ids are unique across connections.
+        sessions[i].nextOrderId = (uint64_t)(i + 1) << 40;
+    }
+    if (options.listings.empty())
+        options.listings.push_back(1);
+}
+
+/*
+* Stop the benchmark if a session's connection was lost.
+*/
+void RiskBenchmark::checkConnected(const Session &session) const
+{
+    if (!session.client->connected())
+    {
+        std::cerr << "ERR 00 <BENCHMARK_CONNECTION_LOST>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+* Back-fill the closed-loop latencies with the samples a sender issuing one
+* message per expected interval would have recorded while each slow reply
+* blocked its window slot (the HdrHistogram correction). The expected
+* interval is the mean uncorrected latency, the pace of an unblocked slot.
+*/
+void RiskBenchmark::correctCoordinatedOmission()
+{
+    if (uncorrected.count == 0)
+        return;
+    uint64_t interval = std::max<uint64_t>(uncorrected.sum / uncorrected.count, 1);
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++)
+    {
+        if (uncorrected.buckets[i] == 0)
+            continue;
+        uint64_t value = std::min(LatencyHistogram::highestValueIn(i), uncorrected.max);
+        for (uint64_t missed = value; missed > interval; missed -= interval)
+            corrected.record(missed - interval, uncorrected.buckets[i]);
+    }
+}
+
+/*
+* Record the latency and outcome of a reply.
+*
+* Parameters
+* ----------
+* session : Session
+*     Reference to the session which sent the message.
+* response : const OrderResponse*
+*     The reply, NULL if the connection closed first.
+* dueAt : uint64_t
+*     Time the message was scheduled for.
+* sentAt : uint64_t
+*     Time the message was queued.
+* newOrder : bool
+*     true if the message was a new order, accepted ones can be modified and
+*     deleted.
+*/
+void RiskBenchmark::recordReply(Session &session, const OrderResponse *response, uint64_t dueAt, uint64_t sentAt, bool newOrder)
+{
+    inFlight--;
+    if (response == NULL)
+        return;
+    uint64_t receivedAt = Metrics::now();
+    corrected.record(receivedAt - dueAt);
+    uncorrected.record(receivedAt - sentAt);
+    replies[(size_t)response->status]++;
+    if (newOrder && response->status == OrderResponse::Status::ACCEPTED)
+        session.liveOrders.push_back(response->orderId);
+}
+
+/*
+* Print the message counts, throughput and latency percentiles of the run.
+*
+* Parameters
+* ----------
+* out : std::ostream
+*     Reference to the stream to print to.
+*/
+void RiskBenchmark::report(std::ostream &out) const
+{
+    static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999, 0.9999, 1.0};
+    double seconds = (stoppedAt - startedAt) / 1e9;
+    uint64_t totalSent = sent[0] + sent[1] + sent[2] + sent[3], unmatched = 0;
+    for (const Session &session : sessions)
+        unmatched += session.client->unmatched();
+    char line[256];
+
+    if (options.rate > 0)
+        snprintf(line, sizeof(line), "Open-loop at %.0f msg/s, %zu connections, %.2f s\n", options.rate, sessions.size(), seconds);
+    else
+        snprintf(line, sizeof(line), "Closed-loop with %zu in flight per connection, %zu connections, %.2f s\n", options.window, sessions.size(), seconds);
+    out << line;
+    snprintf(line, sizeof(line), "Sent      %llu (new %llu, delete %llu, modify %llu, trade %llu), %.0f msg/s\n",
+             (unsigned long long)totalSent, (unsigned long long)sent[0], (unsigned long long)sent[1], (unsigned long long)sent[2],
+             (unsigned long long)sent[3], totalSent / seconds);
+    out << line;
+    snprintf(line, sizeof(line), "Replies   %llu (accepted %llu, rejected %llu), %.0f replies/s, %zu unanswered, %llu unmatched\n",
+             (unsigned long long)(replies[0] + replies[1]), (unsigned long long)replies[0], (unsigned long long)replies[1],
+             (replies[0] + replies[1]) / seconds, inFlight, (unsigned long long)unmatched);
+    out << line;
+
+    out << "Latency (us)        p50        p90        p99      p99.9     p99.99        max\n";
+    const Histogram *histograms[] = {&corrected, &uncorrected};
+    const char *names[] = {"corrected  ", "uncorrected"};
+    for (size_t h = 0; h < 2; h++)
+    {
+        int length = snprintf(line, sizeof(line), "%s", names[h]);
+        for (double quantile : QUANTILES)
+        {
+            uint64_t value = LatencyHistogram::valueAtQuantile(histograms[h]->buckets.data(), histograms[h]->count, histograms[h]->max, quantile);
+            length += snprintf(line + length, sizeof(line) - length, " %10.1f", value / 1e3);
+        }
+        out << line << "\n";
+    }
+}
+
+/*
+* Generate load for the configured duration, then wait for the replies still
+* in flight (up to DRAIN_NANOS).
+*/
+void RiskBenchmark::run()
+{
+    std::vector<struct pollfd> descriptors(sessions.size());
+    startedAt = Metrics::now();
+    uint64_t endAt = startedAt + (uint64_t)(options.duration * 1e9);
+    if (options.rate > 0)
+    {
+        // Every connection sends its share of the rate, staggered evenly.
+        sendInterval = std::max<uint64_t>((uint64_t)(sessions.size() * 1e9 / options.rate), 1);
+        for (size_t i = 0; i < sessions.size(); i++)
+            sessions[i].nextSendAt = startedAt + sendInterval * i / sessions.size();
+    }
+
+    while (true)
+    {
+        uint64_t now = Metrics::now();
+        bool sending = now < endAt;
+        if ((!sending && inFlight == 0) || now >= endAt + DRAIN_NANOS)
+            break;
+
+        uint64_t wakeAt = sending ? endAt : endAt + DRAIN_NANOS;
+        for (size_t i = 0; i < sessions.size(); i++)
+        {
+            Session &session = sessions[i];
+            if (sending && options.rate > 0)
+            {
+                // Catch up on every message due, late ones keep their due time.
+                while (session.nextSendAt <= now && session.nextSendAt < endAt)
+                {
+                    sendNext(session, session.nextSendAt);
+                    session.nextSendAt += sendInterval;
+                }
+                wakeAt = std::min(wakeAt, session.nextSendAt);
+            }
+            else if (sending)
+            {
+                // Messages without a reply do not hold the window, cap them
+                // per pass so replies are still read.
+                for (size_t burst = 0; session.client->inFlight() < options.window && burst < options.window; burst++)
+                    sendNext(session, now);
+            }
+
+            descriptors[i].fd = session.client->descriptor();
+            descriptors[i].events = POLLIN | (session.client->flush() || session.client->sharedMemory() ? 0 : POLLOUT);
+            checkConnected(session);
+            descriptors[i].revents = 0;
+        }
+
+        now = Metrics::now();
+        uint64_t timeout = wakeAt > now ? wakeAt - now : 0;
+#ifdef __linux__
+        struct timespec wait = {(time_t)(timeout / 1000000000), (long)(timeout % 1000000000)};
+        int ready = ppoll(descriptors.data(), descriptors.size(), &wait, NULL);
+#else
+        int ready = poll(descriptors.data(), descriptors.size(), (int)((timeout + 999999) / 1000000));
+#endif
+        if (ready < 0 && errno != EINTR)
+        {
+            std::cerr << "ERR 00 <BENCHMARK_POLL>" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; ready > 0 && i < sessions.size(); i++)
+        {
+            if (descriptors[i].revents & (POLLIN | POLLHUP | POLLERR))
+                sessions[i].client->receive();
+            if (descriptors[i].revents & POLLOUT)
+                sessions[i].client->flush();
+            checkConnected(sessions[i]);
+        }
+    }
+    stoppedAt = std::min(Metrics::now(), endAt);
+    if (options.rate <= 0)
+        correctCoordinatedOmission();
+}
+
+/*
+* Queue the next message of a session, drawn from the configured mix. Deletes
+* and modifies target the session's accepted orders and fall back to a new
+* order when it has none.
+*
+* Parameters
+* ----------
+* session : Session
+*     Reference to the sending session.
+* dueAt : uint64_t
+*     Time the message was scheduled for, latencies are measured from it.
+*/
+void RiskBenchmark::sendNext(Session &session, uint64_t dueAt)
+{
+    uint32_t total = options.mix[0] + options.mix[1] + options.mix[2] + options.mix[3];
+    uint32_t draw = total > 0 ? random() % total : 0;
+    size_t kind = 0;
+    while (kind < 3 && draw >= options.mix[kind])
+        draw -= options.mix[kind++];
+    if ((kind == 1 || kind == 2) && session.liveOrders.empty())
+        kind = 0;
+
+    uint64_t listingId = options.listings[random() % options.listings.size()];
+    uint64_t sentAt = Metrics::now();
+    switch (kind)
+    {
+    case 0:
+    {
+        NewOrder order;
+        order.listingId = listingId;
+        order.orderId = session.nextOrderId++;
+        order.orderQuantity = 1 + random() % options.maxQuantity;
+        order.orderPrice = 1 + random() % options.maxPrice;
+        order.side = random() % 2 ? 'B' : 'S';
+        inFlight++;
+        session.client->submitNewOrder(order, [this, &session, dueAt, sentAt](const OrderResponse *response) {
+            recordReply(session, response, dueAt, sentAt, true);
+        });
+        break;
+    }
+    case 1:
+    {
+        size_t index = random() % session.liveOrders.size();
+        DeleteOrder order;
+        order.orderId = session.liveOrders[index];
+        session.liveOrders[index] = session.liveOrders.back();
+        session.liveOrders.pop_back();
+        session.client->submitDeleteOrder(order);
+        break;
+    }
+    case 2:
+    {
+        ModifyOrderQuantity order;
+        order.orderId = session.liveOrders[random() % session.liveOrders.size()];
+        order.newQuantity = 1 + random() % options.maxQuantity;
+        inFlight++;
+        session.client->submitModifyOrderQuantity(order, [this, &session, dueAt, sentAt](const OrderResponse *response) {
+            recordReply(session, response, dueAt, sentAt, false);
+        });
+        break;
+    }
+    default:
+    {
+        Trade trade;
+        trade.listingId = listingId;
+        trade.tradeId = session.nextOrderId++;
+        trade.tradeQuantity = (int64_t)(1 + random() % options.maxQuantity) * (random() % 2 ? 1 : -1);
+        trade.tradePrice = 1 + random() % options.maxPrice;
+        session.client->submitTrade(trade);
+        break;
+    }
+    }
+    sent[kind]++;
+}
@@ -1,9 +1,60 @@
 #include "../include/risk_server/client.hpp"
 
-RiskClient::RiskClient(uint64_t p)
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+RiskClient::RiskClient(uint64_t p, Transport transport)
 {
     PORT = p;
     initSocket();
+    if (transport == Transport::SHARED_MEMORY)
+        attachSharedMemory();
+}
+
+RiskClient::RiskClient(const std::string &path) : PORT(0), socketPath(path)
+{
+    initSocket();
+}
+
+/*
+* Create a shared memory segment and ask the server to move the connection
+* to it. The segment is unlinked once answered, the two mappings keep it
+* alive. If it cannot be created or the server refuses it, the connection
+* stays on TCP.
+*/
+void RiskClient::attachSharedMemory()
+{
+    std::string name;
+    std::unique_ptr<SharedMemoryChannel> created = SharedMemoryChannel::create(mSocket, name);
+    if (!created)
+    {
+        std::cerr << "Shared memory creation error, using TCP" << std::endl;
+        return;
+    }
+
+    SharedMemoryAttach attach;
+    attach.messageType = SharedMemoryAttach::MESSAGE_TYPE;
+    std::memset(attach.name, 0, sizeof(attach.name));
+    std::memcpy(attach.name, name.c_str(), std::min(name.size(), sizeof(attach.name) - 1));
+    char frame[sizeof(Header) + sizeof(SharedMemoryAttach)];
+    encodeMessage(frame, 0, attach);
+    char reply[sizeof(Header) + sizeof(OrderResponse)];
+    bool answered = transmitAll(frame, sizeof(frame)) && receiveExactly(reply, sizeof(reply));
+    shm_unlink(name.c_str());
+
+    Header responseHeader;
+    OrderResponse response;
+    std::memcpy(&responseHeader, reply, sizeof(Header));
+    std::memcpy(&response, reply + sizeof(Header), sizeof(OrderResponse));
+    if (answered && responseHeader.payloadSize == sizeof(OrderResponse) && response.status == OrderResponse::Status::ACCEPTED)
+        channel = std::move(created);
+    else
+        std::cerr << "Shared memory refused by the server, using TCP" << std::endl;
 }
 
 /*
@@ -72,18 +123,25 @@ void RiskClient::runCLI()
 * Returns
 * -------
 * message : char*
-*     The message to send to the server.
+*     The message to send to the server, encoded in the client's buffer and
+*     valid until the next create call.
 */
 char *RiskClient::createNewOrderMessage(std::shared_ptr<Header> header)
 {
     NewOrder order;
     const auto timestamp_since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
-    std::cin >> order.listingId;
-    std::cin >> order.orderId;
-    std::cin >> order.orderQuantity;
-    std::cin >> order.orderPrice;
+    // Packed fields cannot bind to references, read into locals first.
+    uint64_t listingId, orderId, orderQuantity, orderPrice;
+    std::cin >> listingId;
+    std::cin >> orderId;
+    std::cin >> orderQuantity;
+    std::cin >> orderPrice;
     std::cin >> order.side;
+    order.listingId = listingId;
+    order.orderId = orderId;
+    order.orderQuantity = orderQuantity;
+    order.orderPrice = orderPrice;
     order.messageType = 1;
 
     header->version = 0;
@@ -92,7 +150,8 @@ char *RiskClient::createNewOrderMessage(std::shared_ptr<Header> header)
     header->payloadSize = sizeof(order);
 
     u_long headerSize = sizeof(Header);
-    char *message = new char[headerSize + header->payloadSize];
+    messageBuffer.resize(headerSize + header->payloadSize);
+    char *message = messageBuffer.data();
     std::memcpy(message, header.get(), headerSize);
     std::memcpy(message + headerSize, &order, header->payloadSize);
     return message;
@@ -109,7 +168,8 @@ char *RiskClient::createNewOrderMessage(std::shared_ptr<Header> header)
 * Returns
 * -------
 * message : char*
-*     The message to send to the server.
+*     The message to send to the server, encoded in the client's buffer and
+*     valid until the next create call.
 */
 char *RiskClient::createDeleteOrderMessage(std::shared_ptr<Header> header)
 {
@@ -117,7 +177,9 @@ char *RiskClient::createDeleteOrderMessage(std::shared_ptr<Header> header)
 
     const auto timestamp_since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
-    std::cin >> order.orderId;
+    uint64_t orderId;
+    std::cin >> orderId;
+    order.orderId = orderId;
     order.messageType = 2;
 
     header->version = 0;
@@ -126,7 +188,8 @@ char *RiskClient::createDeleteOrderMessage(std::shared_ptr<Header> header)
     header->timestamp = timestamp_since_epoch;
 
     u_long headerSize = sizeof(Header);
-    char *message = new char[headerSize + header->payloadSize];
+    messageBuffer.resize(headerSize + header->payloadSize);
+    char *message = messageBuffer.data();
     std::memcpy(message, header.get(), headerSize);
     std::memcpy(message + headerSize, &order, header->payloadSize);
     return message;
@@ -143,7 +206,8 @@ char *RiskClient::createDeleteOrderMessage(std::shared_ptr<Header> header)
 * Returns
 * -------
 * message : char*
-*     The message to send to the server.
+*     The message to send to the server, encoded in the client's buffer and
+*     valid until the next create call.
 */
 char *RiskClient::createModifyOrderQuantityMessage(std::shared_ptr<Header> header)
 {
@@ -151,8 +215,11 @@ char *RiskClient::createModifyOrderQuantityMessage(std::shared_ptr<Header> heade
 
     const auto timestamp_since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
-    std::cin >> order.orderId;
-    std::cin >> order.newQuantity;
+    uint64_t orderId, newQuantity;
+    std::cin >> orderId;
+    std::cin >> newQuantity;
+    order.orderId = orderId;
+    order.newQuantity = newQuantity;
     order.messageType = 3;
 
     header->version = 0;
@@ -161,7 +228,8 @@ char *RiskClient::createModifyOrderQuantityMessage(std::shared_ptr<Header> heade
     header->timestamp = timestamp_since_epoch;
     
     u_long headerSize = sizeof(Header);
-    char *message = new char[headerSize + header->payloadSize];
+    messageBuffer.resize(headerSize + header->payloadSize);
+    char *message = messageBuffer.data();
     std::memcpy(message, header.get(), headerSize);
     std::memcpy(message + headerSize, &order, header->payloadSize);
     return message;
@@ -178,17 +246,24 @@ char *RiskClient::createModifyOrderQuantityMessage(std::shared_ptr<Header> heade
 * Returns
 * -------
 * message : char*
-*     The message to send to the server.
+*     The message to send to the server, encoded in the client's buffer and
+*     valid until the next create call.
 */
 char *RiskClient::createTradeMessage(std::shared_ptr<Header> header)
 {
     Trade order;
     const auto timestamp_since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
-    std::cin >> order.listingId;
-    std::cin >> order.tradeId;
-    std::cin >> order.tradeQuantity;
-    std::cin >> order.tradePrice;
+    uint64_t listingId, tradeId, tradePrice;
+    int64_t tradeQuantity;
+    std::cin >> listingId;
+    std::cin >> tradeId;
+    std::cin >> tradeQuantity;
+    std::cin >> tradePrice;
+    order.listingId = listingId;
+    order.tradeId = tradeId;
+    order.tradeQuantity = tradeQuantity;
+    order.tradePrice = tradePrice;
     order.messageType = 4;
     header->version = 0;
     header->payloadSize = sizeof(order);
@@ -196,7 +271,8 @@ char *RiskClient::createTradeMessage(std::shared_ptr<Header> header)
     header->timestamp = timestamp_since_epoch;
 
     u_long headerSize = sizeof(Header);
-    char *message = new char[headerSize + header->payloadSize];
+    messageBuffer.resize(headerSize + header->payloadSize);
+    char *message = messageBuffer.data();
     std::memcpy(message, header.get(), headerSize);
     std::memcpy(message + headerSize, &order, header->payloadSize);
     return message;
@@ -204,10 +280,16 @@ char *RiskClient::createTradeMessage(std::shared_ptr<Header> header)
 
 /*
 * Initializes a TCP socket on the provided PORT and connects to the server 
-* address (mAddress).
+* address (mAddress), or to the Unix socket at socketPath if one was given.
 */
 void RiskClient::initSocket()
 {
+    if (!socketPath.empty())
+    {
+        initUnixSocket();
+        return;
+    }
+
     if ((mSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
     {
         std::cerr << "Socket creation error" << std::endl;
@@ -231,6 +313,34 @@ void RiskClient::initSocket()
     }
 }
 
+/*
+* Connect to the server's Unix socket at socketPath.
+*/
+void RiskClient::initUnixSocket()
+{
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Invalid socket path" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    if ((mSocket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        std::cerr << "Socket creation error" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (connect(mSocket, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        std::cerr << "Connection failed" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
 /*
 * Send a message to the server.
 *
@@ -251,24 +361,24 @@ void RiskClient::initSocket()
 */
 bool RiskClient::sendMessage(Header &header, char *message, bool replyExpected)
 {
-    send(mSocket, message, sizeof(header) + header.payloadSize, 0);
+    transmitAll(message, sizeof(header) + header.payloadSize);
 
     if (replyExpected)
     {
         char buffer[1024];
-        int valread = read(mSocket, buffer, sizeof(Header));
+        bool received = receiveExactly(buffer, sizeof(Header));
 
         Header responseHeader;
         std::memcpy(&responseHeader, buffer, sizeof(Header));
 
-        if (responseHeader.payloadSize != sizeof(OrderResponse))
+        if (!received || responseHeader.payloadSize != sizeof(OrderResponse))
         {
             std::cerr << ERR_INVALID_DATA << std::endl;
             exit(EXIT_FAILURE);
         }
 
         OrderResponse reply;
-        valread = read(mSocket, buffer, responseHeader.payloadSize);
+        receiveExactly(buffer, responseHeader.payloadSize);
         std::memcpy(&reply, buffer, responseHeader.payloadSize);
         if (reply.status == OrderResponse::Status::ACCEPTED)
         {
@@ -282,4 +392,120 @@ bool RiskClient::sendMessage(Header &header, char *message, bool replyExpected)
     return true;
 }
 
+/*
+* Read bytes sent by the server, as read(2) on the connection. Over shared
+* memory it never blocks, wait for descriptor() to be readable.
+*
+* Returns
+* -------
+* received : ssize_t
+*     Number of bytes read, 0 once the server closed the connection, -1 with
+*     errno EAGAIN over shared memory when nothing is buffered.
+*/
+ssize_t RiskClient::receive(char *buffer, size_t size)
+{
+    if (!channel)
+        return read(mSocket, buffer, size);
+    size_t received = channel->receive(buffer, size);
+    if (received > 0)
+        return received;
+    if (!channel->clearDoorbells())
+        return 0;
+    // A doorbell just cleared may be for bytes written since.
+    received = channel->receive(buffer, size);
+    if (received > 0)
+        return received;
+    errno = EAGAIN;
+    return -1;
+}
+
+/*
+* Read exactly size bytes, waiting for them.
+*
+* Returns
+* -------
+* received : bool
+*     false if the connection closed first.
+*/
+bool RiskClient::receiveExactly(char *buffer, size_t size)
+{
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t count = receive(buffer + received, size - received);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            struct pollfd descriptor = {mSocket, POLLIN, 0};
+            ::poll(&descriptor, 1, -1);
+            continue;
+        }
+        if (count <= 0)
+            return false;
+        received += count;
+    }
+    return true;
+}
 
+/*
+* Send bytes to the server, as send(2) on the connection. Over shared memory
+* it never blocks, wait for descriptor() to be readable (the server rings
+* once it freed space).
+*
+* Returns
+* -------
+* sent : ssize_t
+*     Number of bytes sent, -1 with errno EAGAIN over shared memory when the
+*     ring is full.
+*/
+ssize_t RiskClient::transmit(const char *buffer, size_t size)
+{
+    if (!channel)
+        return send(mSocket, buffer, size, MSG_NOSIGNAL);
+    size_t sent = channel->send(buffer, size);
+    if (sent > 0 || size == 0)
+        return sent;
+    errno = EAGAIN;
+    return -1;
+}
+
+/*
+* Send all the bytes, waiting for room.
+*
+* Returns
+* -------
+* sent : bool
+*     false if the connection closed first.
+*/
+bool RiskClient::transmitAll(const char *buffer, size_t size)
+{
+    size_t sent = 0;
+    bool cleared = false;
+    while (sent < size)
+    {
+        ssize_t count = transmit(buffer + sent, size - sent);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Pending doorbells are cleared and the ring tried again before
+            // sleeping, so only one rung after that attempt wakes it.
+            if (channel && !cleared)
+            {
+                if (!channel->clearDoorbells())
+                    return false;
+                cleared = true;
+                continue;
+            }
+            struct pollfd descriptor = {mSocket, (short)(channel ? POLLIN : POLLOUT), 0};
+            ::poll(&descriptor, 1, -1);
+            cleared = false;
+            continue;
+        }
+        if (count <= 0)
+            return false;
+        sent += count;
+    }
+    return true;
+}
@@ -6,22 +6,18 @@
 * Arguments
 * ---------
 *   PORT
-*       uint64_t
+*       uint64_t, or the path of the server's Unix socket (containing a '/').
 */
 int main(int argc, char const *argv[])
 {
-    int PORT;
-    if (argc >= 2)
+    if (argc < 2)
     {
-        PORT = std::atoi(argv[1]);
-    }
-    else
-    {
-        std::cerr << "Arguments not provided. Valid arguments: ... <port>" << std::endl;
+        std::cerr << "Arguments not provided. Valid arguments: ... <port|socket path>" << std::endl;
         exit(EXIT_FAILURE);
     }
 
-    std::unique_ptr<RiskClient> client(new RiskClient(PORT));
+    std::string endpoint(argv[1]);
+    std::unique_ptr<RiskClient> client(endpoint.find('/') != std::string::npos ? new RiskClient(endpoint) : new RiskClient(std::atoi(argv[1])));
     while (true)
     {
         client->runCLI();
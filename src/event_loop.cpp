@@ -0,0 +1,796 @@
+#include "../include/risk_server/event_loop.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <iostream>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/*
+* Create the event loop for the requested backend. Falls back to epoll if
+* io_uring could not be initialized, and to select if epoll is not available
+* on this platform or could not be initialized.
+*
+* Parameters
+* ----------
+* backend : IOBackend
+*     The requested backend.
+* sqPollMillis : uint32_t
+*     With io_uring, idle milliseconds of its submission polling thread, 0
+*     submits from the calling thread.
+*
+* Returns
+* -------
+* loop : std::unique_ptr<EventLoop>
+*     The event loop.
+*/
+std::unique_ptr<EventLoop> EventLoop::create(IOBackend backend, uint32_t sqPollMillis)
+{
+#ifdef __linux__
+    if (backend == IOBackend::IO_URING)
+    {
+        std::unique_ptr<IoUringEventLoop> loop(new IoUringEventLoop(sqPollMillis));
+        if (loop->valid())
+            return loop;
+        std::cerr << "ERR 00 <IO_URING_SETUP> falling back to epoll" << std::endl;
+        backend = IOBackend::EPOLL;
+    }
+    if (backend == IOBackend::EPOLL)
+    {
+        std::unique_ptr<EpollEventLoop> loop(new EpollEventLoop());
+        if (loop->valid())
+            return loop;
+        std::cerr << "ERR 00 <EPOLL_CREATE> falling back to select" << std::endl;
+    }
+#endif
+    return std::unique_ptr<EventLoop>(new SelectEventLoop());
+}
+
+/*
+* Send each buffer of a batch without blocking, one send call each.
+*
+* Parameters
+* ----------
+* sends : std::vector<IOSend>
+*     Reference to the batch, the result of each send is set.
+*/
+void EventLoop::send(std::vector<IOSend> &sends)
+{
+    for (IOSend &request : sends)
+    {
+        ssize_t sent;
+        do
+            sent = ::send(request.fd, request.buffer, request.size, MSG_NOSIGNAL | MSG_DONTWAIT);
+        while (sent < 0 && errno == EINTR);
+        request.result = sent < 0 ? -errno : sent;
+    }
+}
+
+/*
+* Register a socket descriptor for read readiness.
+*
+* Parameters
+* ----------
+* fd : int
+*     The socket descriptor.
+*
+* Returns
+* -------
+* added : bool
+*     false if the descriptor does not fit in an fd_set, true otherwise.
+*/
+bool SelectEventLoop::add(int fd)
+{
+    if (fd < 0 || fd >= FD_SETSIZE)
+        return false;
+    readDescriptors.insert(fd);
+    return true;
+}
+
+/*
+* Change the readiness a registered socket descriptor is watched for.
+*
+* Parameters
+* ----------
+* fd : int
+*     The socket descriptor.
+* readInterest : bool
+*     true to watch for read readiness.
+* writeInterest : bool
+*     true to watch for write readiness.
+*/
+void SelectEventLoop::modify(int fd, bool readInterest, bool writeInterest)
+{
+    if (readInterest)
+        readDescriptors.insert(fd);
+    else
+        readDescriptors.erase(fd);
+
+    if (writeInterest)
+        writeDescriptors.insert(fd);
+    else
+        writeDescriptors.erase(fd);
+}
+
+void SelectEventLoop::remove(int fd)
+{
+    readDescriptors.erase(fd);
+    writeDescriptors.erase(fd);
+}
+
+/*
+* Rebuild the socket descriptor set and wait indefinitely for activity.
+*
+* Parameters
+* ----------
+* events : std::vector<IOEvent>
+*     Reference to the vector filled with the ready descriptors.
+*
+* Returns
+* -------
+* activity : int
+*     Number of ready descriptors, -1 on error.
+*/
+int SelectEventLoop::wait(std::vector<IOEvent> &events)
+{
+    events.clear();
+    FD_ZERO(&readDescriptorSet);
+    FD_ZERO(&writeDescriptorSet);
+    int maxDescriptor = -1;
+    for (int socketDescriptor : readDescriptors)
+    {
+        FD_SET(socketDescriptor, &readDescriptorSet);
+        maxDescriptor = std::max(maxDescriptor, socketDescriptor);
+    }
+    for (int socketDescriptor : writeDescriptors)
+    {
+        FD_SET(socketDescriptor, &writeDescriptorSet);
+        maxDescriptor = std::max(maxDescriptor, socketDescriptor);
+    }
+
+    int activity = select(maxDescriptor + 1, &readDescriptorSet, &writeDescriptorSet, NULL, NULL);
+    if (activity <= 0)
+        return activity;
+
+    for (int socketDescriptor = 0; socketDescriptor <= maxDescriptor; socketDescriptor++)
+    {
+        bool readable = FD_ISSET(socketDescriptor, &readDescriptorSet);
+        bool writable = FD_ISSET(socketDescriptor, &writeDescriptorSet);
+        if (readable || writable)
+            events.push_back({socketDescriptor, readable, writable});
+    }
+    return events.size();
+}
+
+#ifdef __linux__
+EpollEventLoop::EpollEventLoop()
+{
+    epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+}
+
+EpollEventLoop::~EpollEventLoop()
+{
+    if (epollDescriptor >= 0)
+        close(epollDescriptor);
+}
+
+/*
+* Register a socket descriptor for edge-triggered read readiness. The caller
+* must drain the descriptor until EAGAIN on every notification.
+*
+* Parameters
+* ----------
+* fd : int
+*     The socket descriptor.
+*
+* Returns
+* -------
+* added : bool
+*     true if the descriptor was registered, false otherwise.
+*/
+bool EpollEventLoop::add(int fd)
+{
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.fd = fd;
+    return epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+/*
+* Change the readiness a registered socket descriptor is watched for. Re-arming
+* read interest reports any data that arrived while it was disabled.
+*
+* Parameters
+* ----------
+* fd : int
+*     The socket descriptor.
+* readInterest : bool
+*     true to watch for read readiness.
+* writeInterest : bool
+*     true to watch for write readiness.
+*/
+void EpollEventLoop::modify(int fd, bool readInterest, bool writeInterest)
+{
+    struct epoll_event event = {};
+    event.events = EPOLLET;
+    if (readInterest)
+        event.events |= EPOLLIN | EPOLLRDHUP;
+    if (writeInterest)
+        event.events |= EPOLLOUT;
+    event.data.fd = fd;
+    epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, fd, &event);
+}
+
+void EpollEventLoop::remove(int fd)
+{
+    epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/*
+* Wait indefinitely for activity, only ready descriptors are returned.
+*
+* Parameters
+* ----------
+* events : std::vector<IOEvent>
+*     Reference to the vector filled with the ready descriptors.
+*
+* Returns
+* -------
+* activity : int
+*     Number of ready descriptors, -1 on error.
+*/
+int EpollEventLoop::wait(std::vector<IOEvent> &events)
+{
+    events.clear();
+    int activity = epoll_wait(epollDescriptor, readyEvents, MAX_EVENTS, -1);
+    for (int i = 0; i < activity; i++)
+    {
+        uint32_t flags = readyEvents[i].events;
+        bool readable = flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+        events.push_back({readyEvents[i].data.fd, readable, (flags & EPOLLOUT) != 0});
+    }
+    return activity;
+}
+
+/*
+* Set up the rings and register the provided buffers. The loop is not valid()
+* if the kernel lacks io_uring or provided buffer rings.
+*
+* Parameters
+* ----------
+* sqPollMillis : uint32_t
+*     Idle milliseconds before the submission polling thread sleeps, 0 for no
+*     polling thread.
+*/
+IoUringEventLoop::IoUringEventLoop(uint32_t sqPollMillis)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = CQ_ENTRIES;
+    if (sqPollMillis > 0)
+    {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = sqPollMillis;
+    }
+    int descriptor = syscall(__NR_io_uring_setup, SQ_ENTRIES, &params);
+    if (descriptor < 0)
+        return;
+    sqPoll = sqPollMillis > 0;
+    sqEntries = params.sq_entries;
+
+    sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+    sqeMapSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqMap = mmap(NULL, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, descriptor, IORING_OFF_SQ_RING);
+    cqMap = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqMap : mmap(NULL, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, descriptor, IORING_OFF_CQ_RING);
+    sqeMap = mmap(NULL, sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, descriptor, IORING_OFF_SQES);
+    size_t bufferRingSize = BUFFER_COUNT * sizeof(struct io_uring_buf);
+    void *ringMemory = mmap(NULL, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *bufferMemory = mmap(NULL, (size_t)BUFFER_COUNT * BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ringMemory != MAP_FAILED)
+        bufferRing = static_cast<struct io_uring_buf_ring *>(ringMemory);
+    if (bufferMemory != MAP_FAILED)
+        buffers = static_cast<char *>(bufferMemory);
+    ringDescriptor = descriptor;
+    if (sqMap == MAP_FAILED || cqMap == MAP_FAILED || sqeMap == MAP_FAILED || bufferRing == NULL || buffers == NULL)
+    {
+        close(ringDescriptor);
+        ringDescriptor = -1;
+        return;
+    }
+
+    char *sq = static_cast<char *>(sqMap), *cq = static_cast<char *>(cqMap);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqFlags = reinterpret_cast<unsigned *>(sq + params.sq_off.flags);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+    sqes = static_cast<struct io_uring_sqe *>(sqeMap);
+    sqLocalTail = *sqTail;
+
+    struct io_uring_buf_reg registration;
+    std::memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+    registration.ring_entries = BUFFER_COUNT;
+    registration.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ringDescriptor, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+    {
+        close(ringDescriptor);
+        ringDescriptor = -1;
+        return;
+    }
+    for (uint16_t buffer = 0; buffer < BUFFER_COUNT; buffer++)
+        recycle(buffer);
+}
+
+IoUringEventLoop::~IoUringEventLoop()
+{
+    if (ringDescriptor >= 0)
+        close(ringDescriptor);
+    if (sqeMap != NULL && sqeMap != MAP_FAILED)
+        munmap(sqeMap, sqeMapSize);
+    if (cqMap != NULL && cqMap != MAP_FAILED && cqMap != sqMap)
+        munmap(cqMap, cqMapSize);
+    if (sqMap != NULL && sqMap != MAP_FAILED)
+        munmap(sqMap, sqMapSize);
+    if (bufferRing != NULL)
+        munmap(bufferRing, BUFFER_COUNT * sizeof(struct io_uring_buf));
+    if (buffers != NULL)
+        munmap(buffers, (size_t)BUFFER_COUNT * BUFFER_SIZE);
+}
+
+/*
+* Watch a listening descriptor for read readiness, with a multishot poll.
+*
+* Parameters
+* ----------
+* fd : int
+*     The descriptor.
+*
+* Returns
+* -------
+* added : bool
+*     false if the descriptor cannot be tagged in user_data, true otherwise.
+*/
+bool IoUringEventLoop::add(int fd)
+{
+    return start(fd, false);
+}
+
+/*
+* Receive from a client connection with a multishot recv, its data comes with
+* the readable events.
+*
+* Parameters
+* ----------
+* fd : int
+*     The client's socket descriptor.
+*
+* Returns
+* -------
+* added : bool
+*     false if the descriptor cannot be tagged in user_data, true otherwise.
+*/
+bool IoUringEventLoop::addConnection(int fd)
+{
+    return start(fd, true);
+}
+
+/*
+* Queue the requests matching the descriptor's interest: arm the missing
+* ones, cancel those no longer wanted. Cancelled requests are re-armed once
+* their last completion came back if they are wanted again.
+*/
+void IoUringEventLoop::arm(int fd)
+{
+    Watch &entry = watch(fd);
+    if (!entry.registered)
+        return;
+
+    if (entry.readInterest && !entry.readArmed)
+    {
+        struct io_uring_sqe *sqe = nextSqe();
+        sqe->fd = fd;
+        if (entry.connection)
+        {
+            sqe->opcode = IORING_OP_RECV;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = BUFFER_GROUP;
+            sqe->user_data = userData(RECV, fd, entry.generation);
+        }
+        else
+        {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->len = IORING_POLL_ADD_MULTI;
+            sqe->poll32_events = POLLIN;
+            sqe->user_data = userData(POLL_READ, fd, entry.generation);
+        }
+        entry.readArmed = true;
+    }
+    else if (!entry.readInterest && entry.readArmed && !entry.readCancelling)
+    {
+        cancel(userData(entry.connection ? RECV : POLL_READ, fd, entry.generation));
+        entry.readCancelling = true;
+    }
+
+    if (entry.writeInterest && !entry.writeArmed)
+    {
+        struct io_uring_sqe *sqe = nextSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = POLLOUT;
+        sqe->user_data = userData(POLL_WRITE, fd, entry.generation);
+        entry.writeArmed = true;
+    }
+    else if (!entry.writeInterest && entry.writeArmed && !entry.writeCancelling)
+    {
+        cancel(userData(POLL_WRITE, fd, entry.generation));
+        entry.writeCancelling = true;
+    }
+}
+
+/*
+* Queue the cancellation of the request tagged target.
+*/
+void IoUringEventLoop::cancel(uint64_t target)
+{
+    struct io_uring_sqe *sqe = nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = CANCEL;
+}
+
+/*
+* Turn one completion into an event. Completions of removed descriptors are
+* dropped (their buffer recycled), requests which ended are re-armed if they
+* are still wanted.
+*
+* Parameters
+* ----------
+* cqe : io_uring_cqe
+*     The completion.
+* events : std::vector<IOEvent>
+*     Reference to the vector the event is appended to.
+* held : std::vector<uint16_t>
+*     Reference to the vector of buffers held by the events.
+* sends : std::vector<IOSend>*
+*     The batch being sent, whose results SEND completions carry.
+*/
+void IoUringEventLoop::complete(const struct io_uring_cqe &cqe, std::vector<IOEvent> &events, std::vector<uint16_t> &held, std::vector<IOSend> *sends)
+{
+    Kind kind = static_cast<Kind>(cqe.user_data & 7);
+    if (kind == CANCEL)
+        return;
+    if (kind == SEND)
+    {
+        size_t index = cqe.user_data >> 3;
+        if (sends != NULL && index < sends->size())
+            (*sends)[index].result = cqe.res;
+        return;
+    }
+
+    int fd = (cqe.user_data >> 3) & ((1 << 29) - 1);
+    bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    bool buffered = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t buffer = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+    if ((size_t)fd >= watches.size() || watches[fd].generation != (uint32_t)(cqe.user_data >> 32) || !watches[fd].registered)
+    {
+        if (buffered)
+            recycle(buffer);
+        return;
+    }
+    Watch &entry = watches[fd];
+
+    if (kind == POLL_WRITE)
+    {
+        if (!more)
+            entry.writeArmed = entry.writeCancelling = false;
+        if (entry.writeInterest && cqe.res != -ECANCELED)
+            events.push_back({fd, false, true});
+        if (!more)
+            arm(fd);
+        return;
+    }
+
+    if (!more)
+        entry.readArmed = entry.readCancelling = false;
+    if (kind == POLL_READ)
+    {
+        if (cqe.res != -ECANCELED)
+            events.push_back({fd, true, false});
+    }
+    else if (cqe.res > 0 && buffered)
+    {
+        IOEvent event = {fd, true, false};
+        event.received = true;
+        event.data = buffers + (size_t)buffer * BUFFER_SIZE;
+        event.size = cqe.res;
+        events.push_back(event);
+        held.push_back(buffer);
+    }
+    else if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED && cqe.res != -EINTR && cqe.res != -EAGAIN))
+    {
+        // End of stream or a socket error, the connection is closed.
+        IOEvent event = {fd, true, false};
+        event.received = true;
+        event.size = cqe.res;
+        events.push_back(event);
+        entry.readInterest = false;
+    }
+    // Out of buffers: re-armed now, the recv would fail again until the events
+    // holding them are handled, so it resumes on the next wait.
+    if (!more && cqe.res == -ENOBUFS)
+        starved.push_back(fd);
+    else if (!more)
+        arm(fd);
+}
+
+/*
+* Publish the queued submissions and enter the kernel if needed: to submit
+* them (unless the polling thread is awake) or to wait for completions.
+*
+* Parameters
+* ----------
+* minComplete : unsigned
+*     Completions to wait for.
+* flags : unsigned
+*     Extra io_uring_enter flags.
+*
+* Returns
+* -------
+* result : int
+*     io_uring_enter's result, 0 if it was not needed.
+*/
+int IoUringEventLoop::enter(unsigned minComplete, unsigned flags)
+{
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    unsigned submit = sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (minComplete > 0)
+        flags |= IORING_ENTER_GETEVENTS;
+    if (sqPoll)
+    {
+        // The tail store must be visible before the thread's flag is read.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        if (flags == 0)
+            return 0;
+    }
+    else if (submit == 0 && minComplete == 0)
+        return 0;
+    return syscall(__NR_io_uring_enter, ringDescriptor, submit, minComplete, flags, NULL, 0);
+}
+
+/*
+* Change the readiness a descriptor is watched for, reading a connection
+* stops once its recv's completions in flight came back.
+*
+* Parameters
+* ----------
+* fd : int
+*     The descriptor.
+* readInterest : bool
+*     true to receive (or watch for read readiness).
+* writeInterest : bool
+*     true to watch for write readiness.
+*/
+void IoUringEventLoop::modify(int fd, bool readInterest, bool writeInterest)
+{
+    Watch &entry = watch(fd);
+    entry.readInterest = readInterest;
+    entry.writeInterest = writeInterest;
+    arm(fd);
+}
+
+/*
+* Next free submission queue entry, cleared. A full queue is submitted first.
+*/
+struct io_uring_sqe *IoUringEventLoop::nextSqe()
+{
+    while (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+        enter(0, sqPoll ? IORING_ENTER_SQ_WAIT : 0);
+    unsigned index = sqLocalTail & *sqMask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    sqLocalTail++;
+    return sqe;
+}
+
+/*
+* Turn every available completion into events.
+*/
+void IoUringEventLoop::reap(std::vector<IOEvent> &events, std::vector<uint16_t> &held, std::vector<IOSend> *sends)
+{
+    unsigned head = *cqHead;
+    while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+    {
+        complete(cqes[head & *cqMask], events, held, sends);
+        head++;
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+* Hand a buffer back to the kernel.
+*/
+void IoUringEventLoop::recycle(uint16_t buffer)
+{
+    // Not bufferRing->bufs, the kernel header's flexible array member is
+    // offset by an empty struct in C++. The entries start the ring.
+    struct io_uring_buf &entry = reinterpret_cast<struct io_uring_buf *>(bufferRing)[bufferTail & (BUFFER_COUNT - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(buffers + (size_t)buffer * BUFFER_SIZE);
+    entry.len = BUFFER_SIZE;
+    entry.bid = buffer;
+    bufferTail++;
+    __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+}
+
+/*
+* Stop watching a descriptor: its requests are cancelled and any completion
+* still coming, or reaped but not yet returned, is dropped.
+*/
+void IoUringEventLoop::remove(int fd)
+{
+    if (fd < 0 || (size_t)fd >= watches.size() || !watches[fd].registered)
+        return;
+    Watch &entry = watches[fd];
+    if (entry.readArmed && !entry.readCancelling)
+        cancel(userData(entry.connection ? RECV : POLL_READ, fd, entry.generation));
+    if (entry.writeArmed && !entry.writeCancelling)
+        cancel(userData(POLL_WRITE, fd, entry.generation));
+    entry = Watch{entry.generation + 1};
+
+    // Requests take the descriptor's file when submitted, so every queued one
+    // is submitted before the caller closes it and its number is reused.
+    enter(0);
+    while (sqPoll && __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) != sqLocalTail)
+    {
+        sched_yield();
+        enter(0);
+    }
+
+    for (size_t i = 0; i < deferred.size();)
+    {
+        if (deferred[i].fd != fd)
+        {
+            i++;
+            continue;
+        }
+        if (deferred[i].received && deferred[i].size > 0)
+        {
+            uint16_t buffer = (deferred[i].data - buffers) / BUFFER_SIZE;
+            deferredBuffers.erase(std::find(deferredBuffers.begin(), deferredBuffers.end(), buffer));
+            recycle(buffer);
+        }
+        deferred.erase(deferred.begin() + i);
+    }
+}
+
+/*
+* Send every buffer of a batch without blocking, submitted together and
+* reaped with as few io_uring_enter calls as the completions need (one
+* usually). Other completions reaped meanwhile are returned by the next wait.
+*
+* Parameters
+* ----------
+* sends : std::vector<IOSend>
+*     Reference to the batch, the result of each send is set.
+*/
+void IoUringEventLoop::send(std::vector<IOSend> &sends)
+{
+    if (sends.empty())
+        return;
+    for (size_t i = 0; i < sends.size(); i++)
+    {
+        struct io_uring_sqe *sqe = nextSqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = sends[i].fd;
+        sqe->addr = reinterpret_cast<uint64_t>(sends[i].buffer);
+        sqe->len = sends[i].size;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+        sqe->user_data = (uint64_t)i << 3 | SEND;
+        // Not a result a send completes with.
+        sends[i].result = -EINPROGRESS;
+    }
+
+    size_t completed = 0;
+    while (completed < sends.size())
+    {
+        if (enter(1) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+        {
+            for (IOSend &request : sends)
+                if (request.result == -EINPROGRESS)
+                    request.result = -errno;
+            return;
+        }
+        reap(deferred, deferredBuffers, &sends);
+        completed = std::count_if(sends.begin(), sends.end(), [](const IOSend &request) { return request.result != -EINPROGRESS; });
+    }
+}
+
+/*
+* Register a descriptor with read interest and arm its read request.
+*/
+bool IoUringEventLoop::start(int fd, bool connection)
+{
+    if (fd < 0 || fd >= (1 << 29))
+        return false;
+    Watch &entry = watch(fd);
+    entry = Watch{entry.generation};
+    entry.registered = true;
+    entry.connection = connection;
+    entry.readInterest = true;
+    arm(fd);
+    return true;
+}
+
+/*
+* Submit the queued requests and wait for completions. The buffers of the
+* events returned by the previous wait are recycled first, then the recvs
+* which ran out of them are re-armed. Accept and wakeup
+* readiness is returned after the connections' events, so a descriptor closed
+* while handling them is not reused before its own last events were seen.
+*
+* Parameters
+* ----------
+* events : std::vector<IOEvent>
+*     Reference to the vector filled with the completed descriptors.
+*
+* Returns
+* -------
+* activity : int
+*     Number of events, -1 on error.
+*/
+int IoUringEventLoop::wait(std::vector<IOEvent> &events)
+{
+    events.clear();
+    for (uint16_t buffer : delivered)
+        recycle(buffer);
+    delivered.clear();
+    for (int fd : starved)
+        arm(fd);
+    starved.clear();
+    events.swap(deferred);
+    delivered.swap(deferredBuffers);
+
+    bool ready = !events.empty() || *cqHead != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if (enter(ready ? 0 : 1) < 0 && errno != EBUSY && !ready)
+        return -1;
+    reap(events, delivered, NULL);
+    std::stable_partition(events.begin(), events.end(), [](const IOEvent &event) { return event.received || event.writable; });
+    return events.size();
+}
+
+/*
+* Watch entry of a descriptor, the table grows to fit it.
+*/
+IoUringEventLoop::Watch &IoUringEventLoop::watch(int fd)
+{
+    if ((size_t)fd >= watches.size())
+        watches.resize(fd + 1);
+    return watches[fd];
+}
+#endif
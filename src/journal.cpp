@@ -0,0 +1,475 @@
+#include "../include/risk_server/journal.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/*
+* Stop the interval thread and sync and close the current segment.
+*/
+Journal::~Journal()
+{
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopCondition.notify_one();
+    if (syncThread.joinable())
+        syncThread.join();
+
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (mapping != NULL && options.sync != JournalSync::NONE)
+        sync(tail.load(std::memory_order_acquire));
+    unmapSegment();
+    if (snapshotProcess > 0)
+        waitpid(snapshotProcess, NULL, 0);
+}
+
+/*
+* Append a record to the current segment, moving to a new segment if it is
+* full. A segment which cannot be created stops the server, it must not
+* accept what it cannot recover.
+*
+* Parameters
+* ----------
+* record : JournalRecord
+*     Reference to the record, its checksum is set.
+*/
+void Journal::append(JournalRecord &record)
+{
+    size_t offset = tail.load(std::memory_order_relaxed);
+    if (offset + sizeof(JournalRecord) > SEGMENT_SIZE)
+    {
+        rotate();
+        offset = tail.load(std::memory_order_relaxed);
+    }
+    record.reserved = 0;
+    record.checksum = checksum(record);
+    std::memcpy(mapping + offset, &record, sizeof(JournalRecord));
+    tail.store(offset + sizeof(JournalRecord), std::memory_order_release);
+}
+
+/*
+* FNV-1a hash of every byte of the record after the checksum, a torn or
+* stale record fails it and ends the replay.
+*/
+uint32_t Journal::checksum(const JournalRecord &record)
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&record);
+    uint32_t hash = 2166136261u;
+    for (size_t i = sizeof(record.checksum); i < sizeof(JournalRecord); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+/*
+* Force the records appended so far to disk when syncing per batch, a no-op
+* otherwise. Called once per batch of handled messages before their replies
+* are sent, so one sync covers every record of the batch (group commit).
+*/
+void Journal::commit()
+{
+    if (options.sync != JournalSync::BATCH || tail.load(std::memory_order_acquire) == synced.load(std::memory_order_relaxed))
+        return;
+    std::lock_guard<std::mutex> lock(syncMutex);
+    sync(tail.load(std::memory_order_acquire));
+}
+
+/*
+* Map the engine's snapshot, if there is one, and restore the engine from it.
+*
+* Parameters
+* ----------
+* restore : Restore
+*     Restores the engine from the snapshot's instruments, account positions
+*     and orders.
+* from : JournalPosition
+*     Reference set to the journal position the replay starts from, the
+*     start of the journal without a snapshot.
+*
+* Returns
+* -------
+* loaded : bool
+*     true if there was no snapshot or it was restored, false if it could not
+*     be read or is truncated.
+*/
+bool Journal::loadSnapshot(const Restore &restore, JournalPosition &from)
+{
+    from = JournalPosition();
+    int snapshotDescriptor = ::open(snapshotPath().c_str(), O_RDONLY);
+    if (snapshotDescriptor < 0)
+        return errno == ENOENT;
+
+    struct stat status;
+    void *address = MAP_FAILED;
+    if (fstat(snapshotDescriptor, &status) == 0 && (size_t)status.st_size >= sizeof(SnapshotHeader))
+        address = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, snapshotDescriptor, 0);
+    close(snapshotDescriptor);
+    if (address == MAP_FAILED)
+        return false;
+    madvise(address, status.st_size, MADV_SEQUENTIAL);
+
+    const char *data = static_cast<const char *>(address);
+    SnapshotHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    bool valid = header.magic == SnapshotHeader::MAGIC && header.version == SnapshotHeader::VERSION && header.engine == engine &&
+                 (size_t)status.st_size == sizeof(header) + header.instruments * sizeof(SnapshotInstrument) +
+                                                  header.accountPositions * sizeof(SnapshotAccountPosition) + header.orders * sizeof(SnapshotOrder);
+    if (valid && header.engines != engines)
+    {
+        std::cerr << "ERR 00 <JOURNAL_LAYOUT>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (valid)
+    {
+        const SnapshotInstrument *instruments = reinterpret_cast<const SnapshotInstrument *>(data + sizeof(header));
+        const SnapshotAccountPosition *accountPositions = reinterpret_cast<const SnapshotAccountPosition *>(instruments + header.instruments);
+        restore(header, instruments, accountPositions, reinterpret_cast<const SnapshotOrder *>(accountPositions + header.accountPositions));
+        from.segment = header.journalSegment;
+        from.offset = header.journalOffset;
+        snapshotted = from;
+    }
+    munmap(address, status.st_size);
+    return valid;
+}
+
+/*
+* Open a segment file and map it, creating and preallocating it if required.
+* The records of a new segment start after its header.
+*
+* Parameters
+* ----------
+* number : uint32_t
+*     The segment number.
+* create : bool
+*     true to create the segment, false to open an existing one.
+*
+* Returns
+* -------
+* mapped : bool
+*     true if the segment is mapped, false if a file operation failed.
+*/
+bool Journal::mapSegment(uint32_t number, bool create)
+{
+    std::string path = segmentPath(number);
+    descriptor = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0644);
+    if (descriptor < 0)
+        return false;
+
+    struct stat status;
+    bool sized;
+    if (create)
+    {
+        // Allocated up front so appends never extend the file.
+#ifdef __linux__
+        sized = posix_fallocate(descriptor, 0, SEGMENT_SIZE) == 0;
+#else
+        sized = ftruncate(descriptor, SEGMENT_SIZE) == 0;
+#endif
+    }
+    else
+        sized = fstat(descriptor, &status) == 0 && (size_t)status.st_size == SEGMENT_SIZE;
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (create)
+        flags |= MAP_POPULATE;
+#endif
+    void *address = sized ? mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, flags, descriptor, 0) : MAP_FAILED;
+    if (address == MAP_FAILED)
+    {
+        close(descriptor);
+        descriptor = -1;
+        if (create)
+            unlink(path.c_str());
+        return false;
+    }
+    mapping = static_cast<char *>(address);
+    segment = number;
+    synced.store(0, std::memory_order_relaxed);
+
+    JournalSegmentHeader header;
+    if (create)
+    {
+        header.magic = JournalSegmentHeader::MAGIC;
+        header.version = JournalSegmentHeader::VERSION;
+        header.engines = engines;
+        header.engine = engine;
+        header.segment = number;
+        std::memcpy(mapping, &header, sizeof(header));
+        tail.store(sizeof(header), std::memory_order_release);
+        return true;
+    }
+
+    std::memcpy(&header, mapping, sizeof(header));
+    if (header.magic != JournalSegmentHeader::MAGIC || header.version != JournalSegmentHeader::VERSION ||
+        header.engine != engine || header.segment != number)
+    {
+        unmapSegment();
+        return false;
+    }
+    if (header.engines != engines)
+    {
+        // Listings would be recovered into the wrong engines.
+        std::cerr << "ERR 00 <JOURNAL_LAYOUT>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    madvise(mapping, SEGMENT_SIZE, MADV_SEQUENTIAL);
+    return true;
+}
+
+uint64_t Journal::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+* Replay every record of the journal's segments in order from a position,
+* then keep the last segment open for appending. Replay of a segment stops at
+* its first empty or corrupt record. Only the last segment may end early (a
+* torn write), anything after it there is cleared so it is never followed by
+* stale records; earlier segments must be full.
+*
+* Parameters
+* ----------
+* apply : std::function<void(const JournalRecord &)>
+*     Applies a replayed record to the engine.
+* from : JournalPosition
+*     Reference to the position of the first record to replay.
+* replayed : size_t
+*     Reference set to the number of records replayed.
+*
+* Returns
+* -------
+* opened : bool
+*     true if the journal is ready for appending, false if a segment could
+*     not be read or created, or one before the last ends early.
+*/
+bool Journal::open(const std::function<void(const JournalRecord &)> &apply, const JournalPosition &from, size_t &replayed)
+{
+    replayed = 0;
+    if (mkdir(options.directory.c_str(), 0755) < 0 && errno != EEXIST)
+        return false;
+
+    firstSegment = from.segment;
+    struct stat status;
+    if (stat(segmentPath(from.segment).c_str(), &status) < 0)
+    {
+        if (!mapSegment(from.segment, true))
+            return false;
+    }
+    else
+    {
+        for (uint32_t number = from.segment;; number++)
+        {
+            if (!mapSegment(number, false))
+                return false;
+            size_t offset = sizeof(JournalSegmentHeader);
+            if (number == from.segment)
+                offset = std::max<size_t>(offset, from.offset);
+            for (; offset + sizeof(JournalRecord) <= SEGMENT_SIZE; offset += sizeof(JournalRecord))
+            {
+                JournalRecord record;
+                std::memcpy(&record, mapping + offset, sizeof(JournalRecord));
+                if (record.type == JournalRecord::Type::END || record.checksum != checksum(record))
+                    break;
+                apply(record);
+                replayed++;
+            }
+            if (stat(segmentPath(number + 1).c_str(), &status) == 0)
+            {
+                unmapSegment();
+                // Segments rotate only when full, a gap before the next one
+                // is corruption and replaying past it would be wrong.
+                if (offset + sizeof(JournalRecord) <= SEGMENT_SIZE)
+                    return false;
+                continue;
+            }
+
+            const uint64_t *words = reinterpret_cast<const uint64_t *>(mapping + offset);
+            size_t count = (SEGMENT_SIZE - offset) / sizeof(uint64_t);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (words[i] != 0)
+                {
+                    std::memset(mapping + offset, 0, SEGMENT_SIZE - offset);
+                    break;
+                }
+            }
+            tail.store(offset, std::memory_order_release);
+            break;
+        }
+    }
+
+    if (options.sync == JournalSync::INTERVAL)
+        syncThread = std::thread([this]() { syncPeriodically(); });
+    nextSnapshotAt.store(now() + options.snapshotSeconds * 1000000000ULL, std::memory_order_relaxed);
+    return true;
+}
+
+/*
+* Close the full segment, synced unless the policy is NONE, and start the
+* next one.
+*/
+void Journal::rotate()
+{
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (options.sync != JournalSync::NONE)
+        sync(tail.load(std::memory_order_relaxed));
+    unmapSegment();
+    if (!mapSegment(segment + 1, true))
+    {
+        std::cerr << "ERR 00 <JOURNAL_FILE>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+std::string Journal::segmentPath(uint32_t number) const
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/engine-%u-%08u.journal", engine, number);
+    return options.directory + name;
+}
+
+/*
+* Fork a process writing a snapshot of the engine at the current journal
+* position, if the previous one has finished and records were appended since.
+* Called from the engine's thread between messages (or with the shared
+* engine's mutex held), so the copy-on-write image is consistent; the engine
+* only pauses for the fork itself. The child writes a temporary file, syncs
+* it, renames it over the previous snapshot and deletes the journal segments
+* before the snapshot's.
+*
+* Parameters
+* ----------
+* write : Write
+*     Writes the engine to the snapshot, called in the child.
+*/
+void Journal::snapshot(const Write &write)
+{
+    // Another worker sharing the engine may have taken it.
+    if (!snapshotDue())
+        return;
+    nextSnapshotAt.store(now() + options.snapshotSeconds * 1000000000ULL, std::memory_order_relaxed);
+
+    if (snapshotProcess > 0)
+    {
+        int status;
+        pid_t reaped = waitpid(snapshotProcess, &status, WNOHANG);
+        if (reaped == 0)
+            return;
+        if (reaped == snapshotProcess && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)
+            firstSegment = snapshotted.segment;
+        else
+            snapshotted = JournalPosition();
+        snapshotProcess = -1;
+    }
+
+    JournalPosition position;
+    position.segment = segment;
+    position.offset = tail.load(std::memory_order_relaxed);
+    if (position.segment == snapshotted.segment && position.offset == snapshotted.offset)
+        return;
+
+    // The child must not allocate, every path is built here.
+    std::string path = snapshotPath(), temporaryPath = path + ".tmp";
+    std::vector<std::string> coveredSegments;
+    for (uint32_t number = firstSegment; number < position.segment; number++)
+        coveredSegments.push_back(segmentPath(number));
+    SnapshotHeader header;
+    header.magic = SnapshotHeader::MAGIC;
+    header.version = SnapshotHeader::VERSION;
+    header.engines = engines;
+    header.engine = engine;
+    header.journalSegment = position.segment;
+    header.journalOffset = position.offset;
+    header.instruments = header.accountPositions = header.orders = 0;
+
+    pid_t process = fork();
+    if (process < 0)
+    {
+        std::cerr << "ERR 00 <SNAPSHOT_FORK>" << std::endl;
+        return;
+    }
+    if (process > 0)
+    {
+        snapshotProcess = process;
+        snapshotted = position;
+        return;
+    }
+
+    int snapshotDescriptor = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (snapshotDescriptor < 0)
+        _exit(EXIT_FAILURE);
+    SnapshotWriter writer(snapshotDescriptor);
+    bool written = write(writer, header) && writer.flush() && fsync(snapshotDescriptor) == 0;
+    close(snapshotDescriptor);
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0)
+        _exit(EXIT_FAILURE);
+    int directoryDescriptor = ::open(options.directory.c_str(), O_RDONLY);
+    if (directoryDescriptor >= 0)
+    {
+        fsync(directoryDescriptor);
+        close(directoryDescriptor);
+    }
+    for (const std::string &covered : coveredSegments)
+        unlink(covered.c_str());
+    _exit(EXIT_SUCCESS);
+}
+
+bool Journal::snapshotDue() const
+{
+    return options.snapshotSeconds > 0 && now() >= nextSnapshotAt.load(std::memory_order_relaxed);
+}
+
+std::string Journal::snapshotPath() const
+{
+    return options.directory + "/engine-" + std::to_string(engine) + ".snapshot";
+}
+
+/*
+* Force the segment's records up to `end` to disk, syncMutex must be held.
+* Only the pages not synced yet are written.
+*/
+void Journal::sync(size_t end)
+{
+    size_t start = synced.load(std::memory_order_relaxed);
+    if (end <= start)
+        return;
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    start &= ~(pageSize - 1);
+    msync(mapping + start, end - start, MS_SYNC);
+    synced.store(end, std::memory_order_relaxed);
+}
+
+/*
+* Body of the interval thread: sync every intervalMillis until stopped.
+*/
+void Journal::syncPeriodically()
+{
+    std::unique_lock<std::mutex> stopLock(stopMutex);
+    while (!stopCondition.wait_for(stopLock, std::chrono::milliseconds(options.intervalMillis), [this]() { return stopping; }))
+    {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        sync(tail.load(std::memory_order_acquire));
+    }
+}
+
+void Journal::unmapSegment()
+{
+    if (mapping != NULL)
+        munmap(mapping, SEGMENT_SIZE);
+    if (descriptor >= 0)
+        close(descriptor);
+    mapping = NULL;
+    descriptor = -1;
+}
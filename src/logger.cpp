@@ -0,0 +1,265 @@
+#include "../include/risk_server/logger.hpp"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "../include/risk_server/strings.hpp"
+
+/*
+* Append a record to the ring. Never blocks, a full ring drops the record and
+* counts it so the logger thread can report the loss.
+*
+* Parameters
+* ----------
+* record : LogRecord
+*     The record to append.
+*
+* Returns
+* -------
+* pushed : bool
+*     true if the record was appended, false if it was dropped.
+*/
+bool LogQueue::push(const LogRecord &record)
+{
+    uint64_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail - cachedHead >= CAPACITY)
+    {
+        cachedHead = head.load(std::memory_order_acquire);
+        if (currentTail - cachedHead >= CAPACITY)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    records[currentTail & (CAPACITY - 1)] = record;
+    tail.store(currentTail + 1, std::memory_order_release);
+    return true;
+}
+
+thread_local LogQueue *Logger::localQueue = NULL;
+
+Logger::Logger()
+{
+    consumer = std::thread([this]() {
+        while (running.load(std::memory_order_acquire))
+        {
+            // Flush once the queues are empty, sleep briefly while idle.
+            if (!drain())
+            {
+                fflush(stdout);
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+        drain();
+        fflush(stdout);
+    });
+}
+
+/*
+* Stop the logger thread once every queued record has been written.
+*/
+Logger::~Logger()
+{
+    running.store(false, std::memory_order_release);
+    if (consumer.joinable())
+        consumer.join();
+}
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+/*
+* Format every record currently queued by any producing thread.
+*
+* Returns
+* -------
+* drained : bool
+*     true if at least one record was written, false otherwise.
+*/
+bool Logger::drain()
+{
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    bool drained = false;
+    for (auto &queue : queues)
+        drained |= drainQueue(*queue);
+    return drained;
+}
+
+bool Logger::drainQueue(LogQueue &queue)
+{
+    uint64_t currentHead = queue.head.load(std::memory_order_relaxed);
+    uint64_t currentTail = queue.tail.load(std::memory_order_acquire);
+    for (uint64_t i = currentHead; i < currentTail; i++)
+        format(queue.records[i & (LogQueue::CAPACITY - 1)]);
+    queue.head.store(currentTail, std::memory_order_release);
+
+    uint64_t dropped = queue.dropped.exchange(0, std::memory_order_relaxed);
+    totalDropped += dropped;
+    if (dropped > 0)
+        format({0, 0, 0, (int64_t)dropped, LogEvent::RECORDS_DROPPED});
+    return currentTail != currentHead || dropped > 0;
+}
+
+/*
+* Write one record as a text line, ERR records go to stderr and the rest to
+* stdout.
+*
+* Parameters
+* ----------
+* record : LogRecord
+*     The record to format.
+*/
+void Logger::format(const LogRecord &record)
+{
+    unsigned long long seconds = record.timestamp / 1000000000ULL;
+    unsigned long micros = (record.timestamp % 1000000000ULL) / 1000;
+    switch (record.event)
+    {
+    case LogEvent::NEW_CONNECTION:
+    case LogEvent::DISCONNECTED:
+    {
+        // A negative port is the address family of a peer without one.
+        if (record.quantity < 0)
+        {
+            printf("%llu.%06lu %s %s SOCK FD%llu\n", seconds, micros, text(record.event), record.quantity == -AF_UNIX ? "unix" : "unknown",
+                   (unsigned long long)record.orderId);
+            break;
+        }
+        struct in_addr address;
+        address.s_addr = (in_addr_t)record.listingId;
+        printf("%llu.%06lu %s %s:%lld SOCK FD%llu\n", seconds, micros, text(record.event), inet_ntoa(address), (long long)record.quantity, (unsigned long long)record.orderId);
+        break;
+    }
+    case LogEvent::RECORDS_DROPPED:
+    {
+        printf("%s COUNT=%lld\n", text(record.event), (long long)record.quantity);
+        break;
+    }
+    case LogEvent::ORDER_POOL_GROWN:
+    {
+        printf("%llu.%06lu %s LIVE=%llu CAPACITY=%llu\n", seconds, micros, text(record.event), (unsigned long long)record.orderId, (unsigned long long)record.listingId);
+        break;
+    }
+    default:
+    {
+        FILE *stream = levelOf(record.event) == LogLevel::ERR ? stderr : stdout;
+        fprintf(stream, "%llu.%06lu %s ORDER_ID=%llu LISTING_ID=%llu QUANTITY=%lld\n", seconds, micros, text(record.event), (unsigned long long)record.orderId, (unsigned long long)record.listingId, (long long)record.quantity);
+        break;
+    }
+    }
+}
+
+/*
+* Occurrences of an event across every thread, whether or not it was written.
+*
+* Parameters
+* ----------
+* event : LogEvent
+*     The event to count.
+*
+* Returns
+* -------
+* count : uint64_t
+*     Number of times the event was logged since startup.
+*/
+uint64_t Logger::eventCount(LogEvent event)
+{
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    if (event == LogEvent::RECORDS_DROPPED)
+        return totalDropped;
+    uint64_t count = 0;
+    for (auto &queue : queues)
+        count += queue->events[(size_t)event].load(std::memory_order_relaxed);
+    return count;
+}
+
+/*
+* Short lower-case name of an event, used as a metrics label.
+*/
+const char *Logger::name(LogEvent event)
+{
+    switch (event)
+    {
+    case LogEvent::ORDER_ALREADY_EXISTS:
+        return "order_already_exists";
+    case LogEvent::ORDER_DOES_NOT_EXIST:
+        return "order_does_not_exist";
+    case LogEvent::INVALID_DATA:
+        return "invalid_data";
+    case LogEvent::UNKNOWN_LISTING:
+        return "unknown_listing";
+    case LogEvent::NEW_ORDER_CREATED:
+        return "new_order_created";
+    case LogEvent::ORDER_DELETED:
+        return "order_deleted";
+    case LogEvent::ORDER_QUANTITY_MODIFIED:
+        return "order_quantity_modified";
+    case LogEvent::TRADE_EXECUTED:
+        return "trade_executed";
+    case LogEvent::NEW_ORDER_REJECTED:
+        return "new_order_rejected";
+    case LogEvent::MODIFY_ORDER_REJECTED:
+        return "modify_order_rejected";
+    case LogEvent::NEW_CONNECTION:
+        return "new_connection";
+    case LogEvent::DISCONNECTED:
+        return "disconnected";
+    case LogEvent::ORDER_POOL_GROWN:
+        return "order_pool_grown";
+    default:
+        return "records_dropped";
+    }
+}
+
+void Logger::record(LogQueue &queue, LogEvent event, uint64_t orderId, uint64_t listingId, int64_t quantity)
+{
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    queue.push({timestamp, orderId, listingId, quantity, event});
+}
+
+LogQueue *Logger::registerQueue()
+{
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    queues.emplace_back(new LogQueue());
+    return queues.back().get();
+}
+
+const char *Logger::text(LogEvent event)
+{
+    switch (event)
+    {
+    case LogEvent::ORDER_ALREADY_EXISTS:
+        return ERR_ORDER_ALREADY_EXISTS;
+    case LogEvent::ORDER_DOES_NOT_EXIST:
+        return ERR_ORDER_DOES_NOT_EXIST;
+    case LogEvent::INVALID_DATA:
+        return ERR_INVALID_DATA;
+    case LogEvent::UNKNOWN_LISTING:
+        return ERR_UNKNOWN_LISTING;
+    case LogEvent::NEW_ORDER_CREATED:
+        return SUCC_NEW_ORDER_CREATED;
+    case LogEvent::ORDER_DELETED:
+        return SUCC_ORDER_DELETED;
+    case LogEvent::ORDER_QUANTITY_MODIFIED:
+        return SUCC_ORDER_QUANTITY_MODIFIED;
+    case LogEvent::TRADE_EXECUTED:
+        return SUCC_TRADE_EXECUTED;
+    case LogEvent::NEW_ORDER_REJECTED:
+        return WARN_NEW_ORDER_REJECTED;
+    case LogEvent::MODIFY_ORDER_REJECTED:
+        return WARN_MODIFY_ORDER_REJECTED;
+    case LogEvent::NEW_CONNECTION:
+        return LOG_NEW_CONNECTION;
+    case LogEvent::DISCONNECTED:
+        return LOG_DISCONNECTED;
+    case LogEvent::ORDER_POOL_GROWN:
+        return LOG_ORDER_POOL_GROWN;
+    default:
+        return LOG_RECORDS_DROPPED;
+    }
+}
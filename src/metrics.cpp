@@ -0,0 +1,219 @@
+#include "../include/risk_server/metrics.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdio.h>
+
+#include "../include/risk_server/logger.hpp"
+
+thread_local ThreadMetrics *Metrics::localMetrics = NULL;
+
+/*
+* Index of the bucket holding a value.
+*
+* Parameters
+* ----------
+* nanos : uint64_t
+*     The latency in nanoseconds.
+*
+* Returns
+* -------
+* bucket : size_t
+*     Values below SUB_BUCKETS have a bucket each, larger values share a
+*     bucket with every value of the same top SUB_BUCKET_BITS + 1 bits.
+*/
+size_t LatencyHistogram::bucketFor(uint64_t nanos)
+{
+    if (nanos < SUB_BUCKETS)
+        return nanos;
+    uint32_t msb = 63 - __builtin_clzll(nanos);
+    if (msb >= MAX_MAGNITUDE)
+        return BUCKETS - 1;
+    uint32_t magnitude = msb - SUB_BUCKET_BITS + 1;
+    uint32_t subBucket = (nanos >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return magnitude * SUB_BUCKETS + subBucket;
+}
+
+/*
+* Highest value which falls in a bucket, reported for quantiles so they are
+* never understated.
+*/
+uint64_t LatencyHistogram::highestValueIn(size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    uint32_t shift = bucket / SUB_BUCKETS - 1;
+    uint64_t lowest = (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+/*
+* Value at a quantile of a histogram's bucket counts.
+*
+* Parameters
+* ----------
+* buckets : const uint64_t*
+*     BUCKETS counts, as recorded by bucketFor.
+* count : uint64_t
+*     Sum of the counts.
+* max : uint64_t
+*     Highest recorded value, caps the reported values.
+* quantile : double
+*     The quantile in [0, 1].
+*
+* Returns
+* -------
+* value : uint64_t
+*     Highest value of the smallest bucket covering the quantile's rank, 0 if
+*     nothing was recorded.
+*/
+uint64_t LatencyHistogram::valueAtQuantile(const uint64_t *buckets, uint64_t count, uint64_t max, double quantile)
+{
+    uint64_t rank = (uint64_t)(quantile * count + 0.5), seen = 0;
+    for (size_t i = 0; i < BUCKETS && count > 0; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank && seen > 0)
+            return std::min(highestValueIn(i), max);
+    }
+    return 0;
+}
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+/*
+* Count a received message by its type.
+*
+* Parameters
+* ----------
+* payload : char*
+*     The message payload.
+* payloadSize : uint16_t
+*     Size of the payload in bytes.
+*/
+void Metrics::countMessage(const char *payload, uint16_t payloadSize)
+{
+    MessageKind kind = MessageKind::INVALID;
+    uint16_t messageType = 0;
+    if (payloadSize >= sizeof(messageType))
+        std::memcpy(&messageType, payload, sizeof(messageType));
+
+    if (messageType == NewOrder::MESSAGE_TYPE && payloadSize == sizeof(NewOrder))
+        kind = MessageKind::NEW_ORDER;
+    else if (messageType == DeleteOrder::MESSAGE_TYPE && payloadSize == sizeof(DeleteOrder))
+        kind = MessageKind::DELETE_ORDER;
+    else if (messageType == ModifyOrderQuantity::MESSAGE_TYPE && payloadSize == sizeof(ModifyOrderQuantity))
+        kind = MessageKind::MODIFY_ORDER_QUANTITY;
+    else if (messageType == Trade::MESSAGE_TYPE && payloadSize == sizeof(Trade))
+        kind = MessageKind::TRADE;
+    else if (messageType == Batch::MESSAGE_TYPE && batchReplies(payload, payloadSize) >= 0)
+        kind = MessageKind::BATCH;
+    else if (messageType == Logon::MESSAGE_TYPE && payloadSize == sizeof(Logon))
+        kind = MessageKind::LOGON;
+    else if (messageType == SharedMemoryAttach::MESSAGE_TYPE && payloadSize == sizeof(SharedMemoryAttach))
+        kind = MessageKind::SHARED_MEMORY_ATTACH;
+
+    std::atomic<uint64_t> &counter = threadMetrics().messages[(size_t)kind];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void Metrics::countReply(OrderResponse::Status status)
+{
+    std::atomic<uint64_t> &counter = threadMetrics().replies[status == OrderResponse::Status::ACCEPTED ? 0 : 1];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/*
+* Render every counter and latency summary in the Prometheus text exposition
+* format, summed over all recording threads.
+*
+* Returns
+* -------
+* text : std::string
+*     The exposition text.
+*/
+std::string Metrics::prometheusText()
+{
+    static const char *MESSAGE_NAMES[] = {"new_order", "delete_order", "modify_order_quantity", "trade", "batch", "logon", "shared_memory_attach", "invalid"};
+    static const char *STAGE_NAMES[] = {"receive_to_decode", "risk_check", "reply_send"};
+    static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999, 0.9999};
+
+    uint64_t messages[(size_t)MessageKind::COUNT] = {};
+    uint64_t replies[2] = {};
+    std::vector<uint64_t> buckets((size_t)LatencyStage::COUNT * LatencyHistogram::BUCKETS);
+    uint64_t counts[(size_t)LatencyStage::COUNT] = {}, sums[(size_t)LatencyStage::COUNT] = {}, maxima[(size_t)LatencyStage::COUNT] = {};
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (auto &thread : threads)
+        {
+            for (size_t i = 0; i < (size_t)MessageKind::COUNT; i++)
+                messages[i] += thread->messages[i].load(std::memory_order_relaxed);
+            for (size_t i = 0; i < 2; i++)
+                replies[i] += thread->replies[i].load(std::memory_order_relaxed);
+            for (size_t stage = 0; stage < (size_t)LatencyStage::COUNT; stage++)
+            {
+                LatencyHistogram &histogram = thread->latencies[stage];
+                for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++)
+                    buckets[stage * LatencyHistogram::BUCKETS + i] += histogram.buckets[i].load(std::memory_order_relaxed);
+                counts[stage] += histogram.count.load(std::memory_order_relaxed);
+                sums[stage] += histogram.sum.load(std::memory_order_relaxed);
+                maxima[stage] = std::max(maxima[stage], histogram.max.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    std::string text;
+    char line[256];
+    text += "# HELP risk_messages_total Messages received by type.\n# TYPE risk_messages_total counter\n";
+    for (size_t i = 0; i < (size_t)MessageKind::COUNT; i++)
+    {
+        snprintf(line, sizeof(line), "risk_messages_total{type=\"%s\"} %llu\n", MESSAGE_NAMES[i], (unsigned long long)messages[i]);
+        text += line;
+    }
+
+    text += "# HELP risk_replies_total Order responses sent by status.\n# TYPE risk_replies_total counter\n";
+    snprintf(line, sizeof(line), "risk_replies_total{status=\"accepted\"} %llu\nrisk_replies_total{status=\"rejected\"} %llu\n", (unsigned long long)replies[0], (unsigned long long)replies[1]);
+    text += line;
+
+    text += "# HELP risk_events_total Outcomes logged by event, whatever the log level.\n# TYPE risk_events_total counter\n";
+    Logger &logger = Logger::instance();
+    for (size_t i = 0; i < (size_t)LogEvent::COUNT; i++)
+    {
+        LogEvent event = (LogEvent)i;
+        snprintf(line, sizeof(line), "risk_events_total{event=\"%s\",text=\"%s\"} %llu\n", Logger::name(event), Logger::text(event), (unsigned long long)logger.eventCount(event));
+        text += line;
+    }
+
+    text += "# HELP risk_latency_seconds Latency of each processing stage.\n# TYPE risk_latency_seconds summary\n";
+    for (size_t stage = 0; stage < (size_t)LatencyStage::COUNT; stage++)
+    {
+        const uint64_t *histogram = &buckets[stage * LatencyHistogram::BUCKETS];
+        for (double quantile : QUANTILES)
+        {
+            uint64_t value = LatencyHistogram::valueAtQuantile(histogram, counts[stage], maxima[stage], quantile);
+            snprintf(line, sizeof(line), "risk_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n", STAGE_NAMES[stage], quantile, value / 1e9);
+            text += line;
+        }
+        snprintf(line, sizeof(line), "risk_latency_seconds_sum{stage=\"%s\"} %.9f\nrisk_latency_seconds_count{stage=\"%s\"} %llu\n", STAGE_NAMES[stage], sums[stage] / 1e9, STAGE_NAMES[stage], (unsigned long long)counts[stage]);
+        text += line;
+    }
+
+    text += "# HELP risk_latency_max_seconds Highest latency of each processing stage.\n# TYPE risk_latency_max_seconds gauge\n";
+    for (size_t stage = 0; stage < (size_t)LatencyStage::COUNT; stage++)
+    {
+        snprintf(line, sizeof(line), "risk_latency_max_seconds{stage=\"%s\"} %.9f\n", STAGE_NAMES[stage], maxima[stage] / 1e9);
+        text += line;
+    }
+    return text;
+}
+
+ThreadMetrics *Metrics::registerThread()
+{
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    threads.emplace_back(new ThreadMetrics());
+    return threads.back().get();
+}
@@ -0,0 +1,157 @@
+#include "../include/risk_server/order_validation.hpp"
+
+#include <cstring>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ORDER_VALIDATION_X86 1
+#endif
+
+typedef void (*ValidateRecords)(const char *base, const uint32_t *offsets, size_t count, Validity *validity);
+
+static constexpr size_t QUANTITY_OFFSET = offsetof(NewOrder, orderQuantity);
+static constexpr size_t PRICE_OFFSET = offsetof(NewOrder, orderPrice);
+static constexpr size_t SIDE_OFFSET = offsetof(NewOrder, side);
+static_assert(SIDE_OFFSET + 1 == sizeof(NewOrder), "The side must end the NewOrder, vector loads end on it");
+
+static inline int64_t load(const char *record, size_t offset)
+{
+    int64_t value;
+    std::memcpy(&value, record + offset, sizeof(value));
+    return value;
+}
+
+static void validateScalar(const char *base, const uint32_t *offsets, size_t count, Validity *validity)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        NewOrder order;
+        std::memcpy(&order, base + offsets[i], sizeof(NewOrder));
+        validity[i] = OrderValidator::valid(order) ? Validity::VALID : Validity::INVALID;
+    }
+}
+
+#ifdef ORDER_VALIDATION_X86
+/*
+* Set the validity of the lanes of a vector of records from the masks of the
+* lanes which failed a check and of those whose price is 2^32 or more. Below
+* that, quantity x price of a valid quantity fits int64_t, above it the lane's
+* notional is checked on its own.
+*/
+static void setValidity(const char *base, const uint32_t *offsets, size_t lanes, int invalid, int widePrice, Validity *validity)
+{
+    for (size_t lane = 0; lane < lanes; lane++)
+    {
+        bool valid = !(invalid >> lane & 1);
+        if (valid && (widePrice >> lane & 1))
+        {
+            const char *record = base + offsets[lane];
+            valid = OrderValidator::validNotional(load(record, QUANTITY_OFFSET), load(record, PRICE_OFFSET));
+        }
+        validity[lane] = valid ? Validity::VALID : Validity::INVALID;
+    }
+}
+
+/*
+* Two records per 128-bit vector. The last 8 bytes of a record are loaded for
+* the side (its top byte), so no load reads past a record.
+*/
+__attribute__((target("sse4.1"))) static void validateSse41(const char *base, const uint32_t *offsets, size_t count, Validity *validity)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_cmpeq_epi64(zero, zero);
+    const __m128i buy = _mm_set1_epi64x('B'), sell = _mm_set1_epi64x('S');
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const char *first = base + offsets[i], *second = base + offsets[i + 1];
+        __m128i quantity = _mm_set_epi64x(load(second, QUANTITY_OFFSET), load(first, QUANTITY_OFFSET));
+        __m128i price = _mm_set_epi64x(load(second, PRICE_OFFSET), load(first, PRICE_OFFSET));
+        __m128i side = _mm_srli_epi64(_mm_set_epi64x(load(second, SIDE_OFFSET - 7), load(first, SIDE_OFFSET - 7)), 56);
+
+        __m128i invalid = _mm_or_si128(_mm_cmpeq_epi64(quantity, zero), _mm_cmpeq_epi64(price, zero));
+        invalid = _mm_or_si128(invalid, _mm_xor_si128(_mm_cmpeq_epi64(_mm_srli_epi64(quantity, 31), zero), ones));
+        invalid = _mm_or_si128(invalid, _mm_xor_si128(_mm_or_si128(_mm_cmpeq_epi64(side, buy), _mm_cmpeq_epi64(side, sell)), ones));
+        __m128i narrowPrice = _mm_cmpeq_epi64(_mm_srli_epi64(price, 32), zero);
+        setValidity(base, offsets + i, 2, _mm_movemask_pd(_mm_castsi128_pd(invalid)), ~_mm_movemask_pd(_mm_castsi128_pd(narrowPrice)), validity + i);
+    }
+    validateScalar(base, offsets + i, count - i, validity + i);
+}
+
+/*
+* Four records per 256-bit vector, gathered by their offsets.
+*/
+__attribute__((target("avx2"))) static void validateAvx2(const char *base, const uint32_t *offsets, size_t count, Validity *validity)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_cmpeq_epi64(zero, zero);
+    const __m256i buy = _mm256_set1_epi64x('B'), sell = _mm256_set1_epi64x('S');
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i *>(offsets + i));
+        __m256i quantity = _mm256_i32gather_epi64(reinterpret_cast<const long long *>(base + QUANTITY_OFFSET), index, 1);
+        __m256i price = _mm256_i32gather_epi64(reinterpret_cast<const long long *>(base + PRICE_OFFSET), index, 1);
+        __m256i side = _mm256_srli_epi64(_mm256_i32gather_epi64(reinterpret_cast<const long long *>(base + SIDE_OFFSET - 7), index, 1), 56);
+
+        __m256i invalid = _mm256_or_si256(_mm256_cmpeq_epi64(quantity, zero), _mm256_cmpeq_epi64(price, zero));
+        invalid = _mm256_or_si256(invalid, _mm256_xor_si256(_mm256_cmpeq_epi64(_mm256_srli_epi64(quantity, 31), zero), ones));
+        invalid = _mm256_or_si256(invalid, _mm256_xor_si256(_mm256_or_si256(_mm256_cmpeq_epi64(side, buy), _mm256_cmpeq_epi64(side, sell)), ones));
+        __m256i narrowPrice = _mm256_cmpeq_epi64(_mm256_srli_epi64(price, 32), zero);
+        setValidity(base, offsets + i, 4, _mm256_movemask_pd(_mm256_castsi256_pd(invalid)), ~_mm256_movemask_pd(_mm256_castsi256_pd(narrowPrice)),
+                    validity + i);
+    }
+    validateScalar(base, offsets + i, count - i, validity + i);
+}
+#endif
+
+static ValidateRecords chooseValidate(const char *&name)
+{
+#ifdef ORDER_VALIDATION_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        name = "avx2";
+        return validateAvx2;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        name = "sse4.1";
+        return validateSse41;
+    }
+#endif
+    name = "scalar";
+    return validateScalar;
+}
+
+static const char *validateName = NULL;
+static const ValidateRecords validateRecords = chooseValidate(validateName);
+
+/*
+* Name of the instruction set the records are validated with.
+*/
+const char *OrderValidator::instructionSet()
+{
+    return validateName;
+}
+
+/*
+* Validate NewOrder records, the vector lanes at once.
+*
+* Parameters
+* ----------
+* base : const char*
+*     Start of the buffer holding the records.
+* offsets : const uint32_t*
+*     Offset of each record from base, each followed by sizeof(NewOrder)
+*     readable bytes.
+* count : size_t
+*     Number of records.
+* validity : Validity*
+*     Set to VALID or INVALID for each record.
+*/
+void OrderValidator::validate(const char *base, const uint32_t *offsets, size_t count, Validity *validity)
+{
+    validateRecords(base, offsets, count, validity);
+}
@@ -1,128 +1,462 @@
 #include "../include/risk_server/position_data.hpp"
 
+#include <fstream>
+#include <sstream>
+
 /*
-* Adds order to the position if risk within threshold.
+* Adds order to the position if risk within every limit.
 *
 * Parameters
 * ----------
-* order : std::shared_ptr<Order>
-*     Pointer to the order to add to the position.
-* BUY_THRESHOLD : uint64_t
-*     The buy threshold.
-* SELL_THRESHOLD
-*     The sell threshold.
+* order : Order
+*     Reference to the order to add to the position, order.instrumentIndex
+*     and order.accountPosition must be registered.
+* checked : bool
+*     false to add the order whatever the headroom, for orders accepted
+*     before (recovery).
 *
 * Returns
 * -------
 * accepted : bool
-*     true if newly calculated hypothetical buy or sell risk was within 
-*     threshold, false otherwise.
+*     true if the hypothetical buy or sell risk stays within the limits of
+*     the instrument, the account and the account in the instrument, false
+*     otherwise.
+*/
+bool PositionTable::addPosition(Order &order, bool checked)
+{
+    return changePosition(order, order.qty, checked);
+}
+
+/*
+* Change the open quantity of the order's side by delta, and its notional by
+* delta x price, at every level if both fit the headroom of each. The account
+* and portfolio headroom is shared with the other shards, it is reserved last
+* once the levels owned here passed.
 */
-bool PositionData::addPosition(std::shared_ptr<Order> order, uint64_t BUY_THRESHOLD, uint64_t SELL_THRESHOLD)
+bool PositionTable::changePosition(Order &order, int64_t delta, bool checked)
 {
-    if (order->side == 'B')
+    bool buy = order.side == 'B';
+    uint32_t instrument = order.instrumentIndex;
+    AccountPosition &position = accountPositions[order.accountPosition];
+    // Fits: the notional of the order before and after is checked to fit.
+    int64_t notional = delta * (int64_t)order.price;
+    if (checked)
     {
-        buyQty += order->qty;
-        if (calcHypotheticalBuy() > BUY_THRESHOLD)
-        {
-            buyQty -= order->qty;
+        if (((delta > (buy ? buyHeadroom : sellHeadroom)[instrument]) | (delta > (buy ? position.buyHeadroom : position.sellHeadroom)) |
+             (notional > (buy ? buyNotionalHeadroom : sellNotionalHeadroom)[instrument]) |
+             (notional > (buy ? position.buyNotionalHeadroom : position.sellNotionalHeadroom))) ||
+            !order.account->reserve(buy, delta, notional))
             return false;
-        }
-    }
-    else
-    {
-        sellQty += order->qty;
-        if (calcHypotheticalSell() > SELL_THRESHOLD)
+        if (!portfolio.headroom.reserve(buy, delta, notional))
         {
-            sellQty -= order->qty;
+            order.account->consume(buy, -delta);
+            order.account->consumeNotional(buy, -notional);
             return false;
         }
     }
+    moveOpen(position, buy, delta, notional, checked);
     return true;
 }
 
-uint64_t PositionData::calcHypotheticalBuy() const
+
+/*
+* Look up the dense index of a listing.
+*
+* Parameters
+* ----------
+* listingId : uint64_t
+*     The listing id.
+*
+* Returns
+* -------
+* instrument : uint32_t
+*     The dense index, INVALID_INSTRUMENT if the listing is not registered.
+*/
+uint32_t PositionTable::findInstrument(uint64_t listingId)
 {
-    return std::max(buyQty, netPos + buyQty);
+    uint32_t *instrument = listingId2Instrument.find(listingId);
+    return instrument == NULL ? INVALID_INSTRUMENT : *instrument;
 }
 
-uint64_t PositionData::calcHypotheticalSell() const
+/*
+* Look up the position of an account in an instrument, registering it with
+* the headroom of its account x instrument limit on first use.
+*
+* Parameters
+* ----------
+* account : Account*
+*     The account.
+* instrument : uint32_t
+*     Dense index of a registered instrument.
+*
+* Returns
+* -------
+* accountPosition : uint32_t
+*     Index of the account position, stable for the table's lifetime.
+*/
+uint32_t PositionTable::findOrRegisterAccountPosition(Account *account, uint32_t instrument)
 {
-    return std::max(sellQty, sellQty - netPos);
+    uint64_t key = (uint64_t)account->index << 32 | instrument;
+    uint32_t *accountPosition = accountPositionIndex.find(key);
+    if (accountPosition != NULL)
+        return *accountPosition;
+
+    Limit limit = limits->forAccountInstrument(account->id, listingIds[instrument]);
+    AccountPosition position;
+    position.account = account;
+    position.instrument = instrument;
+    position.buyHeadroom = limit.buy;
+    position.sellHeadroom = limit.sell;
+    position.buyNotionalHeadroom = limit.buyNotional;
+    position.sellNotionalHeadroom = limit.sellNotional;
+    accountPositions.push_back(position);
+    accountPositionIndex.insert(key, accountPositions.size() - 1);
+    return accountPositions.size() - 1;
 }
 
 /*
-* Modifies order quantity if risk within threshold.
+* Look up the dense index of a listing, registering it if the universe is
+* not fixed.
 *
 * Parameters
 * ----------
-* order : std::shared_ptr<Order>
-*     Pointer to the order to modify the position.
-* BUY_THRESHOLD : uint64_t
-*     The buy threshold.
-* SELL_THRESHOLD
-*     The sell threshold.
+* listingId : uint64_t
+*     The listing id.
 *
 * Returns
 * -------
-* accepted : bool
-*     true if newly calculated hypothetical buy or sell risk was within 
-*     threshold, false otherwise.
+* instrument : uint32_t
+*     The dense index, INVALID_INSTRUMENT if the listing is not part of a
+*     fixed universe.
+*/
+uint32_t PositionTable::findOrRegisterInstrument(uint64_t listingId)
+{
+    uint32_t instrument = findInstrument(listingId);
+    if (instrument == INVALID_INSTRUMENT && !fixedUniverse)
+        instrument = registerInstrument(listingId);
+    return instrument;
+}
+
+/*
+* Load the listing universe, one listing id per line ('#' starts a comment).
+* Only the loaded listings are accepted afterwards.
+*
+* Parameters
+* ----------
+* path : std::string
+*     Path of the universe file.
+*
+* Returns
+* -------
+* loaded : bool
+*     true if the file was read, false otherwise.
 */
-uint64_t PositionData::modifyPosition(std::shared_ptr<Order> order, uint64_t newQty, uint64_t BUY_THRESHOLD, uint64_t SELL_THRESHOLD)
+bool PositionTable::loadUniverse(const std::string &path)
 {
-    int delta = newQty - order->qty;
-    if (order->side == 'B')
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::vector<uint64_t> universe;
+    std::string line;
+    while (std::getline(file, line))
     {
-        buyQty += delta;
-        if (calcHypotheticalBuy() > BUY_THRESHOLD)
-        {
-            buyQty -= delta;
-            return false;
-        }
+        std::istringstream stream(line.substr(0, line.find('#')));
+        uint64_t listingId;
+        if (stream >> listingId)
+            universe.push_back(listingId);
     }
-    else
+
+    listingId2Instrument.reserve(universe.size());
+    listingIds.reserve(universe.size());
+    buyQty.reserve(universe.size());
+    sellQty.reserve(universe.size());
+    netPos.reserve(universe.size());
+    buyHeadroom.reserve(universe.size());
+    sellHeadroom.reserve(universe.size());
+    buyNotional.reserve(universe.size());
+    sellNotional.reserve(universe.size());
+    netNotional.reserve(universe.size());
+    buyNotionalHeadroom.reserve(universe.size());
+    sellNotionalHeadroom.reserve(universe.size());
+    for (uint64_t listingId : universe)
     {
-        sellQty += delta;
-        if (calcHypotheticalSell() > SELL_THRESHOLD)
-        {
-            sellQty -= delta;
-            return false;
-        }
+        if (findInstrument(listingId) == INVALID_INSTRUMENT)
+            registerInstrument(listingId);
     }
-    order->qty = newQty;
+    fixedUniverse = true;
     return true;
 }
 
 /*
-* Rollsback order and removes order from the position data.
+* Modifies order quantity if risk within every limit.
 *
 * Parameters
 * ----------
-* order : std::shared_ptr<Order>
-*     Pointer to the order to remove to the position.
+* order : Order
+*     Reference to the order to modify the position.
+* newQty : uint64_t
+*     The order's new quantity.
+* checked : bool
+*     false to modify the order whatever the headroom, for modifies accepted
+*     before (recovery).
+*
+* Returns
+* -------
+* accepted : bool
+*     true if the hypothetical buy or sell risk stays within the limits of
+*     the instrument, the account and the account in the instrument, false
+*     otherwise.
 */
-void PositionData::rollbackPosition(std::shared_ptr<Order> order)
+bool PositionTable::modifyPosition(Order &order, uint64_t newQty, bool checked)
 {
-    if (order->side == 'B')
-    {
-        buyQty -= order->qty;
-    }
-    else
+    if (!changePosition(order, (int64_t)newQty - (int64_t)order.qty, checked))
+        return false;
+    order.qty = newQty;
+    return true;
+}
+
+/*
+* Change the open quantity of one side of an account position by delta and
+* its notional by notional, at every level.
+*
+* Parameters
+* ----------
+* position : AccountPosition
+*     Reference to the account position.
+* buy : bool
+*     true for the buy side, false for the sell side.
+* delta : int64_t
+*     The quantity change.
+* notional : Notional
+*     The notional change.
+* reserved : bool
+*     true if the account and portfolio headroom was reserved already.
+*/
+void PositionTable::moveOpen(AccountPosition &position, bool buy, int64_t delta, Notional notional, bool reserved)
+{
+    uint32_t instrument = position.instrument;
+    if (!reserved)
     {
-        sellQty -= order->qty;
+        position.account->consume(buy, delta);
+        position.account->consumeNotional(buy, notional);
+        portfolio.headroom.consume(buy, delta);
+        portfolio.headroom.consumeNotional(buy, notional);
     }
+    (buy ? buyHeadroom : sellHeadroom)[instrument] -= delta;
+    (buy ? position.buyHeadroom : position.sellHeadroom) -= delta;
+    (buy ? buyNotionalHeadroom : sellNotionalHeadroom)[instrument] -= notional;
+    (buy ? position.buyNotionalHeadroom : position.sellNotionalHeadroom) -= notional;
+    (buy ? buyQty : sellQty)[instrument] += delta;
+    (buy ? position.exposure.buyQty : position.exposure.sellQty) += delta;
+    (buy ? buyNotional : sellNotional)[instrument] += notional;
+    (buy ? position.exposure.buyNotional : position.exposure.sellNotional) += notional;
+    portfolio.open(buy, delta, notional);
+}
+
+uint32_t PositionTable::registerInstrument(uint64_t listingId)
+{
+    uint32_t instrument = listingIds.size();
+    listingId2Instrument.insert(listingId, instrument);
+    listingIds.push_back(listingId);
+    buyQty.push_back(0);
+    sellQty.push_back(0);
+    netPos.push_back(0);
+    Limit limit = limits->forInstrument(listingId);
+    buyHeadroom.push_back(limit.buy);
+    sellHeadroom.push_back(limit.sell);
+    buyNotional.push_back(0);
+    sellNotional.push_back(0);
+    netNotional.push_back(0);
+    buyNotionalHeadroom.push_back(limit.buyNotional);
+    sellNotionalHeadroom.push_back(limit.sellNotional);
+    return instrument;
+}
+
+/*
+* Recompute the headroom of an account position from its exposure.
+*/
+void PositionTable::resetHeadroom(AccountPosition &position)
+{
+    Limit limit = limits->forAccountInstrument(position.account->id, listingIds[position.instrument]);
+    const Exposure &exposure = position.exposure;
+    position.buyHeadroom = limit.buy - (int64_t)(exposure.buyQty + std::max<int64_t>(exposure.netPos, 0));
+    position.sellHeadroom = limit.sell - (int64_t)(exposure.sellQty + std::max<int64_t>(-exposure.netPos, 0));
+    position.buyNotionalHeadroom = limit.buyNotional - (exposure.buyNotional + std::max<Notional>(exposure.netNotional, 0));
+    position.sellNotionalHeadroom = limit.sellNotional - (exposure.sellNotional + std::max<Notional>(-exposure.netNotional, 0));
+}
+
+/*
+* Recompute the headroom of an instrument from its exposure.
+*/
+void PositionTable::resetHeadroom(uint32_t instrument)
+{
+    Limit limit = limits->forInstrument(listingIds[instrument]);
+    buyHeadroom[instrument] = limit.buy - (int64_t)(buyQty[instrument] + std::max<int64_t>(netPos[instrument], 0));
+    sellHeadroom[instrument] = limit.sell - (int64_t)(sellQty[instrument] + std::max<int64_t>(-netPos[instrument], 0));
+    buyNotionalHeadroom[instrument] = limit.buyNotional - (buyNotional[instrument] + std::max<Notional>(netNotional[instrument], 0));
+    sellNotionalHeadroom[instrument] = limit.sellNotional - (sellNotional[instrument] + std::max<Notional>(-netNotional[instrument], 0));
+}
+
+/*
+* Set the exposure of an account position from a snapshot, taking it from
+* the account x instrument and the account headroom.
+*/
+void PositionTable::restoreAccountPosition(uint32_t accountPosition, const Exposure &exposure)
+{
+    AccountPosition &position = accountPositions[accountPosition];
+    position.exposure = exposure;
+    resetHeadroom(position);
+    position.account->consume(true, exposure.buyQty + std::max<int64_t>(exposure.netPos, 0));
+    position.account->consume(false, exposure.sellQty + std::max<int64_t>(-exposure.netPos, 0));
+    position.account->consumeNotional(true, exposure.buyNotional + std::max<Notional>(exposure.netNotional, 0));
+    position.account->consumeNotional(false, exposure.sellNotional + std::max<Notional>(-exposure.netNotional, 0));
 }
 
 /*
-* Performs trade and updates netPos.
+* Set the exposure of an instrument from a snapshot, adding it to the
+* portfolio.
+*/
+void PositionTable::restorePosition(uint32_t instrument, const Exposure &exposure)
+{
+    buyQty[instrument] = exposure.buyQty;
+    sellQty[instrument] = exposure.sellQty;
+    netPos[instrument] = exposure.netPos;
+    buyNotional[instrument] = exposure.buyNotional;
+    sellNotional[instrument] = exposure.sellNotional;
+    netNotional[instrument] = exposure.netNotional;
+    resetHeadroom(instrument);
+    portfolio.open(true, exposure.buyQty, exposure.buyNotional);
+    portfolio.open(false, exposure.sellQty, exposure.sellNotional);
+    portfolio.trade(exposure.netPos, exposure.netNotional);
+    portfolio.headroom.consume(true, exposure.buyQty + std::max<int64_t>(exposure.netPos, 0));
+    portfolio.headroom.consume(false, exposure.sellQty + std::max<int64_t>(-exposure.netPos, 0));
+    portfolio.headroom.consumeNotional(true, exposure.buyNotional + std::max<Notional>(exposure.netNotional, 0));
+    portfolio.headroom.consumeNotional(false, exposure.sellNotional + std::max<Notional>(-exposure.netNotional, 0));
+}
+
+/*
+* Rollsback order and removes order from the position data.
 *
 * Parameters
 * ----------
+* order : Order
+*     Reference to the order to remove to the position.
+*/
+void PositionTable::rollbackPosition(Order &order)
+{
+    changePosition(order, -(int64_t)order.qty, false);
+}
+
+/*
+* Roll back orders of one side of an account position at once, on
+* disconnect.
+*
+* Parameters
+* ----------
+* accountPosition : uint32_t
+*     Index of the orders' account position.
+* buy : bool
+*     true for buy orders, false for sell orders.
+* qty : int64_t
+*     The sum of the orders' quantities.
+* notional : Notional
+*     The sum of the orders' notionals.
+*/
+void PositionTable::rollbackPositions(uint32_t accountPosition, bool buy, int64_t qty, Notional notional)
+{
+    moveOpen(accountPositions[accountPosition], buy, -qty, -notional, false);
+}
+
+/*
+* Move to new limits, recomputing the headroom of every instrument and
+* account position from its exposure.
+*
+* Parameters
+* ----------
+* newLimits : RiskLimits*
+*     The new limits, held until the next call.
+*/
+void PositionTable::setLimits(const RiskLimits *newLimits)
+{
+    limits = newLimits;
+    for (uint32_t instrument = 0; instrument < listingIds.size(); instrument++)
+        resetHeadroom(instrument);
+    for (AccountPosition &position : accountPositions)
+        resetHeadroom(position);
+}
+
+/*
+* Net notional after a trade, valued at average cost: a trade from flat or
+* adding to the position adds its notional, one reducing it keeps the
+* average cost of what is left, and one flipping it values what is left at
+* the trade price.
+*/
+static Notional tradedNotional(int64_t net, Notional notional, int64_t tradeQty, uint64_t tradePrice)
+{
+    int64_t newNet = net + tradeQty;
+    if (net == 0 || (net < 0) == (tradeQty < 0))
+        return notional + (Notional)tradeQty * tradePrice;
+    if (newNet == 0)
+        return 0;
+    if ((newNet < 0) != (net < 0))
+        return (Notional)newNet * tradePrice;
+    return notional * newNet / net;
+}
+
+/*
+* Performs trade and updates the net position and notional of the instrument,
+* the account position and the portfolio, moving the change in long (short)
+* exposure out of the buy (sell) headroom of every level.
+*
+* Parameters
+* ----------
+* instrument : uint32_t
+*     Dense index of the traded instrument.
+* accountPosition : uint32_t
+*     Index of the traded account's position in the instrument.
 * tradeQty : int64_t
 *     The quantity of the position to trade. (+ve for long, -ve for short)
+* tradePrice : uint64_t
+*     The trade price, |tradeQty| x tradePrice is checked to fit int64_t.
 */
-void PositionData::trade(int64_t tradeQty)
+void PositionTable::trade(uint32_t instrument, uint32_t accountPosition, int64_t tradeQty, uint64_t tradePrice)
 {
-    netPos += tradeQty;
-}
\ No newline at end of file
+    // The portfolio's long (short) position is that of each instrument.
+    int64_t net = netPos[instrument];
+    Notional notional = netNotional[instrument];
+    netPos[instrument] += tradeQty;
+    netNotional[instrument] = tradedNotional(net, notional, tradeQty, tradePrice);
+    int64_t longChange = std::max<int64_t>(net + tradeQty, 0) - std::max<int64_t>(net, 0);
+    int64_t shortChange = std::max<int64_t>(-net - tradeQty, 0) - std::max<int64_t>(-net, 0);
+    Notional longNotionalChange = std::max<Notional>(netNotional[instrument], 0) - std::max<Notional>(notional, 0);
+    Notional shortNotionalChange = std::max<Notional>(-netNotional[instrument], 0) - std::max<Notional>(-notional, 0);
+    buyHeadroom[instrument] -= longChange;
+    sellHeadroom[instrument] -= shortChange;
+    buyNotionalHeadroom[instrument] -= longNotionalChange;
+    sellNotionalHeadroom[instrument] -= shortNotionalChange;
+    portfolio.headroom.consume(true, longChange);
+    portfolio.headroom.consume(false, shortChange);
+    portfolio.headroom.consumeNotional(true, longNotionalChange);
+    portfolio.headroom.consumeNotional(false, shortNotionalChange);
+    portfolio.trade(tradeQty, netNotional[instrument] - notional);
+
+    AccountPosition &position = accountPositions[accountPosition];
+    Exposure &exposure = position.exposure;
+    net = exposure.netPos;
+    notional = exposure.netNotional;
+    exposure.netPos += tradeQty;
+    exposure.netNotional = tradedNotional(net, notional, tradeQty, tradePrice);
+    longChange = std::max<int64_t>(net + tradeQty, 0) - std::max<int64_t>(net, 0);
+    shortChange = std::max<int64_t>(-net - tradeQty, 0) - std::max<int64_t>(-net, 0);
+    longNotionalChange = std::max<Notional>(exposure.netNotional, 0) - std::max<Notional>(notional, 0);
+    shortNotionalChange = std::max<Notional>(-exposure.netNotional, 0) - std::max<Notional>(-notional, 0);
+    position.buyHeadroom -= longChange;
+    position.sellHeadroom -= shortChange;
+    position.buyNotionalHeadroom -= longNotionalChange;
+    position.sellNotionalHeadroom -= shortNotionalChange;
+    position.account->consume(true, longChange);
+    position.account->consume(false, shortChange);
+    position.account->consumeNotional(true, longNotionalChange);
+    position.account->consumeNotional(false, shortNotionalChange);
+}
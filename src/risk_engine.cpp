@@ -0,0 +1,709 @@
+#include "../include/risk_server/risk_engine.hpp"
+
+const std::array<RiskEngine::Handler, EngineMessages::TYPES> RiskEngine::HANDLERS = [] {
+    std::array<Handler, EngineMessages::TYPES> handlers{};
+    handlers[NewOrder::MESSAGE_TYPE] = &RiskEngine::dispatch<NewOrder, &RiskEngine::createNewOrder>;
+    handlers[DeleteOrder::MESSAGE_TYPE] = &RiskEngine::dispatch<DeleteOrder, &RiskEngine::deleteExistingOrder>;
+    handlers[ModifyOrderQuantity::MESSAGE_TYPE] = &RiskEngine::dispatch<ModifyOrderQuantity, &RiskEngine::modifyExistingOrder>;
+    handlers[Trade::MESSAGE_TYPE] = &RiskEngine::dispatch<Trade, &RiskEngine::executeTrade>;
+    return handlers;
+}();
+
+/*
+* Move every position to the current limits table, then announce that older
+* tables are no longer used by this engine.
+*/
+void RiskEngine::adoptLimits()
+{
+    const RiskLimits *table = limits.current();
+    positions.setLimits(table);
+    limitsVersion = table->getVersion();
+    limits.announce(reader, limitsVersion);
+}
+
+/*
+* Copy an accepted order into the order pool, LOG the pool occupancy if a new
+* slab had to be allocated.
+*
+* Parameters
+* ----------
+* order : Order
+*     Reference to the order to store.
+*
+* Returns
+* -------
+* handle : uint32_t
+*     The stable handle of the stored order.
+*/
+uint32_t RiskEngine::allocateOrder(const Order &order)
+{
+    size_t capacity = orders.getStats().capacity;
+    uint32_t handle = orders.allocate();
+    orders[handle] = order;
+
+    const PoolStats &stats = orders.getStats();
+    if (stats.capacity != capacity)
+        logger.log(LogEvent::ORDER_POOL_GROWN, stats.live, stats.capacity);
+    return handle;
+}
+
+/*
+* Append an accepted transition of an order to the journal, if any.
+*
+* Parameters
+* ----------
+* type : JournalRecord::Type
+*     NEW_ORDER, DELETE_ORDER or MODIFY_ORDER.
+* order : Order
+*     Reference to the order, after the transition.
+*/
+void RiskEngine::appendToJournal(JournalRecord::Type type, const Order &order)
+{
+    if (journal == NULL)
+        return;
+    JournalRecord record;
+    record.type = type;
+    record.side = order.side;
+    record.orderId = order.orderId;
+    record.listingId = order.financialInstrumentId;
+    record.quantity = order.qty;
+    record.price = order.price;
+    record.account = order.account->id;
+    journal->append(record);
+}
+
+/*
+* Apply a replayed journal record. The transition was accepted before, so it
+* is applied without the limit checks; recovered orders belong to no session
+* and are not rolled back on any disconnect.
+*
+* Parameters
+* ----------
+* record : JournalRecord
+*     Reference to the replayed record.
+* shard : uint32_t
+*     The engine's shard, recovered orders claim their id for it.
+*/
+void RiskEngine::applyRecord(const JournalRecord &record, uint32_t shard)
+{
+    uint32_t *orderHandle = orderId2Order.find(record.orderId);
+    switch (record.type)
+    {
+    case JournalRecord::Type::NEW_ORDER:
+    {
+        Order order(record.orderId, record.listingId, record.quantity, record.price, record.side);
+        order.instrumentIndex = positions.findOrRegisterInstrument(record.listingId);
+        if (orderHandle != NULL || order.instrumentIndex == PositionTable::INVALID_INSTRUMENT)
+        {
+            logger.log(LogEvent::INVALID_DATA, record.orderId, record.listingId, record.quantity);
+            break;
+        }
+        if (directory != NULL)
+            order.claim = directory->claim(order.orderId, shard);
+        order.account = accounts.findOrRegister(record.account);
+        order.accountPosition = positions.findOrRegisterAccountPosition(order.account, order.instrumentIndex);
+        positions.addPosition(order, false);
+        orderId2Order.insert(order.orderId, allocateOrder(order));
+        break;
+    }
+    case JournalRecord::Type::DELETE_ORDER:
+    {
+        if (orderHandle == NULL)
+            break;
+        Order &order = orders[*orderHandle];
+        positions.rollbackPosition(order);
+        releaseClaim(order.orderId, order.claim);
+        orders.release(*orderHandle);
+        orderId2Order.erase(record.orderId);
+        break;
+    }
+    case JournalRecord::Type::MODIFY_ORDER:
+    {
+        if (orderHandle != NULL)
+            positions.modifyPosition(orders[*orderHandle], record.quantity, false);
+        break;
+    }
+    case JournalRecord::Type::TRADE:
+    {
+        uint32_t instrument = positions.findInstrument(record.listingId);
+        if (instrument != PositionTable::INVALID_INSTRUMENT)
+            positions.trade(instrument, positions.findOrRegisterAccountPosition(accounts.findOrRegister(record.account), instrument), record.quantity,
+                            record.price);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/*
+* Create a new order and update the user's position data.
+*
+* Respond with updated OrderResponse with OrderResponse::Status::ACCEPTED or 
+* OrderResponse::Status::REJECTED.
+*
+* Parameters
+* ----------
+* newOrder : NewOrder
+*     View of the message in the receive buffer.
+* context : MessageContext
+*     The session, account and order response of the message, the
+*     OrderDirectory claim on the order id, released if the order is
+*     rejected, and the order's validity if already checked.
+*/
+void RiskEngine::createNewOrder(const NewOrder &newOrder, MessageContext &context)
+{
+    OrderResponse &orderResponse = context.orderResponse;
+    orderResponse.orderId = newOrder.orderId;
+
+    bool valid = context.validity == Validity::UNCHECKED ? OrderValidator::valid(newOrder) : context.validity == Validity::VALID;
+    if (!valid)
+    {
+        orderResponse.status = OrderResponse::Status::REJECTED;
+        logger.log(LogEvent::INVALID_DATA, newOrder.orderId, newOrder.listingId, newOrder.orderQuantity);
+        releaseClaim(newOrder.orderId, context.claim);
+    }
+    else if (orderId2Order.contains(newOrder.orderId))
+    {
+        orderResponse.status = OrderResponse::Status::REJECTED;
+        logger.log(LogEvent::ORDER_ALREADY_EXISTS, newOrder.orderId, newOrder.listingId, newOrder.orderQuantity);
+        releaseClaim(newOrder.orderId, context.claim);
+    }
+    else
+    {
+        Order order(newOrder.orderId, newOrder.listingId, newOrder.orderQuantity, newOrder.orderPrice, newOrder.side);
+        order.claim = context.claim;
+        order.instrumentIndex = positions.findOrRegisterInstrument(newOrder.listingId);
+        if (order.instrumentIndex == PositionTable::INVALID_INSTRUMENT)
+        {
+            orderResponse.status = OrderResponse::Status::REJECTED;
+            logger.log(LogEvent::UNKNOWN_LISTING, newOrder.orderId, newOrder.listingId, newOrder.orderQuantity);
+            releaseClaim(newOrder.orderId, context.claim);
+            return;
+        }
+
+        order.account = context.account;
+        order.accountPosition = positions.findOrRegisterAccountPosition(context.account, order.instrumentIndex);
+        bool added = positions.addPosition(order);
+        if (added)
+        {
+            uint32_t handle = allocateOrder(order);
+            orderId2Order.insert(order.orderId, handle);
+            linkOrder(context.session, handle);
+            appendToJournal(JournalRecord::Type::NEW_ORDER, order);
+            orderResponse.status = OrderResponse::Status::ACCEPTED;
+            logger.log(LogEvent::NEW_ORDER_CREATED, order.orderId, order.financialInstrumentId, order.qty);
+        }
+        else
+        {
+            orderResponse.status = OrderResponse::Status::REJECTED;
+            logger.log(LogEvent::NEW_ORDER_REJECTED, order.orderId, order.financialInstrumentId, order.qty);
+            releaseClaim(order.orderId, context.claim);
+        }
+    }
+}
+
+/*
+* Delete an order and update the user's position data.
+*
+* Parameters
+* ----------
+* deleteOrder : DeleteOrder
+*     View of the message in the receive buffer.
+* context : MessageContext
+*     The session and account of the message. Not read, an order is
+*     deleted by its id alone.
+*/
+void RiskEngine::deleteExistingOrder(const DeleteOrder &deleteOrder, [[maybe_unused]] MessageContext &context)
+{
+    uint32_t *orderHandle = orderId2Order.find(deleteOrder.orderId);
+    if (orderHandle == NULL)
+    {
+        logger.log(LogEvent::ORDER_DOES_NOT_EXIST, deleteOrder.orderId);
+    }
+    else
+    {
+        Order &order = orders[*orderHandle];
+        positions.rollbackPosition(order);
+        appendToJournal(JournalRecord::Type::DELETE_ORDER, order);
+        logger.log(LogEvent::ORDER_DELETED, order.orderId, order.financialInstrumentId, order.qty);
+        unlinkOrder(*orderHandle);
+        orders.release(*orderHandle);
+        orderId2Order.erase(deleteOrder.orderId);
+    }
+}
+
+/*
+* Execute a trade.
+*
+* Parameters
+* ----------
+* trade : Trade
+*     View of the message in the receive buffer.
+* context : MessageContext
+*     The session and account of the message. Not read, the trade is
+*     booked to the traded order's account.
+*/
+void RiskEngine::executeTrade(const Trade &trade, [[maybe_unused]] MessageContext &context)
+{
+    if (trade.tradePrice <= 0 || trade.tradeQuantity == 0 || std::abs(trade.tradeQuantity) > (int64_t)OrderValidator::MAX_QUANTITY ||
+        !OrderValidator::validNotional(std::abs(trade.tradeQuantity), trade.tradePrice))
+    {
+        logger.log(LogEvent::INVALID_DATA, trade.tradeId, trade.listingId, trade.tradeQuantity);
+        return;
+    }
+
+    uint32_t instrument = positions.findInstrument(trade.listingId);
+    uint32_t *orderHandle = orderId2Order.find(trade.tradeId);
+    if (orderHandle == NULL)
+    {
+        logger.log(LogEvent::ORDER_DOES_NOT_EXIST, trade.tradeId, trade.listingId, trade.tradeQuantity);
+    }
+    else if (instrument == PositionTable::INVALID_INSTRUMENT)
+    {
+        logger.log(LogEvent::UNKNOWN_LISTING, trade.tradeId, trade.listingId, trade.tradeQuantity);
+    }
+    else
+    {
+        // The position is the traded order's account's.
+        Account *account = orders[*orderHandle].account;
+        positions.trade(instrument, positions.findOrRegisterAccountPosition(account, instrument), trade.tradeQuantity, trade.tradePrice);
+        if (journal != NULL)
+        {
+            JournalRecord record;
+            record.type = JournalRecord::Type::TRADE;
+            record.side = 0;
+            record.orderId = trade.tradeId;
+            record.listingId = trade.listingId;
+            record.quantity = trade.tradeQuantity;
+            record.price = trade.tradePrice;
+            record.account = account->id;
+            journal->append(record);
+        }
+        logger.log(LogEvent::TRADE_EXECUTED, trade.tradeId, trade.listingId, trade.tradeQuantity);
+    }
+}
+
+/*
+* Handle every sub-message of a Batch in order, in a single dispatch.
+*
+* Parameters
+* ----------
+* session : uint64_t
+*     The client's session id.
+* account : Account*
+*     The session's account.
+* buffer : char*
+*     The Batch payload, header.payloadSize bytes, already checked by
+*     batchReplies.
+* header : Header
+*     Reference to the decoded batch header.
+* entries : BatchResponse::Entry*
+*     The response entries to fill, one per answered sub-message.
+* validity : const Validity*
+*     Validity of each NewOrder of the batch, in order, NULL if unchecked.
+*
+* Returns
+* -------
+* count : uint16_t
+*     Number of entries filled.
+*/
+uint16_t RiskEngine::handleBatch(uint64_t session, Account *account, char *buffer, Header &header, BatchResponse::Entry *entries, const Validity *validity)
+{
+    Batch batch;
+    std::memcpy(&batch, buffer, sizeof(Batch));
+    size_t offset = sizeof(Batch);
+    uint16_t count = 0;
+    Header subHeader = header;
+    OrderResponse orderResponse;
+    for (uint16_t i = 0; i < batch.count; i++)
+    {
+        uint16_t messageType;
+        std::memcpy(&messageType, buffer + offset, sizeof(messageType));
+        subHeader.payloadSize = batchedMessageSize(messageType);
+        Validity checked = Validity::UNCHECKED;
+        if (validity && messageType == NewOrder::MESSAGE_TYPE)
+            checked = *validity++;
+        if (handleMessage(session, account, orderResponse, buffer + offset, subHeader, OrderDirectory::NO_CLAIM, checked))
+        {
+            entries[count].orderId = orderResponse.orderId;
+            entries[count].status = (uint16_t)orderResponse.status;
+            count++;
+        }
+        offset += subHeader.payloadSize;
+    }
+    return count;
+}
+
+/*
+* Check the message's size against its EngineMessages entry and dispatch it
+* through HANDLERS, one indexed load, to its handler.
+*
+* Parameters
+* ----------
+* session : uint64_t
+*     The client's session id.
+* account : Account*
+*     The session's account, new orders are checked against its limits.
+* orderResponse : OrderResponse
+*     Reference to the order response to update.
+* buffer : char*
+*     The message payload, header.payloadSize bytes.
+* header : Header
+*     Reference to the decoded message header.
+* claim : uint32_t
+*     The OrderDirectory claim on a NewOrder's id, NO_CLAIM when unsharded.
+* validity : Validity
+*     A NewOrder's validity if the I/O thread checked it, UNCHECKED
+*     otherwise.
+*
+* Returns
+* -------
+* reply : bool
+*     true if client is expecting a reply, false otherwise.
+*/
+bool RiskEngine::handleMessage(uint64_t session, Account *account, OrderResponse &orderResponse, char *buffer, Header &header, uint32_t claim,
+                               Validity validity)
+{
+    uint16_t messageType = 0;
+    if (header.payloadSize >= sizeof(messageType))
+        std::memcpy(&messageType, buffer, sizeof(messageType));
+    orderResponse.messageType = OrderResponse::MESSAGE_TYPE;
+    EngineMessages::Entry entry = EngineMessages::at(messageType);
+    if (entry.size == 0 || header.payloadSize != entry.size)
+    {
+        // Answered types are rejected whatever is wrong with them, with the
+        // order id when the payload is long enough to hold one.
+        orderResponse.orderId = 0;
+        if (header.payloadSize >= sizeof(messageType) + sizeof(orderResponse.orderId))
+            std::memcpy(&orderResponse.orderId, buffer + sizeof(messageType), sizeof(orderResponse.orderId));
+        orderResponse.status = OrderResponse::Status::REJECTED;
+        logger.log(LogEvent::INVALID_DATA);
+        return entry.replied;
+    }
+
+    MessageContext context = {session, account, orderResponse, claim, validity};
+    (this->*HANDLERS[messageType])(buffer, context);
+    return entry.replied;
+}
+
+/*
+* Link an order at the head of its session's list of live orders.
+*
+* Parameters
+* ----------
+* session : uint64_t
+*     The client's session id.
+* handle : uint32_t
+*     The order's pool handle.
+*/
+void RiskEngine::linkOrder(uint64_t session, uint32_t handle)
+{
+    Order &order = orders[handle];
+    std::pair<uint32_t *, bool> head = session2Orders.insert(session, handle);
+    order.session = session;
+    order.previousInSession = ObjectPool<Order>::INVALID_HANDLE;
+    order.nextInSession = ObjectPool<Order>::INVALID_HANDLE;
+    if (!head.second)
+    {
+        order.nextInSession = *head.first;
+        orders[*head.first].previousInSession = handle;
+        *head.first = handle;
+    }
+}
+
+/*
+* Modify the quantity of an existing order and update the user's position
+* data.
+*
+* Respond with updated OrderResponse with OrderResponse::Status::ACCEPTED or 
+* OrderResponse::Status::REJECTED.
+*
+* Parameters
+* ----------
+* modifyOrderQuantity : ModifyOrderQuantity
+*     View of the message in the receive buffer.
+* context : MessageContext
+*     The session, account and order response of the message.
+*/
+void RiskEngine::modifyExistingOrder(const ModifyOrderQuantity &modifyOrderQuantity, MessageContext &context)
+{
+    OrderResponse &orderResponse = context.orderResponse;
+    orderResponse.orderId = modifyOrderQuantity.orderId;
+    if (modifyOrderQuantity.newQuantity <= 0 || modifyOrderQuantity.newQuantity > OrderValidator::MAX_QUANTITY)
+    {
+        orderResponse.status = OrderResponse::Status::REJECTED;
+        logger.log(LogEvent::INVALID_DATA, modifyOrderQuantity.orderId, 0, modifyOrderQuantity.newQuantity);
+        return;
+    }
+
+    uint32_t *orderHandle = orderId2Order.find(modifyOrderQuantity.orderId);
+    if (orderHandle == NULL)
+    {
+        orderResponse.status = OrderResponse::Status::REJECTED;
+        logger.log(LogEvent::ORDER_DOES_NOT_EXIST, modifyOrderQuantity.orderId, 0, modifyOrderQuantity.newQuantity);
+    }
+    else if (!OrderValidator::validNotional(modifyOrderQuantity.newQuantity, orders[*orderHandle].price))
+    {
+        orderResponse.status = OrderResponse::Status::REJECTED;
+        logger.log(LogEvent::INVALID_DATA, modifyOrderQuantity.orderId, 0, modifyOrderQuantity.newQuantity);
+    }
+    else
+    {
+        Order &order = orders[*orderHandle];
+        bool added = positions.modifyPosition(order, modifyOrderQuantity.newQuantity);
+        if (added)
+        {
+            appendToJournal(JournalRecord::Type::MODIFY_ORDER, order);
+            orderResponse.status = OrderResponse::Status::ACCEPTED;
+            logger.log(LogEvent::ORDER_QUANTITY_MODIFIED, order.orderId, order.financialInstrumentId, order.qty);
+        }
+        else
+        {
+            orderResponse.status = OrderResponse::Status::REJECTED;
+            logger.log(LogEvent::MODIFY_ORDER_REJECTED, order.orderId, order.financialInstrumentId, modifyOrderQuantity.newQuantity);
+        }
+    }
+}
+
+/*
+* Restore the engine from its snapshot and replay the journal records after
+* it, then journal every accepted transition from then on.
+*
+* Parameters
+* ----------
+* engineJournal : Journal*
+*     The engine's journal.
+* shard : uint32_t
+*     The engine's shard, 0 when unsharded.
+* restored : size_t
+*     Reference set to the number of orders restored from the snapshot.
+* replayed : size_t
+*     Reference set to the number of records replayed.
+*
+* Returns
+* -------
+* recovered : bool
+*     true if the snapshot and journal were read, false otherwise.
+*/
+bool RiskEngine::recover(Journal *engineJournal, uint32_t shard, size_t &restored, size_t &replayed)
+{
+    JournalPosition from;
+    restored = replayed = 0;
+    bool loaded = engineJournal->loadSnapshot(
+        [this, shard, &restored](const SnapshotHeader &header, const SnapshotInstrument *instruments, const SnapshotAccountPosition *accountPositions,
+                                 const SnapshotOrder *snapshotOrders) {
+            restoreSnapshot(header, instruments, accountPositions, snapshotOrders, shard);
+            restored = header.orders;
+        },
+        from);
+    if (!loaded || !engineJournal->open([this, shard](const JournalRecord &record) { applyRecord(record, shard); }, from, replayed))
+        return false;
+    journal = engineJournal;
+    return true;
+}
+
+/*
+* Release the OrderDirectory claim on an order id which is no longer open in
+* this engine, a no-op when unsharded.
+*/
+void RiskEngine::releaseClaim(uint64_t orderId, uint32_t claim)
+{
+    if (directory != NULL)
+        directory->release(orderId, claim);
+}
+
+/*
+* Roll back and remove every live order of the session. The orders are
+* grouped by instrument, account position and side, and each group leaves
+* the positions at once.
+*
+* Parameters
+* ----------
+* session : uint64_t
+*     The client's session id.
+*/
+void RiskEngine::removeUser(uint64_t session)
+{
+    uint32_t *head = session2Orders.find(session);
+    if (head == NULL)
+        return;
+
+    rollbackHandles.clear();
+    for (uint32_t handle = *head; handle != ObjectPool<Order>::INVALID_HANDLE; handle = orders[handle].nextInSession)
+        rollbackHandles.push_back(handle);
+    session2Orders.erase(session);
+    std::sort(rollbackHandles.begin(), rollbackHandles.end(), [this](uint32_t left, uint32_t right) {
+        const Order &a = orders[left], &b = orders[right];
+        return std::tie(a.instrumentIndex, a.accountPosition, a.side) < std::tie(b.instrumentIndex, b.accountPosition, b.side);
+    });
+
+    for (size_t first = 0, last; first < rollbackHandles.size(); first = last)
+    {
+        const Order &group = orders[rollbackHandles[first]];
+        int64_t qty = 0;
+        Notional notional = 0;
+        for (last = first; last < rollbackHandles.size(); last++)
+        {
+            const Order &order = orders[rollbackHandles[last]];
+            if (order.accountPosition != group.accountPosition || order.side != group.side)
+                break;
+            qty += order.qty;
+            notional += (Notional)order.qty * order.price;
+        }
+        positions.rollbackPositions(group.accountPosition, group.side == 'B', qty, notional);
+    }
+
+    for (uint32_t handle : rollbackHandles)
+    {
+        Order &order = orders[handle];
+        appendToJournal(JournalRecord::Type::DELETE_ORDER, order);
+        releaseClaim(order.orderId, order.claim);
+        orderId2Order.erase(order.orderId);
+        orders.release(handle);
+    }
+}
+
+/*
+* Exposure of a snapshot instrument or account position.
+*/
+template <typename SnapshotPosition>
+static Exposure snapshotExposure(const SnapshotPosition &position)
+{
+    Exposure exposure;
+    exposure.buyQty = position.buyQty;
+    exposure.sellQty = position.sellQty;
+    exposure.netPos = position.netPos;
+    exposure.buyNotional = position.buyNotional;
+    exposure.sellNotional = position.sellNotional;
+    exposure.netNotional = position.netNotional;
+    return exposure;
+}
+
+/*
+* Restore the positions and open orders of a snapshot into the empty engine.
+* Positions and orders on a listing no longer in the universe are dropped.
+*
+* Parameters
+* ----------
+* header : SnapshotHeader
+*     Reference to the snapshot header.
+* instruments : const SnapshotInstrument*
+*     The header.instruments instrument positions.
+* accountPositions : const SnapshotAccountPosition*
+*     The header.accountPositions positions of each account.
+* snapshotOrders : const SnapshotOrder*
+*     The header.orders open orders.
+* shard : uint32_t
+*     The engine's shard, restored orders claim their id for it.
+*/
+void RiskEngine::restoreSnapshot(const SnapshotHeader &header, const SnapshotInstrument *instruments, const SnapshotAccountPosition *accountPositions,
+                                 const SnapshotOrder *snapshotOrders, uint32_t shard)
+{
+    for (uint64_t i = 0; i < header.instruments; i++)
+    {
+        uint32_t instrument = positions.findOrRegisterInstrument(instruments[i].listingId);
+        if (instrument != PositionTable::INVALID_INSTRUMENT)
+            positions.restorePosition(instrument, snapshotExposure(instruments[i]));
+    }
+    for (uint64_t i = 0; i < header.accountPositions; i++)
+    {
+        const SnapshotAccountPosition &position = accountPositions[i];
+        uint32_t instrument = positions.findInstrument(position.listingId);
+        if (instrument != PositionTable::INVALID_INSTRUMENT)
+        {
+            uint32_t accountPosition = positions.findOrRegisterAccountPosition(accounts.findOrRegister(position.account), instrument);
+            positions.restoreAccountPosition(accountPosition, snapshotExposure(position));
+        }
+    }
+
+    orderId2Order.reserve(header.orders);
+    orders.reserve(header.orders);
+    for (uint64_t i = 0; i < header.orders; i++)
+    {
+        const SnapshotOrder &snapshotOrder = snapshotOrders[i];
+        Order order(snapshotOrder.orderId, snapshotOrder.listingId, snapshotOrder.quantity, snapshotOrder.price, snapshotOrder.side);
+        order.instrumentIndex = positions.findInstrument(snapshotOrder.listingId);
+        if (order.instrumentIndex == PositionTable::INVALID_INSTRUMENT)
+        {
+            logger.log(LogEvent::UNKNOWN_LISTING, order.orderId, order.financialInstrumentId, order.qty);
+            continue;
+        }
+        if (directory != NULL)
+            order.claim = directory->claim(order.orderId, shard);
+        order.account = accounts.findOrRegister(snapshotOrder.account);
+        order.accountPosition = positions.findOrRegisterAccountPosition(order.account, order.instrumentIndex);
+        orderId2Order.insert(order.orderId, allocateOrder(order));
+    }
+}
+
+/*
+* Snapshot the engine in the background if one is due, see Journal::snapshot.
+*/
+void RiskEngine::snapshotIfDue()
+{
+    if (journal != NULL && journal->snapshotDue())
+        journal->snapshot([this](SnapshotWriter &writer, SnapshotHeader &header) { return writeSnapshot(writer, header); });
+}
+
+/*
+* Unlink an order from its session's list of live orders, if it has a
+* session.
+*
+* Parameters
+* ----------
+* handle : uint32_t
+*     The order's pool handle.
+*/
+void RiskEngine::unlinkOrder(uint32_t handle)
+{
+    Order &order = orders[handle];
+    if (order.session == 0)
+        return;
+    if (order.nextInSession != ObjectPool<Order>::INVALID_HANDLE)
+        orders[order.nextInSession].previousInSession = order.previousInSession;
+    if (order.previousInSession != ObjectPool<Order>::INVALID_HANDLE)
+        orders[order.previousInSession].nextInSession = order.nextInSession;
+    else if (order.nextInSession != ObjectPool<Order>::INVALID_HANDLE)
+        *session2Orders.find(order.session) = order.nextInSession;
+    else
+        session2Orders.erase(order.session);
+}
+
+/*
+* Write the positions, account positions and open orders to a snapshot, in the forked snapshot
+* process. Nothing here may allocate.
+*
+* Parameters
+* ----------
+* writer : SnapshotWriter
+*     Reference to the snapshot file writer.
+* header : SnapshotHeader
+*     Reference to the header filled by the journal, the counts are set.
+*
+* Returns
+* -------
+* written : bool
+*     true if every write succeeded, false otherwise.
+*/
+bool RiskEngine::writeSnapshot(SnapshotWriter &writer, SnapshotHeader &header)
+{
+    header.instruments = positions.size();
+    header.accountPositions = positions.accountPositionCount();
+    header.orders = orderId2Order.size();
+    bool written = writer.write(&header, sizeof(header));
+    positions.forEachInstrument([&writer, &written](uint64_t listingId, const Exposure &e) {
+        SnapshotInstrument instrument = {listingId, e.buyQty, e.sellQty, e.netPos, e.buyNotional, e.sellNotional, e.netNotional};
+        written = written && writer.write(&instrument, sizeof(instrument));
+    });
+    positions.forEachAccountPosition([&writer, &written](uint64_t account, uint64_t listingId, const Exposure &e) {
+        SnapshotAccountPosition position = {account, listingId, e.buyQty, e.sellQty, e.netPos, e.buyNotional, e.sellNotional, e.netNotional};
+        written = written && writer.write(&position, sizeof(position));
+    });
+    orderId2Order.forEach([this, &writer, &written](uint64_t orderId, uint32_t handle) {
+        const Order &order = orders[handle];
+        SnapshotOrder snapshotOrder = {orderId, order.financialInstrumentId, order.qty, order.price, order.account->id, order.side};
+        written = written && writer.write(&snapshotOrder, sizeof(snapshotOrder));
+    });
+    return written;
+}
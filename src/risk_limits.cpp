@@ -0,0 +1,138 @@
+#include "../include/risk_server/risk_limits.hpp"
+
+#include <fstream>
+#include <sstream>
+
+Limit RiskLimits::forAccount(uint64_t account) const
+{
+    auto it = accounts.find(account);
+    return it == accounts.end() ? Limit() : it->second;
+}
+
+Limit RiskLimits::forAccountInstrument(uint64_t account, uint64_t listingId) const
+{
+    auto it = accountInstruments.find(std::make_pair(account, listingId));
+    return it == accountInstruments.end() ? Limit() : it->second;
+}
+
+Limit RiskLimits::forInstrument(uint64_t listingId) const
+{
+    auto it = instruments.find(listingId);
+    return it == instruments.end() ? global : it->second;
+}
+
+/*
+* Load the limits file, one limit per line ('#' starts a comment):
+*
+*     global <buy> <sell> [<buy notional> <sell notional>]
+*     portfolio <buy> <sell> [<buy notional> <sell notional>]
+*     instrument <listing id> <buy> <sell> [<buy notional> <sell notional>]
+*     account <account> <buy> <sell> [<buy notional> <sell notional>]
+*     account-instrument <account> <listing id> <buy> <sell> [...]
+*
+* Notional limits are in price x quantity units, unlimited when omitted.
+*
+* Parameters
+* ----------
+* path : std::string
+*     Path of the limits file.
+*
+* Returns
+* -------
+* loaded : bool
+*     true if every line was read, false if the file is missing or a line is
+*     malformed.
+*/
+bool RiskLimits::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line.substr(0, line.find('#')));
+        std::string level;
+        if (!(stream >> level))
+            continue;
+
+        uint64_t account = 0, listingId = 0, buy = 0, sell = 0;
+        bool parsed;
+        if (level == "global" || level == "portfolio")
+            parsed = static_cast<bool>(stream >> buy >> sell);
+        else if (level == "instrument" || level == "account")
+            parsed = static_cast<bool>(stream >> (level == "account" ? account : listingId) >> buy >> sell);
+        else if (level == "account-instrument")
+            parsed = static_cast<bool>(stream >> account >> listingId >> buy >> sell);
+        else
+            parsed = false;
+        uint64_t buyNotional = UINT64_MAX, sellNotional = UINT64_MAX, value;
+        if (parsed && stream >> value)
+        {
+            buyNotional = value;
+            parsed = static_cast<bool>(stream >> sellNotional);
+        }
+        if (!parsed)
+            return false;
+
+        Limit limit(buy, sell, buyNotional, sellNotional);
+        if (level == "global")
+            global = limit;
+        else if (level == "portfolio")
+            portfolio = limit;
+        else if (level == "instrument")
+            instruments[listingId] = limit;
+        else if (level == "account")
+            accounts[account] = limit;
+        else
+            accountInstruments[std::make_pair(account, listingId)] = limit;
+    }
+    return true;
+}
+
+LimitsRegistry::~LimitsRegistry()
+{
+    delete table.load();
+}
+
+/*
+* Register a reader, holding the current table from now on.
+*
+* Returns
+* -------
+* reader : size_t
+*     Index of the reader, passed to announce.
+*/
+size_t LimitsRegistry::addReader()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    readers.emplace_back(current()->getVersion());
+    return readers.size() - 1;
+}
+
+/*
+* Replace the current table and free every replaced table no reader holds.
+*
+* Parameters
+* ----------
+* limits : RiskLimits*
+*     The new table, owned by the registry from now on.
+*/
+void LimitsRegistry::publish(RiskLimits *limits)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const RiskLimits *replaced = table.load(std::memory_order_relaxed);
+    limits->version = replaced->version + 1;
+    retired.emplace_back(replaced);
+    table.store(limits, std::memory_order_release);
+    publishedVersion.store(limits->version, std::memory_order_release);
+
+    // A reader only announces a version once it stopped using older tables.
+    uint64_t oldest = UINT64_MAX;
+    for (const std::atomic<uint64_t> &reader : readers)
+        oldest = std::min(oldest, reader.load(std::memory_order_acquire));
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                 [oldest](const std::unique_ptr<const RiskLimits> &limits) { return limits->getVersion() < oldest; }),
+                  retired.end());
+}
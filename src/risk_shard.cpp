@@ -0,0 +1,247 @@
+#include "../include/risk_server/risk_shard.hpp"
+
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+ShardWakeup::ShardWakeup()
+{
+    int descriptors[2];
+    if (pipe(descriptors) < 0)
+    {
+        std::cerr << "ERR 00 <SHARD_WAKEUP_PIPE>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    readDescriptor = descriptors[0];
+    writeDescriptor = descriptors[1];
+    fcntl(readDescriptor, F_SETFL, fcntl(readDescriptor, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(writeDescriptor, F_SETFL, fcntl(writeDescriptor, F_GETFL, 0) | O_NONBLOCK);
+}
+
+ShardWakeup::~ShardWakeup()
+{
+    close(readDescriptor);
+    close(writeDescriptor);
+}
+
+/*
+* Consume the wakeup, called by the I/O thread before it drains the replies.
+*/
+void ShardWakeup::clear()
+{
+    char buffer[64];
+    while (read(readDescriptor, buffer, sizeof(buffer)) > 0)
+        ;
+    // Read-modify-write so a concurrent signal either sees the flag cleared
+    // and writes again, or its replies are visible to the following drain.
+    pending.exchange(false, std::memory_order_acq_rel);
+}
+
+/*
+* Wake the I/O thread unless a wakeup is already pending.
+*/
+void ShardWakeup::signal()
+{
+    if (pending.exchange(true, std::memory_order_acq_rel))
+        return;
+    char byte = 1;
+    ssize_t written = write(writeDescriptor, &byte, 1);
+    (void)written;
+}
+
+RiskShard::RiskShard(LimitsRegistry &limits, AccountTable &accounts, size_t orderCapacity, OrderDirectory &directory, const std::vector<ShardWakeup *> &producers)
+    : engine(limits, accounts, orderCapacity)
+{
+    engine.setDirectory(&directory);
+    for (ShardWakeup *wakeup : producers)
+    {
+        channels.emplace_back(new Channel());
+        channels.back()->wakeup = wakeup;
+    }
+}
+
+/*
+* Stop the shard thread once it has drained its requests.
+*/
+RiskShard::~RiskShard()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running.store(false, std::memory_order_release);
+    }
+    sleepCondition.notify_one();
+    if (thread.joinable())
+        thread.join();
+}
+
+bool RiskShard::hasRequests() const
+{
+    for (const auto &channel : channels)
+    {
+        if (!channel->requests.empty())
+            return true;
+    }
+    return false;
+}
+
+/*
+* Handle every request queued by one producer and wake it if replies were
+* queued. When the journal commits per batch the replies are held until the
+* batch's records are on disk.
+*
+* Parameters
+* ----------
+* channel : Channel
+*     Reference to the producer's rings.
+*
+* Returns
+* -------
+* processed : bool
+*     true if at least one request was handled, false otherwise.
+*/
+bool RiskShard::processChannel(Channel &channel)
+{
+    ShardRequest request;
+    ShardReply reply;
+    bool processed = false, replied = false;
+    Journal *journal = engine.getJournal();
+    bool holdReplies = journal != NULL && journal->commitsPerBatch();
+    while (channel.requests.pop(request))
+    {
+        processed = true;
+        if (request.kind == ShardRequest::Kind::CLOSE_SESSION)
+        {
+            engine.removeUser(request.session);
+            continue;
+        }
+
+        Metrics &metrics = Metrics::instance();
+        uint64_t handlingAt = metrics.enabled() ? Metrics::now() : 0;
+        bool replies = engine.handleMessage(request.session, request.account, reply.orderResponse, request.payload, request.header, request.claim,
+                                            request.validity);
+        if (handlingAt != 0)
+        {
+            metrics.recordLatency(LatencyStage::RISK_CHECK, Metrics::now() - handlingAt);
+            if (replies)
+                metrics.countReply(reply.orderResponse.status);
+        }
+        if (!replies)
+            continue;
+        reply.socketDescriptor = request.socketDescriptor;
+        reply.batch = request.batch;
+        reply.entry = request.entry;
+        reply.session = request.session;
+        reply.header.version = 0;
+        reply.header.payloadSize = sizeof(OrderResponse);
+        reply.header.sequenceNumber = request.header.sequenceNumber + 1;
+        reply.header.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        replied = true;
+        if (!holdReplies)
+            pushReply(channel, reply);
+        else
+        {
+            uncommitted.push_back(reply);
+            // Bounded by the reply ring, the batch ends here.
+            if (uncommitted.size() == QUEUE_CAPACITY)
+                break;
+        }
+    }
+    if (journal != NULL)
+        journal->commit();
+    for (const ShardReply &held : uncommitted)
+        pushReply(channel, held);
+    uncommitted.clear();
+    if (replied)
+        channel.wakeup->signal();
+    return processed;
+}
+
+/*
+* Queue a request for the shard and wake it if it sleeps. Called by the
+* producer's I/O thread only.
+*
+* Parameters
+* ----------
+* producer : size_t
+*     Index of the calling I/O thread.
+* request : ShardRequest
+*     Reference to the request to queue.
+*
+* Returns
+* -------
+* pushed : bool
+*     true if the request was queued, false if the ring is full.
+*/
+bool RiskShard::push(size_t producer, const ShardRequest &request)
+{
+    if (!channels[producer]->requests.push(request))
+        return false;
+
+    // Pairs with the fence in sleep(): either the shard sees the request
+    // before sleeping or the producer sees it sleeping.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_one();
+    }
+    return true;
+}
+
+/*
+* Queue a reply for the producer. A full reply ring waits for the I/O thread,
+* which drains replies while its own pushes are blocked so neither side can
+* deadlock.
+*/
+void RiskShard::pushReply(Channel &channel, const ShardReply &reply)
+{
+    while (!channel.replies.push(reply))
+    {
+        channel.wakeup->signal();
+        std::this_thread::yield();
+    }
+}
+
+void RiskShard::run()
+{
+    int idlePolls = 0;
+    while (running.load(std::memory_order_acquire))
+    {
+        engine.refreshLimits();
+        bool processed = false;
+        for (auto &channel : channels)
+            processed |= processChannel(*channel);
+        if (processed)
+            engine.snapshotIfDue();
+
+        if (processed)
+            idlePolls = 0;
+        else if (++idlePolls >= SPIN_POLLS)
+        {
+            sleep();
+            idlePolls = 0;
+        }
+    }
+    for (auto &channel : channels)
+        processChannel(*channel);
+}
+
+/*
+* Block until a producer pushes a request or the shard is stopped.
+*/
+void RiskShard::sleep()
+{
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this]() { return hasRequests() || !running.load(std::memory_order_acquire); });
+    }
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+void RiskShard::start()
+{
+    thread = std::thread([this]() { run(); });
+}
@@ -1,482 +1,294 @@
 #include "../include/risk_server/server.hpp"
 
-/*
-* Add a master socket to the server's socket descriptor set. Also add child 
-* sockets to the socket descriptor set and update maxDescriptor for select.
-*/
-void RiskServer::addMasterAndChildSockets()
+RiskServer::RiskServer(uint64_t b, uint64_t s, int p, const ServerOptions &o)
+    : BUY_THRESHOLD(b), SELL_THRESHOLD(s), PORT(p), options(o), limits(b, s), accounts(limits.current())
 {
-    FD_ZERO(&socketDescriptorSet);
-
-    FD_SET(masterSocket, &socketDescriptorSet);
-    maxDescriptor = masterSocket;
-
-    for (auto it = clientSocket.begin(); it != clientSocket.end(); it++)
+    if (!options.limitsPath.empty() && !reloadLimits(options.limitsPath))
     {
-        int socketDescriptor = *it;
-
-        // Check socket validity.
-        if (socketDescriptor > 0)
-            FD_SET(socketDescriptor, &socketDescriptorSet);
-
-        maxDescriptor = std::max(maxDescriptor, socketDescriptor);
+        std::cerr << "ERR 00 <LIMITS_FILE>" << std::endl;
+        exit(EXIT_FAILURE);
     }
-}
-
-/*
-* Add a new user's socket descriptor to the client sockets and update the 
-* user's id to order id map with user's socket descriptor.
-*
-* Parameters
-* ----------
-* newSocket : uint64_t
-*     The client's socket descriptor.
-*/
-void RiskServer::addUser(uint64_t newSocket)
-{
-    clientSocket.insert(newSocket);
-    userId2Order[newSocket] = new std::vector<uint64_t>();
-}
-
-/*
-* LOG user's client details, remove user data from the server and close the 
-* connection to the socket descriptor.
-*
-* Parameters
-* ----------
-* socketDescriptor : int
-*     The client's socket descriptor.
-*/
-void RiskServer::closeConnection(int socketDescriptor)
-{
-    struct sockaddr_in address;
-    int addressLen;
-    getpeername(socketDescriptor, (struct sockaddr *)&address, (socklen_t *)&addressLen);
-
-    printf("LOG Disconnected %s:%d \n", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-
-    removeUser(socketDescriptor);
-    close(socketDescriptor);
-}
 
-/*
-* Read provided header and message to create a new order and update the user's 
-* position data. 
-*
-* Respond with updated OrderResponse with OrderResponse::Status::ACCEPTED or 
-* OrderResponse::Status::REJECTED.
-*
-* Parameters
-* ----------
-* socketDescriptor : int
-*     The client's socket descriptor.
-* buffer : char*
-*     The message buffer.
-* header : Header
-*     Reference to the message header.
-* orderResponse : OrderResponse
-*     Reference to the order response to update.
-*/
-void RiskServer::createNewOrder(int socketDescriptor, char *buffer, Header &header, OrderResponse &orderResponse)
-{
-    orderResponse.messageType = OrderResponse::MESSAGE_TYPE;
-    if (header.payloadSize != sizeof(NewOrder))
+    std::vector<ShardWakeup *> producers;
+    for (size_t i = 0; i < std::max<size_t>(options.ioThreads, 1); i++)
     {
-        orderResponse.status = OrderResponse::Status::REJECTED;
-        std::cerr << ERR_INVALID_DATA << std::endl;
-        return;
+        workers.emplace_back(new ServerWorker(*this, i));
+        if (options.shards > 0)
+            producers.push_back(workers.back()->createShardWakeup());
     }
 
-    NewOrder newOrder;
-    std::memcpy(&newOrder, buffer, header.payloadSize);
-    orderResponse.orderId = newOrder.orderId;
-
-    if (newOrder.orderPrice <= 0 || newOrder.orderQuantity == 0)
+    bool loaded = true;
+    if (options.shards == 0)
     {
-        orderResponse.status = OrderResponse::Status::REJECTED;
-        std::cerr << ERR_INVALID_DATA << std::endl;
-    }
-    else if (orderId2Order.count(newOrder.orderId))
-    {
-        orderResponse.status = OrderResponse::Status::REJECTED;
-        std::cerr << ERR_ORDER_ALREADY_EXISTS << std::endl;
+        engine.reset(new RiskEngine(limits, accounts, options.orderCapacity));
+        if (!options.universePath.empty())
+            loaded = engine->loadUniverse(options.universePath);
     }
     else
     {
-        std::shared_ptr<Order> order(new Order(newOrder.orderId, newOrder.listingId, newOrder.orderQuantity, newOrder.orderPrice, newOrder.side));
-
-        if (!instrumentId2PositionData.count(newOrder.listingId))
-        {
-            std::shared_ptr<PositionData> pos(new PositionData());
-            instrumentId2PositionData[newOrder.listingId] = pos;
-        }
-        bool added = instrumentId2PositionData[newOrder.listingId]->addPosition(order, BUY_THRESHOLD, SELL_THRESHOLD);
-        if (added)
+        directory.reserve(options.orderCapacity);
+        for (size_t i = 0; i < options.shards; i++)
         {
-            orderId2Order[order->orderId] = order;
-            userId2Order[socketDescriptor]->push_back(order->orderId);
-            orderResponse.status = OrderResponse::Status::ACCEPTED;
-            std::cout << SUCC_NEW_ORDER_CREATED << std::endl;
-        }
-        else
-        {
-            orderResponse.status = OrderResponse::Status::REJECTED;
-            std::cout << WARN_NEW_ORDER_REJECTED << std::endl;
+            shards.emplace_back(new RiskShard(limits, accounts, options.orderCapacity / options.shards, directory, producers));
+            if (!options.universePath.empty())
+                loaded &= shards.back()->loadUniverse(options.universePath);
         }
     }
+    if (!loaded)
+    {
+        std::cerr << "ERR 00 <UNIVERSE_FILE>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!options.journal.directory.empty())
+        recoverJournals();
+    for (auto &shard : shards)
+        shard->start();
+    if (!options.limitsPath.empty() && options.limitsWatchSeconds > 0)
+        limitsWatcher = std::thread([this]() { watchLimits(); });
 }
 
 /*
-* Read provided header and message to delete an order and update the user's 
-* position data. 
-*
-* Parameters
-* ----------
-* buffer : char*
-*     The message buffer.
-* header : Header
-*     Reference to the message header.
+* Stop the limits watcher.
 */
-void RiskServer::deleteExistingOrder(char *buffer, Header &header)
+RiskServer::~RiskServer()
 {
-    if (header.payloadSize != sizeof(DeleteOrder))
-    {
-        std::cerr << ERR_INVALID_DATA << std::endl;
-        return;
-    }
-    DeleteOrder deleteOrder;
-    std::memcpy(&deleteOrder, buffer, header.payloadSize);
-    auto it = orderId2Order.find(deleteOrder.orderId);
-    if (it == orderId2Order.end())
-    {
-        std::cerr << ERR_ORDER_DOES_NOT_EXIST << std::endl;
-    }
-    else
     {
-        std::shared_ptr<Order> order = it->second;
-        std::shared_ptr<PositionData> pos = instrumentId2PositionData.find(order->financialInstrumentId)->second;
-        pos->rollbackPosition(order);
-        orderId2Order.erase(it);
-        std::cout << SUCC_ORDER_DELETED << " ORDER_ID=" << order->orderId << std::endl;
+        std::lock_guard<std::mutex> lock(watchMutex);
+        stopping = true;
     }
+    watchCondition.notify_one();
+    if (limitsWatcher.joinable())
+        limitsWatcher.join();
 }
 
 /*
-* Read provided header and message to execute trade.
-*
-* Parameters
-* ----------
-* buffer : char*
-*     The message buffer.
-* header : Header
-*     Reference to the message header.
+* Serve the metrics on the admin endpoints, if any were configured, and start
+* recording them.
 */
-void RiskServer::executeTrade(char *buffer, Header &header)
+void RiskServer::initAdminServer()
 {
-    if (header.payloadSize != sizeof(Trade))
-    {
-        std::cerr << ERR_INVALID_DATA << std::endl;
+    if (options.adminPort == 0 && options.adminSocketPath.empty())
         return;
-    }
 
-    Trade trade;
-    std::memcpy(&trade, buffer, header.payloadSize);
-    if (trade.tradePrice <= 0 || trade.tradeQuantity == 0)
+    admin.addCommand("metrics", [](const std::string &) { return Metrics::instance().prometheusText(); });
+    admin.addCommand("portfolio", [this](const std::string &) { return portfolioText(); });
+    // reload-limits [path]: reload the --limits file, or load another one.
+    admin.addCommand("reload-limits", [this](const std::string &arguments) {
+        std::string path = arguments.empty() ? options.limitsPath : arguments;
+        if (path.empty() || !reloadLimits(path))
+            return std::string("ERR 00 <LIMITS_FILE>\n");
+        return "OK limits version " + std::to_string(limits.version()) + "\n";
+    });
+    if ((options.adminPort != 0 && !admin.listenTcp(options.adminPort)) ||
+        (!options.adminSocketPath.empty() && !admin.listenUnix(options.adminSocketPath)))
     {
-        std::cerr << ERR_INVALID_DATA << std::endl;
-        return;
-    }
-
-    auto it = orderId2Order.find(trade.tradeId);
-    if (it == orderId2Order.end())
-    {
-        std::cerr << ERR_ORDER_DOES_NOT_EXIST << std::endl;
-    }
-    else
-    {
-        std::shared_ptr<PositionData> pos = instrumentId2PositionData.find(trade.listingId)->second;
-        pos->trade(trade.tradeQuantity);
-        std::cout << SUCC_TRADE_EXECUTED << std::endl;
+        std::cerr << "ERR 00 <ADMIN_SOCKET_BINDING>" << std::endl;
+        exit(EXIT_FAILURE);
     }
+    Metrics::instance().enable();
+    admin.start();
 }
 
 /*
-* Handle the socket operations for each client socket, keep track of closed
-* sockets to erase and handle any new messages.
+* Bind one listener per worker and run the workers' event loops, the first 
+* one on the calling thread. With several workers the listeners share PORT 
+* through SO_REUSEPORT and the kernel spreads new connections over them, so
+* accepts never wait behind another worker's message handling. The Unix 
+* socket, if any, is a single listener watched by every worker, whichever 
+* accepts first serves the connection.
 */
-void RiskServer::handleClientSocketIOOperations()
+void RiskServer::initListenerSocket()
 {
-    std::vector<int> closedSockets;
-    for (auto it = clientSocket.begin(); it != clientSocket.end(); it++)
-    {
-        int socketDescriptor = *it;
-
-        if (FD_ISSET(socketDescriptor, &socketDescriptorSet))
-        {
-            char buffer[1024];
-            int valread;
-
-            // Check if client socket is closing.
-            if ((valread = read(socketDescriptor, buffer, sizeof(Header))) <= 0)
-            {
-                closeConnection(socketDescriptor);
-                closedSockets.push_back(socketDescriptor);
-            }
-            // Handle message and respond if required.
-            else
-            {
-                OrderResponse orderResponse;
-                Header header;
-                bool reply = handleMessage(socketDescriptor, orderResponse, buffer, header);
-                if (reply)
-                {
-                    Header responseHeader;
-                    responseHeader.payloadSize = sizeof(OrderResponse);
-                    responseHeader.sequenceNumber = header.sequenceNumber + 1;
-                    responseHeader.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-
-                    u_long headerSize = sizeof(Header);
-                    char *message = new char[headerSize + responseHeader.payloadSize];
-                    std::memcpy(message, &responseHeader, headerSize);
-                    std::memcpy(message + headerSize, &orderResponse, responseHeader.payloadSize);
-                    send(socketDescriptor, message, headerSize + responseHeader.payloadSize, 0);
-                }
-            }
-        }
-    }
-    for (int closed : closedSockets) clientSocket.erase(closed);
+    initAdminServer();
+    if (!options.socketPath.empty())
+        initUnixSocket();
+    for (auto &worker : workers)
+        worker->initListenerSocket(workers.size() > 1);
+    printf("Listener on port %d \n", PORT);
+    if (unixSocket >= 0)
+        printf("Listener on socket %s \n", options.socketPath.c_str());
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers.size(); i++)
+        threads.emplace_back([this, i]() { workers[i]->run(); });
+    workers[0]->run();
+    for (std::thread &thread : threads)
+        thread.join();
 }
 
 /*
-* Read provided header and message type to handle the message and reponse.
-*
-* Parameters
-* ----------
-* socketDescriptor : int
-*     The client's socket descriptor.
-* orderResponse : OrderResponse
-*     Reference to the order response to update.
-* buffer : char*
-*     The message buffer.
-* header : Header
-*     Reference to the message header.
-*
-* Returns
-* -------
-* reply : bool
-*     true if client is expecting a reply, false otherwise.
+* Bind the non-blocking Unix stream listener at options.socketPath, replacing
+* a stale socket file. Its clients skip the TCP/IP stack but are served with
+* the same framing and event loops as those of PORT.
 */
-bool RiskServer::handleMessage(int socketDescriptor, OrderResponse &orderResponse, char *buffer, Header &header)
+void RiskServer::initUnixSocket()
 {
-    bool reply;
-    std::memcpy(&header, buffer, sizeof(Header));
-    int valread = read(socketDescriptor, buffer, header.payloadSize);
-    uint16_t *messageType = (uint16_t *)buffer;
-    switch (*messageType)
-    {
-    case NewOrder::MESSAGE_TYPE:
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    if (options.socketPath.size() >= sizeof(address.sun_path))
     {
-        createNewOrder(socketDescriptor, buffer, header, orderResponse);
-        reply = true;
-        break;
+        std::cerr << "ERR 00 <UNIX_SOCKET_PATH>" << std::endl;
+        exit(EXIT_FAILURE);
     }
-    case DeleteOrder::MESSAGE_TYPE:
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, options.socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    if ((unixSocket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
     {
-        deleteExistingOrder(buffer, header);
-        reply = false;
-        break;
+        std::cerr << "ERR 00 <UNIX_SOCKET>" << std::endl;
+        exit(EXIT_FAILURE);
     }
-    case ModifyOrderQuantity::MESSAGE_TYPE:
+    unlink(options.socketPath.c_str());
+    if (bind(unixSocket, (struct sockaddr *)&address, sizeof(address)) < 0)
     {
-        modifyExistingOrder(buffer, header, orderResponse);
-        reply = true;
-        break;
+        std::cerr << "ERR 00 <UNIX_SOCKET_BINDING>" << std::endl;
+        exit(EXIT_FAILURE);
     }
-    case Trade::MESSAGE_TYPE:
+    if (listen(unixSocket, options.backlog) < 0)
     {
-        executeTrade(buffer, header);
-        reply = false;
-        break;
-    }
+        std::cerr << "ERR 00 <UNIX_SOCKET_LISTEN>" << std::endl;
+        exit(EXIT_FAILURE);
     }
-    return reply;
+    fcntl(unixSocket, F_SETFL, fcntl(unixSocket, F_GETFL, 0) | O_NONBLOCK);
 }
 
-
 /*
-* Handle a new connection.
-*
-* Parameters
-* ----------
-* socketDescriptor : int
-*     The client's socket descriptor.
-* address : sockaddr_in
-*     The client's address details.
+* Allocate the id of a new client session, unique across every worker.
 */
-void RiskServer::handleNewConnection(int newSocket, struct sockaddr_in address)
+uint64_t RiskServer::newSession()
 {
-    if (newSocket < 0)
-    {
-        std::cerr << "accept" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    std::cout << "LOG New Connection " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << " SOCK FD" << newSocket << std::endl;
-    addUser(newSocket);
+    return nextSession.fetch_add(1, std::memory_order_relaxed);
 }
 
 /*
-* Initialize a master socket and address, bind socket to PORT.
-* Listen master and client sockets for activity and handle any connections/
-* operations.
+* Render the portfolio aggregates and headroom as Prometheus gauges.
+*
+* Returns
+* -------
+* text : std::string
+*     The gauges, read without stopping the engines.
 */
-void RiskServer::initListenerSocket()
+std::string RiskServer::portfolioText()
 {
-    int opt = 1;
-    // Create and set master socket to allow multiple connections.
-    if ((masterSocket = socket(AF_INET, SOCK_STREAM, 0)) == 0)
-    {
-        std::cerr << "socket failed" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    if (setsockopt(masterSocket, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt)) < 0)
-    {
-        std::cerr << "setsockopt" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    // TCP socket.
-    mAddress.sin_family = AF_INET;
-    mAddress.sin_addr.s_addr = INADDR_ANY;
-    mAddress.sin_port = htons(PORT);
-    mAddressLen = sizeof(mAddress);
-
-    // Bind the socket to PORT.
-    if (bind(masterSocket, (struct sockaddr *)&mAddress, sizeof(mAddress)) < 0)
-    {
-        std::cerr << "ERR 00 <MASTER_SOCKET_BINDING>" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    printf("Listener on port %d \n", PORT);
-
-    // Maximum 3 pending sockets to listen.
-    if (listen(masterSocket, 3) < 0)
+    const Portfolio &portfolio = accounts.getPortfolio();
+    const Account &headroom = portfolio.headroom;
+    struct Gauge
     {
-        std::cerr << "ERR 00 <MASTER_SOCKET_LISTEN>" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    while (true)
+        const char *name, *labels;
+        const std::atomic<int64_t> &value;
+    } gauges[] = {
+        {"risk_portfolio_open_quantity", "side=\"buy\"", portfolio.buyQty},
+        {"risk_portfolio_open_quantity", "side=\"sell\"", portfolio.sellQty},
+        {"risk_portfolio_net_position", "", portfolio.netPos},
+        {"risk_portfolio_open_notional", "side=\"buy\"", portfolio.buyNotional},
+        {"risk_portfolio_open_notional", "side=\"sell\"", portfolio.sellNotional},
+        {"risk_portfolio_net_notional", "", portfolio.netNotional},
+        {"risk_portfolio_headroom", "side=\"buy\",unit=\"quantity\"", headroom.buyHeadroom},
+        {"risk_portfolio_headroom", "side=\"sell\",unit=\"quantity\"", headroom.sellHeadroom},
+        {"risk_portfolio_headroom", "side=\"buy\",unit=\"notional\"", headroom.buyNotionalHeadroom},
+        {"risk_portfolio_headroom", "side=\"sell\",unit=\"notional\"", headroom.sellNotionalHeadroom},
+    };
+
+    std::string text;
+    const char *previous = "";
+    for (const Gauge &gauge : gauges)
     {
-        addMasterAndChildSockets();
-
-        // Wait indefinitely for an activity on one of the sockets in the socket descriptor set.
-        int activity = select(maxDescriptor + 1, &socketDescriptorSet, NULL, NULL, NULL);
-
-        // Invalid socket selected.
-        if ((activity < 0) && (errno != EINTR))
-        {
-            std::cerr << "ERR 00 <SELECTING_SOCKET>" << std::endl;
-        }
-
-        // If new connection on master socket...
-        if (FD_ISSET(masterSocket, &socketDescriptorSet))
+        char line[160];
+        if (std::strcmp(gauge.name, previous) != 0)
         {
-            struct sockaddr_in address;
-            int addressLen;
-            int newSocket = accept(masterSocket, (struct sockaddr *)&address, (socklen_t *)&addressLen);
-            handleNewConnection(newSocket, address);
+            snprintf(line, sizeof(line), "# TYPE %s gauge\n", gauge.name);
+            text += line;
+            previous = gauge.name;
         }
-
-        // Hnadle IO operations for all client sockets.
-        handleClientSocketIOOperations();
+        snprintf(line, sizeof(line), *gauge.labels ? "%s{%s} %lld\n" : "%s%s %lld\n", gauge.name, gauge.labels,
+                 (long long)gauge.value.load(std::memory_order_relaxed));
+        text += line;
     }
+    return text;
 }
 
 /*
-* Read provided header and message to modify an existing order and update the 
-* user's position data. 
-*
-* Respond with updated OrderResponse with OrderResponse::Status::ACCEPTED or 
-* OrderResponse::Status::REJECTED.
-*
-* Parameters
-* ----------
-* buffer : char*
-*     The message buffer.
-* header : Header
-*     Reference to the message header.
-* orderResponse : OrderResponse
-*     Reference to the order response to update.
+* Open one journal per engine, restoring the engine from its snapshot and
+* replaying the journal tail before any connection is accepted, and print
+* what was recovered and the time it took. Shards must keep their count,
+* listings are recovered into the shard which journaled them.
 */
-void RiskServer::modifyExistingOrder(char *buffer, Header &header, OrderResponse &orderResponse)
+void RiskServer::recoverJournals()
 {
-    orderResponse.messageType = OrderResponse::MESSAGE_TYPE;
-    if (header.payloadSize != sizeof(ModifyOrderQuantity))
+    uint32_t engines = std::max<size_t>(options.shards, 1);
+    auto startedAt = std::chrono::steady_clock::now();
+    size_t restored = 0, replayed = 0, orders, records;
+    bool recovered = true;
+    for (uint32_t i = 0; i < engines; i++)
     {
-        orderResponse.status = OrderResponse::Status::REJECTED;
-        std::cerr << ERR_INVALID_DATA << std::endl;
-        return;
-    }
-
-    ModifyOrderQuantity modifyOrderQuantity;
-    std::memcpy(&modifyOrderQuantity, buffer, header.payloadSize);
-    orderResponse.orderId = modifyOrderQuantity.orderId;
-    if (modifyOrderQuantity.newQuantity <= 0)
-    {
-        orderResponse.status = OrderResponse::Status::REJECTED;
-        std::cerr << ERR_INVALID_DATA << std::endl;
-        return;
-    }
-
-    auto it = orderId2Order.find(modifyOrderQuantity.orderId);
-    if (it == orderId2Order.end())
-    {
-        orderResponse.status = OrderResponse::Status::REJECTED;
-        std::cerr << ERR_ORDER_DOES_NOT_EXIST << std::endl;
+        journals.emplace_back(new Journal(options.journal, i, engines));
+        if (engine)
+            recovered &= engine->recover(journals.back().get(), i, orders, records);
+        else
+            recovered &= shards[i]->recover(journals.back().get(), i, orders, records);
+        restored += orders;
+        replayed += records;
     }
-    else
+    if (!recovered)
     {
-        std::shared_ptr<Order> order = it->second;
-        std::shared_ptr<PositionData> pos = instrumentId2PositionData.find(order->financialInstrumentId)->second;
-
-        bool added = pos->modifyPosition(order, modifyOrderQuantity.newQuantity, BUY_THRESHOLD, SELL_THRESHOLD);
-        if (added)
-        {
-            orderResponse.status = OrderResponse::Status::ACCEPTED;
-            std::cout << SUCC_ORDER_QUANTITY_MODIFIED << " ORDER_ID=" << order->orderId << " ORDER_QUANTITY=" << order->qty << std::endl;
-        }
-        else
-        {
-            orderResponse.status = OrderResponse::Status::REJECTED;
-            std::cout << WARN_MODIFY_ORDER_REJECTED << std::endl;
-        }
+        std::cerr << "ERR 00 <JOURNAL_FILE>" << std::endl;
+        exit(EXIT_FAILURE);
     }
+    double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startedAt).count();
+    printf("Journal restored %zu orders from snapshots and replayed %zu records in %.1f ms \n", restored, replayed, millis);
 }
 
 /*
-* Remove all order's of the user, rollback position data and delete the user's 
-* socket descriptor from the user id to order id map.
+* Load a limits file and swap it in for the current limits. Accounts move to
+* it at once, each engine between two of its messages, none of them locks.
 *
 * Parameters
 * ----------
-* socketDescriptor : uint64_t
-*     The client's socket descriptor.
+* path : std::string
+*     Path of the limits file.
+*
+* Returns
+* -------
+* reloaded : bool
+*     true if the file was loaded, false if it could not be read and the
+*     limits were left unchanged.
 */
-void RiskServer::removeUser(uint64_t socketDescriptor)
+bool RiskServer::reloadLimits(const std::string &path)
 {
-    for (uint64_t orderId : *userId2Order[socketDescriptor])
+    std::unique_ptr<RiskLimits> table(new RiskLimits(BUY_THRESHOLD, SELL_THRESHOLD));
+    if (!table->load(path))
+        return false;
+    std::lock_guard<std::mutex> lock(reloadMutex);
+    accounts.setLimits(table.get());
+    limits.publish(table.release());
+    return true;
+}
+
+/*
+* Reload the --limits file whenever its modification time, size or inode
+* changes (editors often replace the file), every limitsWatchSeconds.
+*/
+void RiskServer::watchLimits()
+{
+    struct stat status;
+#ifdef __APPLE__
+    auto signature = [&status]() { return std::make_tuple(status.st_mtimespec.tv_sec, status.st_mtimespec.tv_nsec, status.st_size, status.st_ino); };
+#else
+    auto signature = [&status]() { return std::make_tuple(status.st_mtim.tv_sec, status.st_mtim.tv_nsec, status.st_size, status.st_ino); };
+#endif
+    bool found = stat(options.limitsPath.c_str(), &status) == 0;
+    auto loaded = signature();
+
+    std::unique_lock<std::mutex> lock(watchMutex);
+    while (!watchCondition.wait_for(lock, std::chrono::seconds(options.limitsWatchSeconds), [this]() { return stopping; }))
     {
-        auto it = orderId2Order.find(orderId);
-        if (it != orderId2Order.end())
-        {
-            std::shared_ptr<Order> order = it->second;
-            std::shared_ptr<PositionData> pos = instrumentId2PositionData.find(order->financialInstrumentId)->second;
-            pos->rollbackPosition(order);
-            orderId2Order.erase(it);
-        }
+        if (stat(options.limitsPath.c_str(), &status) != 0 || (found && signature() == loaded))
+            continue;
+        found = true;
+        loaded = signature();
+        if (reloadLimits(options.limitsPath))
+            printf("Limits reloaded from %s, version %llu \n", options.limitsPath.c_str(), (unsigned long long)limits.version());
+        else
+            std::cerr << "ERR 00 <LIMITS_FILE>" << std::endl;
     }
-    auto it = userId2Order.find(socketDescriptor);
-    userId2Order.erase(it);
-}
\ No newline at end of file
+}
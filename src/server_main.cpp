@@ -1,5 +1,7 @@
 #include "../include/risk_server/server.hpp"
 
+#include <signal.h>
+
 /*
 * Main runner code for risk server.
 *
@@ -11,11 +13,60 @@
 *       uint64_t
 *   PORT
 *       uint64_t
+*
+* Options
+* -------
+*   --io=<epoll|select|io_uring>
+*       Notification backend for the event loop (default epoll on Linux).
+*   --io-sqpoll=<milliseconds>
+*       With io_uring, submit through a kernel polling thread which sleeps
+*       after this many idle milliseconds (default 0, no thread).
+*   --io-threads=<threads>
+*       Workers with their own SO_REUSEPORT listener, event loop and 
+*       connections (default 1).
+*   --backlog=<connections>
+*       Pending connections queued by each listener (default SOMAXCONN).
+*   --socket=<path>
+*       Unix socket served next to PORT, for clients on the same host.
+*   --log-level=<off|err|warn|succ|log>
+*       Highest level of records written by the logger thread (default log).
+*   --order-capacity=<orders>
+*       Number of open orders the order index is pre-sized for.
+*   --shards=<threads>
+*       Partition the risk engine by listing id over this many threads, fed
+*       by the I/O thread over lock-free queues (default 0, single-threaded).
+*   --universe=<path>
+*       File of tradable listing ids, one per line. Orders on any other
+*       listing are rejected (default: listings are registered on first use).
+*   --limits=<path>
+*       File of global, instrument, account and account x instrument buy and
+*       sell limits (default: the thresholds limit every instrument).
+*   --limits-watch=<seconds>
+*       How often the limits file is checked for changes, which are applied
+*       without a restart (default 1, 0 disables). The admin command
+*       reload-limits [path] reloads on demand.
+*   --admin-port=<port>
+*       Loopback port serving the metrics, as text commands or HTTP GET
+*       /metrics. Metrics are only recorded with an admin endpoint.
+*   --admin-socket=<path>
+*       Unix socket serving the same admin commands.
+*   --journal=<directory>
+*       Write-ahead journal of accepted orders, modifies, deletes and trades,
+*       replayed on startup to recover the risk state (default: none).
+*   --journal-sync=<batch|interval|none>
+*       When journal records are forced to disk: before the replies of each
+*       batch of messages are sent, periodically, or never (default batch).
+*   --journal-interval=<milliseconds>
+*       Sync period of --journal-sync=interval (default 10).
+*   --snapshot-interval=<seconds>
+*       Seconds between background snapshots of the journaled engines, which
+*       replace the journal records they cover (default 60, 0 disables).
 */
 int main(int argc, char *argv[])
 {
     uint64_t BUY_THRESHOLD, SELL_THRESHOLD;
     int PORT;
+    ServerOptions options;
     if (argc >= 4)
     {
         BUY_THRESHOLD = std::atoi(argv[1]);
@@ -28,7 +79,70 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    std::unique_ptr<RiskServer> server(new RiskServer(BUY_THRESHOLD, SELL_THRESHOLD, PORT));
+    for (int i = 4; i < argc; i++)
+    {
+        std::string option(argv[i]);
+        if (option == "--io=epoll")
+            options.ioBackend = IOBackend::EPOLL;
+        else if (option == "--io=select")
+            options.ioBackend = IOBackend::SELECT;
+        else if (option == "--io=io_uring")
+            options.ioBackend = IOBackend::IO_URING;
+        else if (option.rfind("--io-sqpoll=", 0) == 0)
+            options.sqPollMillis = std::strtoul(option.c_str() + strlen("--io-sqpoll="), NULL, 10);
+        else if (option.rfind("--io-threads=", 0) == 0)
+            options.ioThreads = std::strtoull(option.c_str() + strlen("--io-threads="), NULL, 10);
+        else if (option.rfind("--backlog=", 0) == 0)
+            options.backlog = std::atoi(option.c_str() + strlen("--backlog="));
+        else if (option.rfind("--socket=", 0) == 0)
+            options.socketPath = option.substr(strlen("--socket="));
+        else if (option == "--log-level=off")
+            Logger::instance().setLevel(LogLevel::OFF);
+        else if (option == "--log-level=err")
+            Logger::instance().setLevel(LogLevel::ERR);
+        else if (option == "--log-level=warn")
+            Logger::instance().setLevel(LogLevel::WARN);
+        else if (option == "--log-level=succ")
+            Logger::instance().setLevel(LogLevel::SUCC);
+        else if (option == "--log-level=log")
+            Logger::instance().setLevel(LogLevel::LOG);
+        else if (option.rfind("--order-capacity=", 0) == 0)
+            options.orderCapacity = std::strtoull(option.c_str() + strlen("--order-capacity="), NULL, 10);
+        else if (option.rfind("--shards=", 0) == 0)
+            options.shards = std::strtoull(option.c_str() + strlen("--shards="), NULL, 10);
+        else if (option.rfind("--universe=", 0) == 0)
+            options.universePath = option.substr(strlen("--universe="));
+        else if (option.rfind("--limits=", 0) == 0)
+            options.limitsPath = option.substr(strlen("--limits="));
+        else if (option.rfind("--limits-watch=", 0) == 0)
+            options.limitsWatchSeconds = std::strtoul(option.c_str() + strlen("--limits-watch="), NULL, 10);
+        else if (option.rfind("--admin-port=", 0) == 0)
+            options.adminPort = std::atoi(option.c_str() + strlen("--admin-port="));
+        else if (option.rfind("--admin-socket=", 0) == 0)
+            options.adminSocketPath = option.substr(strlen("--admin-socket="));
+        else if (option.rfind("--journal=", 0) == 0)
+            options.journal.directory = option.substr(strlen("--journal="));
+        else if (option == "--journal-sync=batch")
+            options.journal.sync = JournalSync::BATCH;
+        else if (option == "--journal-sync=interval")
+            options.journal.sync = JournalSync::INTERVAL;
+        else if (option == "--journal-sync=none")
+            options.journal.sync = JournalSync::NONE;
+        else if (option.rfind("--journal-interval=", 0) == 0)
+            options.journal.intervalMillis = std::max<uint32_t>(std::strtoul(option.c_str() + strlen("--journal-interval="), NULL, 10), 1);
+        else if (option.rfind("--snapshot-interval=", 0) == 0)
+            options.journal.snapshotSeconds = std::strtoul(option.c_str() + strlen("--snapshot-interval="), NULL, 10);
+        else
+        {
+            std::cerr << "Invalid option " << option << ". Valid options: --io=<epoll|select|io_uring> --io-sqpoll=<milliseconds> --io-threads=<threads> --backlog=<connections> --socket=<path> --log-level=<off|err|warn|succ|log> --order-capacity=<orders> --shards=<threads> --universe=<path> --limits=<path> --limits-watch=<seconds> --admin-port=<port> --admin-socket=<path> --journal=<directory> --journal-sync=<batch|interval|none> --journal-interval=<milliseconds> --snapshot-interval=<seconds>" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // A client closing mid-reply must not terminate the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    std::unique_ptr<RiskServer> server(new RiskServer(BUY_THRESHOLD, SELL_THRESHOLD, PORT, options));
     server->initListenerSocket();
 
     return 0;
@@ -0,0 +1,1142 @@
+#include "../include/risk_server/server_worker.hpp"
+
+#include "../include/risk_server/server.hpp"
+
+/*
+* Accept every pending connection on a listener, the master socket or the
+* Unix socket. Listeners are non-blocking so the accept queue is drained in
+* one pass, and on Linux accept4 returns the client socket already 
+* non-blocking. Out of descriptors, the spare one is released to accept and
+* close each pending connection: left in the queue, they would raise no new
+* edge with epoll and a level-triggered loop would spin on them.
+*
+* Parameters
+* ----------
+* listener : int
+*     The listening socket which became readable.
+*/
+void ServerWorker::acceptNewConnections(int listener)
+{
+    while (true)
+    {
+        struct sockaddr_storage address;
+        socklen_t addressLen = sizeof(address);
+#ifdef __linux__
+        int newSocket = accept4(listener, (struct sockaddr *)&address, &addressLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int newSocket = accept(listener, (struct sockaddr *)&address, &addressLen);
+        if (newSocket >= 0)
+            fcntl(newSocket, F_SETFL, fcntl(newSocket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+        if (newSocket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if ((errno == EMFILE || errno == ENFILE) && spareDescriptor >= 0)
+            {
+                // Logged once until connections are accepted again.
+                if (!descriptorsExhausted)
+                    std::cerr << "ERR 00 <DESCRIPTORS_EXHAUSTED>" << std::endl;
+                descriptorsExhausted = true;
+                close(spareDescriptor);
+                int shed = accept(listener, NULL, NULL);
+                if (shed >= 0)
+                    close(shed);
+                spareDescriptor = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if (shed >= 0)
+                    continue;
+                return;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                std::cerr << "ERR 00 <ACCEPTING_SOCKET>" << std::endl;
+            return;
+        }
+        descriptorsExhausted = false;
+        handleNewConnection(newSocket, address);
+    }
+}
+
+/*
+* Add a new user's connection to the client connections under a new session
+* id.
+*
+* Parameters
+* ----------
+* newSocket : uint64_t
+*     The client's socket descriptor.
+* address : sockaddr_storage
+*     The client's address details, AF_INET or AF_UNIX.
+*/
+void ServerWorker::addUser(uint64_t newSocket, const struct sockaddr_storage &address)
+{
+    Connection &connection = connections.emplace(newSocket, Connection(newSocket)).first->second;
+    connection.peer = address;
+    connection.session = server.newSession();
+    connection.account = server.accounts.findOrRegister(0);
+}
+
+/*
+* LOG user's client details, as accepted, remove user data from the server and close the 
+* connection to the socket descriptor.
+*
+* Parameters
+* ----------
+* socketDescriptor : int
+*     The client's socket descriptor.
+*/
+void ServerWorker::closeConnection(int socketDescriptor)
+{
+    eventLoop->remove(socketDescriptor);
+    auto it = connections.find(socketDescriptor);
+    if (it != connections.end())
+    {
+        logPeer(LogEvent::DISCONNECTED, socketDescriptor, it->second.peer);
+        removeUser(it->second.session);
+        connections.erase(it);
+    }
+    close(socketDescriptor);
+}
+
+/*
+* Fill the entry of a batch routed to the shards, and queue the batch's
+* response once it was the last one owed.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+* batch : uint32_t
+*     Id of the batch.
+* entry : uint16_t
+*     Index of the entry in the batch response.
+* orderResponse : OrderResponse
+*     Reference to the sub-message's response.
+*/
+void ServerWorker::completeBatchEntry(Connection &connection, uint32_t batch, uint16_t entry, const OrderResponse &orderResponse)
+{
+    auto it = connection.batches.find(batch);
+    if (it == connection.batches.end())
+        return;
+    PendingBatch &pendingBatch = it->second;
+    pendingBatch.entries[entry].orderId = orderResponse.orderId;
+    pendingBatch.entries[entry].status = (uint16_t)orderResponse.status;
+    if (--pendingBatch.remaining > 0)
+        return;
+
+    // Space was kept free when the batch was routed.
+    size_t entriesSize = pendingBatch.entries.size() * sizeof(BatchResponse::Entry);
+    size_t replySize = sizeof(Header) + sizeof(BatchResponse) + entriesSize;
+    if (connection.pendingSend() == 0 && metrics.enabled())
+        connection.firstUnsentAt = Metrics::now();
+    char *frame = connection.reserveSend(replySize);
+    Header responseHeader;
+    responseHeader.version = 0;
+    responseHeader.payloadSize = replySize - sizeof(Header);
+    responseHeader.sequenceNumber = pendingBatch.sequenceNumber;
+    responseHeader.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    BatchResponse batchResponse;
+    batchResponse.messageType = BatchResponse::MESSAGE_TYPE;
+    batchResponse.count = pendingBatch.entries.size();
+    std::memcpy(frame, &responseHeader, sizeof(Header));
+    std::memcpy(frame + sizeof(Header), &batchResponse, sizeof(BatchResponse));
+    std::memcpy(frame + sizeof(Header) + sizeof(BatchResponse), pendingBatch.entries.data(), entriesSize);
+    connection.commitSend(replySize);
+    connection.replyBytesInFlight -= replySize;
+    connection.batches.erase(it);
+    queueFlush(connection);
+}
+
+/*
+* Create the pipe through which the shards wake this worker's event loop.
+*/
+ShardWakeup *ServerWorker::createShardWakeup()
+{
+    shardWakeup.reset(new ShardWakeup());
+    return shardWakeup.get();
+}
+
+/*
+* Decode every complete Header + payload frame in the connection's receive
+* buffer, handle each message and build the reply in the send buffer if 
+* required. A trailing partial frame is kept in the buffer until the next 
+* readiness event. Decoding pauses when the send buffer is full.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+*/
+void ServerWorker::decodeFrames(Connection &connection)
+{
+    // The fields of every newly buffered NewOrder are checked at once, outside
+    // the engine lock.
+    validateOrders(connection);
+    size_t nextOrder = 0;
+
+    // Workers share the unsharded engine, it is held once per batch of frames.
+    std::unique_lock<std::mutex> engineLock(server.engineMutex, std::defer_lock);
+    if (server.engine && server.workers.size() > 1)
+        engineLock.lock();
+    if (server.engine)
+        server.engine->refreshLimits();
+
+    bool timed = metrics.enabled();
+    uint64_t decodedAt = timed ? Metrics::now() : 0;
+    // Frames after an accepted attach wait for the switch to its rings.
+    while (!connection.attached && connection.readable() >= sizeof(Header))
+    {
+        Header header;
+        std::memcpy(&header, connection.readPointer(), sizeof(Header));
+        size_t frameSize = sizeof(Header) + header.payloadSize;
+        if (connection.readable() < frameSize)
+            break;
+
+        char *payload = connection.readPointer() + sizeof(Header);
+        uint16_t messageType = 0;
+        if (header.payloadSize >= sizeof(messageType))
+            std::memcpy(&messageType, payload, sizeof(messageType));
+        int batchEntries = messageType == Batch::MESSAGE_TYPE ? batchReplies(payload, header.payloadSize) : 0;
+        size_t replySize = sizeof(Header) + sizeof(OrderResponse);
+        if (messageType == Batch::MESSAGE_TYPE)
+            replySize = sizeof(Header) + sizeof(BatchResponse) + std::max(batchEntries, 0) * sizeof(BatchResponse::Entry);
+
+        // Build the reply in place, decoding stops until writes drain if it 
+        // does not fit next to the replies still owed by shards.
+        char *frame = connection.reserveSend(connection.replyBytesInFlight + replySize);
+        if (frame == NULL)
+        {
+            connection.readPaused = true;
+            break;
+        }
+        Header *responseHeader = reinterpret_cast<Header *>(frame);
+        OrderResponse *orderResponse = reinterpret_cast<OrderResponse *>(frame + sizeof(Header));
+
+        if (timed)
+        {
+            metrics.countMessage(payload, header.payloadSize);
+            metrics.recordLatency(LatencyStage::RECEIVE_TO_DECODE, decodedAt - connection.receivedAt);
+        }
+        // The frame's NewOrders, if validated.
+        size_t firstOrder = nextOrder;
+        while (nextOrder < connection.orderOffsets.size() && connection.orderOffsets[nextOrder] < connection.recvHead + frameSize)
+            nextOrder++;
+        const Validity *validity = nextOrder > firstOrder ? &connection.orderValidity[firstOrder] : NULL;
+
+        bool reply = false;
+        if (messageType == Logon::MESSAGE_TYPE)
+            handleLogon(connection, payload, header);
+        else if (messageType == SharedMemoryAttach::MESSAGE_TYPE)
+            reply = handleSharedMemoryAttach(connection, *orderResponse, payload, header);
+        else if (messageType == Batch::MESSAGE_TYPE)
+            reply = handleBatch(connection, frame + sizeof(Header), payload, header, batchEntries, validity);
+        else
+        {
+            Validity checked = validity ? *validity : Validity::UNCHECKED;
+            reply = server.engine ? server.engine->handleMessage(connection.session, connection.account, *orderResponse, payload, header,
+                                                                 OrderDirectory::NO_CLAIM, checked)
+                                  : routeMessage(connection, *orderResponse, payload, header, 0, 0, checked);
+        }
+        connection.recvHead += frameSize;
+        connection.validated -= frameSize;
+
+        // Shards time their own risk checks.
+        if (timed)
+        {
+            uint64_t handledAt = Metrics::now();
+            if (server.engine)
+                metrics.recordLatency(LatencyStage::RISK_CHECK, handledAt - decodedAt);
+            decodedAt = handledAt;
+        }
+        if (reply)
+        {
+            if (timed)
+            {
+                if (messageType != Batch::MESSAGE_TYPE)
+                    metrics.countReply(orderResponse->status);
+                if (connection.pendingSend() == 0)
+                    connection.firstUnsentAt = decodedAt;
+            }
+            responseHeader->version = 0;
+            responseHeader->payloadSize = replySize - sizeof(Header);
+            responseHeader->sequenceNumber = header.sequenceNumber + 1;
+            responseHeader->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            connection.commitSend(replySize);
+        }
+    }
+    if (nextOrder > 0)
+    {
+        connection.orderOffsets.erase(connection.orderOffsets.begin(), connection.orderOffsets.begin() + nextOrder);
+        connection.orderValidity.erase(connection.orderValidity.begin(), connection.orderValidity.begin() + nextOrder);
+    }
+    connection.compact();
+    queueFlush(connection);
+}
+
+/*
+* Copy the replies produced by the shards into their connections' send 
+* buffers. Replies of connections closed in the meantime are dropped.
+*/
+void ServerWorker::deliverShardReplies()
+{
+    ShardReply reply;
+    for (auto &shard : server.shards)
+    {
+        while (shard->popReply(index, reply))
+        {
+            auto it = connections.find(reply.socketDescriptor);
+            if (it == connections.end() || it->second.session != reply.session)
+                continue;
+            Connection &connection = it->second;
+            if (reply.batch != 0)
+            {
+                completeBatchEntry(connection, reply.batch, reply.entry, reply.orderResponse);
+                continue;
+            }
+
+            // Space was kept free when the message was routed.
+            connection.replyBytesInFlight -= sizeof(Header) + sizeof(OrderResponse);
+            if (connection.pendingSend() == 0 && metrics.enabled())
+                connection.firstUnsentAt = Metrics::now();
+            char *frame = connection.reserveSend(sizeof(Header) + sizeof(OrderResponse));
+            std::memcpy(frame, &reply.header, sizeof(Header));
+            std::memcpy(frame + sizeof(Header), &reply.orderResponse, sizeof(OrderResponse));
+            connection.commitSend(sizeof(Header) + sizeof(OrderResponse));
+            queueFlush(connection);
+        }
+    }
+}
+
+/*
+* Send as much of the connection's pending replies as the socket accepts in
+* one syscall. Leftover bytes enable write readiness, and once the buffer 
+* drains any decoding paused by backpressure is resumed.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+*/
+void ServerWorker::flushConnection(Connection &connection)
+{
+    int socketDescriptor = connection.socketDescriptor;
+    while (connection.pendingSend() > 0)
+    {
+        // A full ring rings the doorbell once the client read from it.
+        if (connection.channel)
+        {
+            size_t sent = connection.channel->send(connection.sendPointer(), connection.pendingSend());
+            if (sent == 0)
+                break;
+            connection.sendHead += sent;
+            continue;
+        }
+        ssize_t sent = send(socketDescriptor, connection.sendPointer(), connection.pendingSend(), MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (sent < 0)
+        {
+            closeConnection(socketDescriptor);
+            return;
+        }
+        connection.sendHead += sent;
+    }
+    if (connection.pendingSend() == 0)
+    {
+        connection.sendHead = connection.sendTail = 0;
+        if (connection.firstUnsentAt != 0)
+        {
+            metrics.recordLatency(LatencyStage::REPLY_SEND, Metrics::now() - connection.firstUnsentAt);
+            connection.firstUnsentAt = 0;
+        }
+    }
+
+    bool resume = connection.readPaused && connection.pendingSend() == 0;
+    if (resume)
+        connection.readPaused = false;
+    // The client reads the answer to its attach before using the rings.
+    bool attach = connection.attached && connection.pendingSend() == 0;
+    if (attach)
+        connection.channel = std::move(connection.attached);
+    updateInterest(connection);
+    if (resume || attach)
+        handleClientSocketIO(socketDescriptor);
+}
+
+/*
+* Flush every connection that produced replies during this event loop pass.
+* Their sends go to the event loop as one batch, a single submission with
+* io_uring.
+*/
+void ServerWorker::flushPendingConnections()
+{
+    // Resumed connections may queue again, so batches repeat until none is.
+    while (!pendingFlush.empty())
+    {
+        flushing.swap(pendingFlush);
+        pendingFlush.clear();
+        sends.clear();
+        for (int socketDescriptor : flushing)
+        {
+            auto it = connections.find(socketDescriptor);
+            if (it == connections.end())
+                continue;
+            Connection &connection = it->second;
+            connection.flushQueued = false;
+            if (!connection.channel && connection.pendingSend() > 0)
+                sends.push_back({socketDescriptor, connection.sendPointer(), connection.pendingSend(), 0});
+        }
+        eventLoop->send(sends);
+
+        size_t next = 0;
+        for (int socketDescriptor : flushing)
+        {
+            auto it = connections.find(socketDescriptor);
+            if (it == connections.end())
+                continue;
+            if (next < sends.size() && sends[next].fd == socketDescriptor)
+            {
+                ssize_t result = sends[next++].result;
+                if (result > 0)
+                    it->second.sendHead += result;
+                else if (result < 0 && result != -EAGAIN && result != -EWOULDBLOCK && result != -EINTR)
+                {
+                    closeConnection(socketDescriptor);
+                    continue;
+                }
+            }
+            // Bookkeeping, and the rest of a partial send.
+            flushConnection(it->second);
+        }
+    }
+}
+
+/*
+* Handle a Batch frame: on the engine in one dispatch, or split over the
+* shards with every sub-message routed as a message of its own, the response
+* being sent once all of them were answered. A malformed batch is answered
+* with an empty response.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+* response : char*
+*     Space for the BatchResponse and its entries.
+* payload : char*
+*     The Batch payload, header.payloadSize bytes.
+* header : Header
+*     Reference to the decoded batch header.
+* replies : int
+*     Entries owed as counted by batchReplies, -1 if the batch is malformed.
+* validity : const Validity*
+*     Validity of each NewOrder of the batch, in order, NULL if unchecked.
+*
+* Returns
+* -------
+* reply : bool
+*     true if the response was built in place and must be sent, false if it
+*     is owed by the shards.
+*/
+bool ServerWorker::handleBatch(Connection &connection, char *response, char *payload, Header &header, int replies, const Validity *validity)
+{
+    BatchResponse batchResponse;
+    batchResponse.messageType = BatchResponse::MESSAGE_TYPE;
+    batchResponse.count = 0;
+    if (replies < 0)
+    {
+        logger.log(LogEvent::INVALID_DATA);
+        std::memcpy(response, &batchResponse, sizeof(BatchResponse));
+        return true;
+    }
+
+    BatchResponse::Entry *entries = reinterpret_cast<BatchResponse::Entry *>(response + sizeof(BatchResponse));
+    if (server.engine)
+    {
+        batchResponse.count = server.engine->handleBatch(connection.session, connection.account, payload, header, entries, validity);
+        if (metrics.enabled())
+        {
+            for (uint16_t i = 0; i < batchResponse.count; i++)
+                metrics.countReply((OrderResponse::Status)entries[i].status);
+        }
+    }
+    if (server.engine || replies == 0)
+    {
+        std::memcpy(response, &batchResponse, sizeof(BatchResponse));
+        return true;
+    }
+
+    uint32_t batch = connection.nextBatch++;
+    if (batch == 0)
+        batch = connection.nextBatch++;
+    PendingBatch &pendingBatch = connection.batches[batch];
+    pendingBatch.sequenceNumber = header.sequenceNumber + 1;
+    pendingBatch.remaining = replies;
+    pendingBatch.entries.resize(replies);
+    connection.replyBytesInFlight += sizeof(Header) + sizeof(BatchResponse) + replies * sizeof(BatchResponse::Entry);
+
+    Batch batchHeader;
+    std::memcpy(&batchHeader, payload, sizeof(Batch));
+    size_t offset = sizeof(Batch);
+    uint16_t entry = 0;
+    Header subHeader = header;
+    for (uint16_t i = 0; i < batchHeader.count; i++)
+    {
+        uint16_t messageType;
+        std::memcpy(&messageType, payload + offset, sizeof(messageType));
+        subHeader.payloadSize = batchedMessageSize(messageType);
+        Validity checked = Validity::UNCHECKED;
+        if (validity && messageType == NewOrder::MESSAGE_TYPE)
+            checked = *validity++;
+        OrderResponse orderResponse;
+        if (routeMessage(connection, orderResponse, payload + offset, subHeader, batch, entry, checked))
+            completeBatchEntry(connection, batch, entry, orderResponse);
+        entry += EngineMessages::at(messageType).replied;
+        offset += subHeader.payloadSize;
+    }
+    return false;
+}
+
+/*
+* Handle the socket operations for a ready client socket. Reads as many bytes
+* as the receive buffer can hold per syscall and decodes every complete frame,
+* until the socket is drained, as edge-triggered backends only notify once 
+* per burst.
+*
+* Parameters
+* ----------
+* socketDescriptor : int
+*     The client's socket descriptor.
+*/
+void ServerWorker::handleClientSocketIO(int socketDescriptor)
+{
+    auto it = connections.find(socketDescriptor);
+    if (it == connections.end())
+        return;
+    Connection &connection = it->second;
+    if (connection.channel)
+    {
+        handleSharedMemoryIO(connection);
+        return;
+    }
+
+    // Frames held back by send backpressure are decoded first.
+    decodeFrames(connection);
+    // The loop receives for the connection, resuming re-arms its recv.
+    if (eventLoop->receives())
+    {
+        updateInterest(connection);
+        return;
+    }
+    while (!connection.readPaused)
+    {
+        size_t writable = connection.writable();
+        ssize_t valread = read(socketDescriptor, connection.writePointer(), writable);
+
+        // Socket drained, wait for the next readiness event.
+        if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (valread < 0 && errno == EINTR)
+            continue;
+
+        // Check if client socket is closing.
+        if (valread <= 0)
+        {
+            closeConnection(socketDescriptor);
+            return;
+        }
+
+        connection.recvTail += valread;
+        if (metrics.enabled())
+            connection.receivedAt = Metrics::now();
+        decodeFrames(connection);
+
+        // A short read means the socket buffer was emptied.
+        if ((size_t)valread < writable)
+            break;
+    }
+
+    // Stop reading while decoding waits on writes to drain.
+    updateInterest(connection);
+}
+
+/*
+* Bind the connection's session to the account of a Logon. Orders already
+* open stay with the account they were accepted under.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+* payload : char*
+*     The Logon payload, header.payloadSize bytes.
+* header : Header
+*     Reference to the decoded message header.
+*/
+void ServerWorker::handleLogon(Connection &connection, char *payload, Header &header)
+{
+    if (header.payloadSize != sizeof(Logon))
+    {
+        logger.log(LogEvent::INVALID_DATA);
+        return;
+    }
+    Logon logon;
+    std::memcpy(&logon, payload, sizeof(Logon));
+    connection.account = server.accounts.findOrRegister(logon.account);
+}
+
+/*
+* Handle a new connection.
+*
+* Parameters
+* ----------
+* socketDescriptor : int
+*     The client's socket descriptor.
+* address : sockaddr_storage
+*     The client's address details, AF_INET or AF_UNIX.
+*/
+void ServerWorker::handleNewConnection(int newSocket, const struct sockaddr_storage &address)
+{
+    if (newSocket < 0)
+    {
+        std::cerr << "accept" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    logPeer(LogEvent::NEW_CONNECTION, newSocket, address);
+
+    // Replies are small frames, Nagle would hold them while earlier ones are
+    // unacknowledged.
+    if (address.ss_family == AF_INET)
+    {
+        int opt = 1;
+        setsockopt(newSocket, IPPROTO_TCP, TCP_NODELAY, (char *)&opt, sizeof(opt));
+    }
+
+    // select cannot watch descriptors beyond FD_SETSIZE.
+    if (!eventLoop->addConnection(newSocket))
+    {
+        std::cerr << "ERR 00 <SOCKET_LIMIT_REACHED> SOCK FD" << newSocket << std::endl;
+        close(newSocket);
+        return;
+    }
+    addUser(newSocket, address);
+}
+
+/*
+* Handle bytes the event loop received for a connection. Bytes still in
+* flight when reading paused grow the receive buffer if they do not fit.
+*
+* Parameters
+* ----------
+* socketDescriptor : int
+*     The client's socket descriptor.
+* data : const char*
+*     The bytes received.
+* size : ssize_t
+*     Number of bytes, 0 at end of stream or -errno.
+*/
+void ServerWorker::handleReceived(int socketDescriptor, const char *data, ssize_t size)
+{
+    auto it = connections.find(socketDescriptor);
+    if (it == connections.end())
+        return;
+    Connection &connection = it->second;
+    if (size <= 0)
+    {
+        closeConnection(socketDescriptor);
+        return;
+    }
+    // Doorbells, the frames are in the rings.
+    if (connection.channel)
+    {
+        handleSharedMemoryIO(connection);
+        return;
+    }
+
+    if (connection.writable() < (size_t)size)
+        connection.compact();
+    if (connection.writable() < (size_t)size)
+        connection.recvBuffer.resize(connection.recvTail + size);
+    std::memcpy(connection.writePointer(), data, size);
+    connection.recvTail += size;
+    if (metrics.enabled())
+        connection.receivedAt = Metrics::now();
+    decodeFrames(connection);
+    updateInterest(connection);
+}
+
+/*
+* Attach the shared memory segment a client created and answer whether the
+* connection moves to it. The connection switches once the answer left the
+* socket. Refused once replies were owed, as they would have to be sent on
+* the socket after the answer.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+* orderResponse : OrderResponse
+*     Reference to the answer, ACCEPTED if the segment was attached.
+* payload : char*
+*     The SharedMemoryAttach payload, header.payloadSize bytes.
+* header : Header
+*     Reference to the decoded message header.
+*
+* Returns
+* -------
+* reply : bool
+*     Always true, malformed and repeated attaches are answered REJECTED.
+*/
+bool ServerWorker::handleSharedMemoryAttach(Connection &connection, OrderResponse &orderResponse, char *payload, Header &header)
+{
+    // Malformed or repeated attaches are refused, the client waits on an answer.
+    if (header.payloadSize != sizeof(SharedMemoryAttach) || connection.channel)
+        logger.log(LogEvent::INVALID_DATA);
+    else if (connection.pendingSend() == 0 && connection.replyBytesInFlight == 0)
+    {
+        SharedMemoryAttach attach;
+        std::memcpy(&attach, payload, sizeof(SharedMemoryAttach));
+        connection.attached = SharedMemoryChannel::attach(connection.socketDescriptor, attach.name);
+    }
+
+    orderResponse.messageType = OrderResponse::MESSAGE_TYPE;
+    orderResponse.orderId = 0;
+    orderResponse.status = connection.attached ? OrderResponse::Status::ACCEPTED : OrderResponse::Status::REJECTED;
+    return true;
+}
+
+/*
+* Handle a ready socket of a connection moved to shared memory. The socket
+* only carries doorbells (and the client closing), the frames are read from
+* the segment's request ring until it is empty, which arms the doorbell for
+* the next ones. Replies waiting for ring space are flushed again.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+*/
+void ServerWorker::handleSharedMemoryIO(Connection &connection)
+{
+    if (!connection.channel->clearDoorbells())
+    {
+        closeConnection(connection.socketDescriptor);
+        return;
+    }
+    queueFlush(connection);
+
+    decodeFrames(connection);
+    while (!connection.readPaused)
+    {
+        size_t received = connection.channel->receive(connection.writePointer(), connection.writable());
+        if (received == 0)
+            break;
+        connection.recvTail += received;
+        if (metrics.enabled())
+            connection.receivedAt = Metrics::now();
+        decodeFrames(connection);
+    }
+    updateInterest(connection);
+}
+
+/*
+* Initialize a master socket and address, bind socket to PORT and create the
+* worker's event loop, which also watches the server's Unix socket if any.
+*
+* Parameters
+* ----------
+* reusePort : bool
+*     true to share PORT with the listeners of the other workers.
+*/
+void ServerWorker::initListenerSocket(bool reusePort)
+{
+    int opt = 1;
+    // Create and set master socket to allow multiple connections.
+    if ((masterSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        std::cerr << "socket failed" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (setsockopt(masterSocket, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt)) < 0)
+    {
+        std::cerr << "setsockopt" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (reusePort && setsockopt(masterSocket, SOL_SOCKET, SO_REUSEPORT, (char *)&opt, sizeof(opt)) < 0)
+    {
+        std::cerr << "ERR 00 <MASTER_SOCKET_REUSEPORT>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // TCP socket.
+    struct sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(server.PORT);
+
+    // Bind the socket to PORT.
+    if (bind(masterSocket, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        std::cerr << "ERR 00 <MASTER_SOCKET_BINDING>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (listen(masterSocket, server.options.backlog) < 0)
+    {
+        std::cerr << "ERR 00 <MASTER_SOCKET_LISTEN>" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Non-blocking master socket so pending connections can be accepted in bulk.
+    fcntl(masterSocket, F_SETFL, fcntl(masterSocket, F_GETFL, 0) | O_NONBLOCK);
+    spareDescriptor = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    eventLoop = EventLoop::create(server.options.ioBackend, server.options.sqPollMillis);
+    eventLoop->add(masterSocket);
+    if (server.unixSocket >= 0)
+        eventLoop->add(server.unixSocket);
+    if (shardWakeup)
+        eventLoop->add(shardWakeup->descriptor());
+}
+
+/*
+* Log a connection event with the peer's address and port. Other peers, the
+* clients of the Unix socket, are logged by address family, as the negated
+* family in place of the port.
+*
+* Parameters
+* ----------
+* event : LogEvent
+*     NEW_CONNECTION or DISCONNECTED.
+* socketDescriptor : int
+*     The client's socket descriptor.
+* address : sockaddr_storage
+*     The client's address details.
+*/
+void ServerWorker::logPeer(LogEvent event, int socketDescriptor, const struct sockaddr_storage &address)
+{
+    if (address.ss_family != AF_INET)
+    {
+        logger.log(event, socketDescriptor, 0, -(int64_t)address.ss_family);
+        return;
+    }
+    const struct sockaddr_in &inet = reinterpret_cast<const struct sockaddr_in &>(address);
+    logger.log(event, socketDescriptor, inet.sin_addr.s_addr, ntohs(inet.sin_port));
+}
+
+/*
+* Queue the connection to be flushed at the end of the event loop pass if it
+* has pending replies.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+*/
+void ServerWorker::queueFlush(Connection &connection)
+{
+    // Replies are flushed once at the end of the event loop pass.
+    if (connection.pendingSend() > 0 && !connection.flushQueued)
+    {
+        connection.flushQueued = true;
+        pendingFlush.push_back(connection.socketDescriptor);
+    }
+}
+
+/*
+* Remove all orders of a closed session, on every shard when sharded.
+*
+* Parameters
+* ----------
+* session : uint64_t
+*     The client's session id.
+*/
+void ServerWorker::removeUser(uint64_t session)
+{
+    if (server.engine)
+    {
+        std::lock_guard<std::mutex> lock(server.engineMutex);
+        server.engine->removeUser(session);
+        return;
+    }
+
+    ShardRequest request;
+    request.kind = ShardRequest::Kind::CLOSE_SESSION;
+    request.session = session;
+    for (uint32_t shard = 0; shard < server.shards.size(); shard++)
+        routeToShard(shard, request);
+}
+
+/*
+* Route a message to the shard owning it. NewOrder and Trade messages go to
+* the shard of their listing, Delete and Modify messages to the shard found
+* in the order directory. A NewOrder claims its order id in the directory 
+* first so duplicates are rejected here, as are NewOrders which failed
+* validation, and messages which cannot be routed are left to shard 0 to log
+* and reject.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+* orderResponse : OrderResponse
+*     Reference to the order response to update if rejected here.
+* buffer : char*
+*     The message payload, header.payloadSize bytes.
+* header : Header
+*     Reference to the decoded message header.
+* batch : uint32_t
+*     Id of the connection's batch the message belongs to, 0 if none.
+* entry : uint16_t
+*     The message's entry in the batch response.
+* validity : Validity
+*     A NewOrder's validity if validateOrders checked it, UNCHECKED
+*     otherwise.
+*
+* Returns
+* -------
+* reply : bool
+*     true if the message was rejected here and the response must be sent,
+*     false if the shard replies if required.
+*/
+bool ServerWorker::routeMessage(Connection &connection, OrderResponse &orderResponse, char *buffer, Header &header, uint32_t batch, uint16_t entry,
+                                Validity validity)
+{
+    ShardRequest request;
+    request.socketDescriptor = connection.socketDescriptor;
+    request.batch = batch;
+    request.entry = entry;
+    request.validity = validity;
+    request.session = connection.session;
+    request.account = connection.account;
+    request.header = header;
+    std::memcpy(request.payload, buffer, std::min<size_t>(header.payloadSize, sizeof(request.payload)));
+
+    uint16_t messageType = 0;
+    if (header.payloadSize >= sizeof(uint16_t))
+        std::memcpy(&messageType, buffer, sizeof(messageType));
+
+    uint32_t shard = 0;
+    if (messageType == NewOrder::MESSAGE_TYPE && header.payloadSize == sizeof(NewOrder))
+    {
+        NewOrder newOrder;
+        std::memcpy(&newOrder, buffer, sizeof(NewOrder));
+        shard = server.shardFor(newOrder.listingId);
+        if (validity == Validity::INVALID)
+        {
+            orderResponse.messageType = OrderResponse::MESSAGE_TYPE;
+            orderResponse.orderId = newOrder.orderId;
+            orderResponse.status = OrderResponse::Status::REJECTED;
+            logger.log(LogEvent::INVALID_DATA, newOrder.orderId, newOrder.listingId, newOrder.orderQuantity);
+            return true;
+        }
+        if (newOrder.orderPrice > 0 && newOrder.orderQuantity > 0)
+        {
+            request.claim = server.directory.claim(newOrder.orderId, shard);
+            if (request.claim == OrderDirectory::NO_CLAIM)
+            {
+                orderResponse.messageType = OrderResponse::MESSAGE_TYPE;
+                orderResponse.orderId = newOrder.orderId;
+                orderResponse.status = OrderResponse::Status::REJECTED;
+                logger.log(LogEvent::ORDER_ALREADY_EXISTS, newOrder.orderId, newOrder.listingId, newOrder.orderQuantity);
+                return true;
+            }
+        }
+    }
+    else if (messageType == DeleteOrder::MESSAGE_TYPE && header.payloadSize == sizeof(DeleteOrder))
+    {
+        DeleteOrder deleteOrder;
+        std::memcpy(&deleteOrder, buffer, sizeof(DeleteOrder));
+        server.directory.erase(deleteOrder.orderId, shard);
+    }
+    else if (messageType == ModifyOrderQuantity::MESSAGE_TYPE && header.payloadSize == sizeof(ModifyOrderQuantity))
+    {
+        ModifyOrderQuantity modifyOrderQuantity;
+        std::memcpy(&modifyOrderQuantity, buffer, sizeof(ModifyOrderQuantity));
+        server.directory.find(modifyOrderQuantity.orderId, shard);
+    }
+    else if (messageType == Trade::MESSAGE_TYPE && header.payloadSize == sizeof(Trade))
+    {
+        Trade trade;
+        std::memcpy(&trade, buffer, sizeof(Trade));
+        shard = server.shardFor(trade.listingId);
+    }
+
+    // Shards reply to every NewOrder and Modify, valid or not. A batch kept
+    // the space of its whole response.
+    if (batch == 0 && EngineMessages::at(messageType).replied)
+        connection.replyBytesInFlight += sizeof(Header) + sizeof(OrderResponse);
+    routeToShard(shard, request);
+    return false;
+}
+
+/*
+* Queue a request on a shard. While the shard's ring is full its replies are
+* drained, so a shard blocked on a full reply ring always makes progress.
+*
+* Parameters
+* ----------
+* shard : uint32_t
+*     Index of the shard.
+* request : ShardRequest
+*     Reference to the request to queue.
+*/
+void ServerWorker::routeToShard(uint32_t shard, const ShardRequest &request)
+{
+    while (!server.shards[shard]->push(index, request))
+    {
+        deliverShardReplies();
+        std::this_thread::yield();
+    }
+}
+
+/*
+* Listen master and client sockets for activity and handle any connections/
+* operations.
+*/
+void ServerWorker::run()
+{
+    std::vector<IOEvent> events;
+    while (true)
+    {
+        // Wait indefinitely for an activity on one of the registered sockets.
+        int activity = eventLoop->wait(events);
+
+        // Invalid socket selected.
+        if ((activity < 0) && (errno != EINTR))
+        {
+            std::cerr << "ERR 00 <SELECTING_SOCKET>" << std::endl;
+        }
+
+        for (const IOEvent &event : events)
+        {
+            // If new connection on master socket or Unix socket...
+            if (event.fd == masterSocket || event.fd == server.unixSocket)
+            {
+                acceptNewConnections(event.fd);
+                continue;
+            }
+
+            // Shards queued replies, they are delivered below.
+            if (shardWakeup && event.fd == shardWakeup->descriptor())
+            {
+                shardWakeup->clear();
+                continue;
+            }
+
+            // Bytes the loop received for a connection.
+            if (event.received)
+            {
+                handleReceived(event.fd, event.data, event.size);
+                continue;
+            }
+
+            // Drain pending replies of a client socket that became writable.
+            if (event.writable)
+            {
+                auto it = connections.find(event.fd);
+                if (it != connections.end())
+                    flushConnection(it->second);
+            }
+
+            // Handle IO operations for the ready client socket.
+            if (event.readable)
+                handleClientSocketIO(event.fd);
+        }
+
+        // Send all replies produced in this pass, one syscall per connection,
+        // once the journal records of the engine's messages are committed.
+        deliverShardReplies();
+        Journal *journal = server.engine ? server.engine->getJournal() : NULL;
+        if (journal != NULL)
+            journal->commit();
+        flushPendingConnections();
+
+        // Snapshots of the shared engine are forked between its messages.
+        if (journal != NULL && journal->snapshotDue())
+        {
+            std::unique_lock<std::mutex> engineLock(server.engineMutex, std::defer_lock);
+            if (server.workers.size() > 1)
+                engineLock.lock();
+            server.engine->snapshotIfDue();
+        }
+    }
+}
+
+/*
+* Update the readiness the connection is watched for: read unless paused by
+* send backpressure, write while replies are pending. Connections moved to
+* shared memory are always read, their doorbells resume them.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+*/
+void ServerWorker::updateInterest(Connection &connection)
+{
+    bool readInterest = !connection.readPaused || connection.channel;
+    bool writeInterest = connection.pendingSend() > 0 && !connection.channel;
+    if (readInterest == connection.readInterest && writeInterest == connection.writeInterest)
+        return;
+
+    connection.readInterest = readInterest;
+    connection.writeInterest = writeInterest;
+    eventLoop->modify(connection.socketDescriptor, readInterest, writeInterest);
+}
+
+/*
+* Validate the NewOrders of every complete frame received since the last
+* call, single or batched, in one OrderValidator call, so the vector lanes
+* are filled across frames. Frames already validated but not yet decoded,
+* held back by send backpressure, keep their results. Malformed frames and
+* batches are left to the decoder.
+*
+* Parameters
+* ----------
+* connection : Connection
+*     Reference to the client's connection.
+*/
+void ServerWorker::validateOrders(Connection &connection)
+{
+    size_t first = connection.orderOffsets.size();
+    const char *base = connection.recvBuffer.data();
+    size_t offset = connection.recvHead + connection.validated;
+    while (connection.recvTail - offset >= sizeof(Header))
+    {
+        Header header;
+        std::memcpy(&header, base + offset, sizeof(Header));
+        size_t frameSize = sizeof(Header) + header.payloadSize;
+        if (connection.recvTail - offset < frameSize)
+            break;
+
+        const char *payload = base + offset + sizeof(Header);
+        uint16_t messageType = 0;
+        if (header.payloadSize >= sizeof(messageType))
+            std::memcpy(&messageType, payload, sizeof(messageType));
+        if (messageType == NewOrder::MESSAGE_TYPE && header.payloadSize == sizeof(NewOrder))
+            connection.orderOffsets.push_back(payload - base);
+        else if (messageType == Batch::MESSAGE_TYPE && batchReplies(payload, header.payloadSize) >= 0)
+        {
+            Batch batch;
+            std::memcpy(&batch, payload, sizeof(Batch));
+            size_t subOffset = sizeof(Batch);
+            for (uint16_t i = 0; i < batch.count; i++)
+            {
+                std::memcpy(&messageType, payload + subOffset, sizeof(messageType));
+                if (messageType == NewOrder::MESSAGE_TYPE)
+                    connection.orderOffsets.push_back(payload + subOffset - base);
+                subOffset += batchedMessageSize(messageType);
+            }
+        }
+        offset += frameSize;
+    }
+    connection.validated = offset - connection.recvHead;
+    connection.orderValidity.resize(connection.orderOffsets.size());
+    OrderValidator::validate(base, connection.orderOffsets.data() + first, connection.orderOffsets.size() - first,
+                             connection.orderValidity.data() + first);
+}
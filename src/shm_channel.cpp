@@ -0,0 +1,298 @@
+#include "../include/risk_server/shm_channel.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <netinet/in.h>
+#include <new>
+#include <stdio.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/*
+* Copy up to size buffered bytes out of a ring. Head and tail may have been
+* written by a misbehaving peer, the count is bounded by the ring so a copy
+* never leaves the segment.
+*/
+static size_t readRing(SharedMemoryRing &ring, char *buffer, size_t size)
+{
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t buffered = ring.tail.load(std::memory_order_acquire) - head;
+    size_t count = std::min<uint64_t>(std::min<uint64_t>(buffered, size), SharedMemoryRing::CAPACITY);
+    size_t start = head & (SharedMemoryRing::CAPACITY - 1);
+    size_t first = std::min(count, SharedMemoryRing::CAPACITY - start);
+    std::memcpy(buffer, ring.data + start, first);
+    std::memcpy(buffer + first, ring.data, count - first);
+    // Ordered before the load of writerWaiting that follows.
+    if (count > 0)
+        ring.head.store(head + count, std::memory_order_seq_cst);
+    return count;
+}
+
+/*
+* Copy as many bytes as fit into a ring.
+*/
+static size_t writeRing(SharedMemoryRing &ring, const char *buffer, size_t size)
+{
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t buffered = tail - ring.head.load(std::memory_order_acquire);
+    size_t count = buffered >= SharedMemoryRing::CAPACITY ? 0 : std::min<uint64_t>(SharedMemoryRing::CAPACITY - buffered, size);
+    size_t start = tail & (SharedMemoryRing::CAPACITY - 1);
+    size_t first = std::min(count, SharedMemoryRing::CAPACITY - start);
+    std::memcpy(ring.data + start, buffer, first);
+    std::memcpy(ring.data, buffer + first, count - first);
+    // Ordered before the load of readerWaiting that follows.
+    if (count > 0)
+        ring.tail.store(tail + count, std::memory_order_seq_cst);
+    return count;
+}
+
+/*
+* Find the user on the other end of a connection: SO_PEERCRED on a Unix
+* socket, which also gives the process, and the kernel's socket table on
+* loopback TCP, the way identd does. Unknown on other platforms.
+*
+* Parameters
+* ----------
+* socketDescriptor : int
+*     The connected socket.
+* uid : uid_t
+*     Set to the peer's user.
+* pid : pid_t
+*     Set to the peer's process, 0 if unknown.
+*
+* Returns
+* -------
+* found : bool
+*     false if the peer cannot be identified.
+*/
+static bool peerCredentials(int socketDescriptor, uid_t &uid, pid_t &pid)
+{
+#ifdef __linux__
+    struct sockaddr_storage local, peer;
+    socklen_t localLength = sizeof(local), peerLength = sizeof(peer);
+    if (getsockname(socketDescriptor, (struct sockaddr *)&local, &localLength) < 0 ||
+        getpeername(socketDescriptor, (struct sockaddr *)&peer, &peerLength) < 0)
+        return false;
+    if (local.ss_family == AF_UNIX)
+    {
+        struct ucred credentials;
+        socklen_t length = sizeof(credentials);
+        if (getsockopt(socketDescriptor, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0)
+            return false;
+        uid = credentials.uid;
+        pid = credentials.pid;
+        return true;
+    }
+    if (local.ss_family != AF_INET)
+        return false;
+
+    // The peer's own socket is the row bound to its address and connected to ours.
+    const struct sockaddr_in &ours = reinterpret_cast<const struct sockaddr_in &>(local);
+    const struct sockaddr_in &theirs = reinterpret_cast<const struct sockaddr_in &>(peer);
+    std::ifstream table("/proc/net/tcp");
+    std::string row;
+    std::getline(table, row);
+    while (std::getline(table, row))
+    {
+        unsigned int localAddress, localPort, remoteAddress, remotePort, owner;
+        if (sscanf(row.c_str(), " %*u: %x:%x %x:%x %*x %*x:%*x %*x:%*x %*x %u", &localAddress, &localPort, &remoteAddress, &remotePort,
+                   &owner) != 5)
+            continue;
+        if (localAddress == theirs.sin_addr.s_addr && localPort == ntohs(theirs.sin_port) && remoteAddress == ours.sin_addr.s_addr &&
+            remotePort == ntohs(ours.sin_port))
+        {
+            uid = owner;
+            pid = 0;
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+SharedMemoryChannel::~SharedMemoryChannel()
+{
+    munmap(segment, sizeof(SharedMemorySegment));
+}
+
+/*
+* Map the segment a client created, on the server side of its connection.
+* The segment must belong to the peer's user, and its name carry the peer's
+* process when that is known, so a client cannot attach another's segment.
+*
+* Parameters
+* ----------
+* socketDescriptor : int
+*     The client's socket, doorbells are rung on it.
+* name : const char*
+*     Name of the segment, NUL-terminated within NAME_SIZE bytes.
+*
+* Returns
+* -------
+* channel : std::unique_ptr<SharedMemoryChannel>
+*     The attached channel, NULL if the segment cannot be mapped, is not a
+*     segment of this transport or does not belong to the peer.
+*/
+std::unique_ptr<SharedMemoryChannel> SharedMemoryChannel::attach(int socketDescriptor, const char *name)
+{
+    std::unique_ptr<SharedMemoryChannel> channel;
+    if (strnlen(name, NAME_SIZE) == NAME_SIZE || strncmp(name, "/risk-", strlen("/risk-")) != 0)
+        return channel;
+    uid_t uid;
+    pid_t pid;
+    int creator = 0;
+    if (!peerCredentials(socketDescriptor, uid, pid) || sscanf(name, "/risk-%d-", &creator) != 1 || (pid != 0 && creator != pid))
+        return channel;
+    int descriptor = shm_open(name, O_RDWR, 0);
+    if (descriptor < 0)
+        return channel;
+    struct stat status;
+    void *address = MAP_FAILED;
+    if (fstat(descriptor, &status) == 0 && status.st_uid == uid && (size_t)status.st_size == sizeof(SharedMemorySegment))
+        address = mmap(NULL, sizeof(SharedMemorySegment), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (address == MAP_FAILED)
+        return channel;
+
+    SharedMemorySegment *segment = static_cast<SharedMemorySegment *>(address);
+    if (segment->magic != SharedMemorySegment::MAGIC || segment->capacity != SharedMemoryRing::CAPACITY)
+    {
+        munmap(address, sizeof(SharedMemorySegment));
+        return channel;
+    }
+    channel.reset(new SharedMemoryChannel(socketDescriptor, segment, true));
+    return channel;
+}
+
+/*
+* Discard the doorbells rung on the socket, without blocking.
+*
+* Returns
+* -------
+* open : bool
+*     false once the peer closed the connection.
+*/
+bool SharedMemoryChannel::clearDoorbells()
+{
+    char doorbells[64];
+    while (true)
+    {
+        ssize_t received = recv(socketDescriptor, doorbells, sizeof(doorbells), MSG_DONTWAIT);
+        if (received > 0)
+            continue;
+        if (received < 0 && errno == EINTR)
+            continue;
+        return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+/*
+* Create a segment for a connection, on the client side. The server attaches
+* it by name, the client unlinks it once attached.
+*
+* Parameters
+* ----------
+* socketDescriptor : int
+*     The connection's socket, doorbells are rung on it.
+* name : std::string
+*     Set to the segment's name.
+*
+* Returns
+* -------
+* channel : std::unique_ptr<SharedMemoryChannel>
+*     The new channel, NULL if no segment could be created.
+*/
+std::unique_ptr<SharedMemoryChannel> SharedMemoryChannel::create(int socketDescriptor, std::string &name)
+{
+    static std::atomic<uint32_t> created{0};
+    char path[NAME_SIZE];
+    snprintf(path, sizeof(path), "/risk-%d-%u", (int)getpid(), created.fetch_add(1, std::memory_order_relaxed));
+    name = path;
+
+    std::unique_ptr<SharedMemoryChannel> channel;
+    int descriptor = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (descriptor < 0)
+        return channel;
+    void *address = MAP_FAILED;
+    if (ftruncate(descriptor, sizeof(SharedMemorySegment)) == 0)
+        address = mmap(NULL, sizeof(SharedMemorySegment), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (address == MAP_FAILED)
+    {
+        shm_unlink(path);
+        return channel;
+    }
+    channel.reset(new SharedMemoryChannel(socketDescriptor, new (address) SharedMemorySegment(), false));
+    return channel;
+}
+
+/*
+* Read up to size bytes from the inbound ring. Finding it empty arms the
+* peer's doorbell, so a caller may sleep on the socket until it rings.
+*
+* Returns
+* -------
+* received : size_t
+*     Number of bytes read, 0 if the ring is empty.
+*/
+size_t SharedMemoryChannel::receive(char *buffer, size_t size)
+{
+    size_t received = readRing(inbound, buffer, size);
+    if (received == 0 && size > 0)
+    {
+        // Re-checked, the peer may have written before it saw the flag.
+        inbound.readerWaiting.store(1, std::memory_order_seq_cst);
+        received = readRing(inbound, buffer, size);
+        if (received > 0)
+            inbound.readerWaiting.store(0, std::memory_order_relaxed);
+    }
+    if (received > 0 && inbound.writerWaiting.load(std::memory_order_seq_cst) != 0 && inbound.writerWaiting.exchange(0) != 0)
+        ringDoorbell();
+    return received;
+}
+
+/*
+* Send a doorbell byte to the peer. A full socket means doorbells are already
+* pending, so the byte can be dropped.
+*/
+void SharedMemoryChannel::ringDoorbell()
+{
+    char doorbell = 0;
+    while (::send(socketDescriptor, &doorbell, 1, MSG_NOSIGNAL | MSG_DONTWAIT) < 0 && errno == EINTR)
+        ;
+}
+
+/*
+* Write as many of the bytes as the outbound ring has room for. Not writing
+* them all arms the peer's doorbell, rung once it frees space.
+*
+* Returns
+* -------
+* sent : size_t
+*     Number of bytes written.
+*/
+size_t SharedMemoryChannel::send(const char *buffer, size_t size)
+{
+    size_t sent = writeRing(outbound, buffer, size);
+    if (sent < size)
+    {
+        outbound.writerWaiting.store(1, std::memory_order_seq_cst);
+        sent += writeRing(outbound, buffer + sent, size - sent);
+        if (sent == size)
+            outbound.writerWaiting.store(0, std::memory_order_relaxed);
+    }
+    if (sent > 0 && outbound.readerWaiting.load(std::memory_order_seq_cst) != 0 && outbound.readerWaiting.exchange(0) != 0)
+        ringDoorbell();
+    return sent;
+}
@@ -1,9 +1,13 @@
 // Cover the initial test case and edge cases
+#include "../include/risk_server/async_client.hpp"
 #include "../include/risk_server/client.hpp"
 #include <iostream>
 #include <assert.h>
 
 #define PORT 51717
+// The server must be started with --socket=SOCKET_PATH and
+// --limits=tests/limits.txt.
+#define SOCKET_PATH "/tmp/risk_server_test.sock"
 
 
 /*  
@@ -149,10 +153,549 @@ void test_modifyNonExistingOrder(std::shared_ptr<RiskClient> client) {
     std::cout << "PASSED!" << std::endl;
 }
 
+void test_newOrder64BitId(std::shared_ptr<RiskClient> client) {
+    std::cout << "TEST NEW ORDER ID ALIASING AN EXISTING ID IN 32 BITS <ACCEPTED>" << std::endl;
+    u_long headerSize = sizeof(Header);
+    Header header;
+    NewOrder order;
+
+    // Order id 13 already exists, (1 << 32) + 13 must not collide with it.
+    helper_createNewOrder(header, order, 4, (1ULL << 32) + 13, 1, 10'0000, 'S');
+
+    char *message = new char[headerSize + header.payloadSize];
+    std::memcpy(message, &header, headerSize);
+    std::memcpy(message + headerSize, &order, header.payloadSize);
+
+    assert(client->sendMessage(header, message, true));
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_newOrderNotionalOverflow(std::shared_ptr<RiskClient> client) {
+    std::cout << "TEST NEW ORDER NOTIONAL ABOVE 2^63 - 1 <REJECTED>" << std::endl;
+    u_long headerSize = sizeof(Header);
+    Header header;
+    NewOrder order;
+
+    // 4 x 2^62 overflows int64_t although quantity and price are valid.
+    helper_createNewOrder(header, order, 4, 14, 4, 1ULL << 62, 'B');
+
+    char *message = new char[headerSize + header.payloadSize];
+    std::memcpy(message, &header, headerSize);
+    std::memcpy(message + headerSize, &order, header.payloadSize);
+
+    assert(!client->sendMessage(header, message, true));
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_newOrderInvalidSide(std::shared_ptr<RiskClient> client) {
+    std::cout << "TEST NEW ORDER SIDE NEITHER BUY NOR SELL <REJECTED>" << std::endl;
+    u_long headerSize = sizeof(Header);
+    Header header;
+    NewOrder order;
+
+    helper_createNewOrder(header, order, 4, 15, 5, 10'0000, 'X');
+
+    char *message = new char[headerSize + header.payloadSize];
+    std::memcpy(message, &header, headerSize);
+    std::memcpy(message + headerSize, &order, header.payloadSize);
+
+    assert(!client->sendMessage(header, message, true));
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_splitAndPipelinedFrames(std::shared_ptr<RiskClient> client) {
+    std::cout << "TEST NEW ORDER SPLIT ACROSS SENDS <ACCEPTED>" << std::endl;
+    u_long headerSize = sizeof(Header);
+    Header header;
+    NewOrder order;
+
+    helper_createNewOrder(header, order, 3, 21, 5, 10'0000, 'B');
+
+    char *message = new char[headerSize + header.payloadSize];
+    std::memcpy(message, &header, headerSize);
+    std::memcpy(message + headerSize, &order, header.payloadSize);
+
+    // Send the header alone, then the payload, the server must reassemble the frame.
+    Header headerOnly = header;
+    headerOnly.payloadSize = 0;
+    client->sendMessage(headerOnly, message, false);
+    usleep(50'000);
+    Header payloadOnly = header;
+    payloadOnly.payloadSize = header.payloadSize - headerSize;
+    assert(client->sendMessage(payloadOnly, message + headerSize, true));
+    std::cout << "PASSED!" << std::endl;
+
+    std::cout << "TEST PIPELINED NEW ORDER AND DELETE IN ONE SEND <ACCEPTED>" << std::endl;
+    Header header2;
+    NewOrder order2;
+    Header header3;
+    DeleteOrder order3;
+
+    helper_createNewOrder(header2, order2, 3, 22, 5, 10'0000, 'S');
+    helper_deleteOrder(header3, order3, 22);
+
+    u_long frame2Size = headerSize + header2.payloadSize;
+    u_long frame3Size = headerSize + header3.payloadSize;
+    message = new char[frame2Size + frame3Size];
+    std::memcpy(message, &header2, headerSize);
+    std::memcpy(message + headerSize, &order2, header2.payloadSize);
+    std::memcpy(message + frame2Size, &header3, headerSize);
+    std::memcpy(message + frame2Size + headerSize, &order3, header3.payloadSize);
+
+    Header pipelined = header2;
+    pipelined.payloadSize = frame2Size + frame3Size - headerSize;
+    assert(client->sendMessage(pipelined, message, true));
+    std::cout << "PASSED!" << std::endl;
+
+    std::cout << "TEST NEW ORDER REUSING DELETED PIPELINED ID <ACCEPTED>" << std::endl;
+    Header header4;
+    NewOrder order4;
+
+    helper_createNewOrder(header4, order4, 3, 22, 5, 10'0000, 'S');
+
+    message = new char[headerSize + header4.payloadSize];
+    std::memcpy(message, &header4, headerSize);
+    std::memcpy(message + headerSize, &order4, header4.payloadSize);
+
+    assert(client->sendMessage(header4, message, true));
+    std::cout << "PASSED!" << std::endl;
+
+    std::cout << "TEST NEW ORDER THEN INVALID ONE SPLIT ACROSS SENDS <ACCEPTED, REJECTED>" << std::endl;
+    Header header5, header6;
+    NewOrder order5, order6;
+
+    helper_createNewOrder(header5, order5, 3, 23, 5, 10'0000, 'B');
+    helper_createNewOrder(header6, order6, 3, 24, 5, 10'0000, 'X');
+
+    u_long frame5Size = headerSize + header5.payloadSize;
+    u_long frame6Size = headerSize + header6.payloadSize;
+    message = new char[frame5Size + frame6Size];
+    std::memcpy(message, &header5, headerSize);
+    std::memcpy(message + headerSize, &order5, header5.payloadSize);
+    std::memcpy(message + frame5Size, &header6, headerSize);
+    std::memcpy(message + frame5Size + headerSize, &order6, header6.payloadSize);
+
+    // The second frame completes on a later read, validated after the first.
+    u_long split = frame5Size + headerSize + 10;
+    Header firstPart = header5;
+    firstPart.payloadSize = split - headerSize;
+    assert(client->sendMessage(firstPart, message, true));
+    usleep(50'000);
+    Header secondPart = header6;
+    secondPart.payloadSize = frame5Size + frame6Size - split - headerSize;
+    assert(!client->sendMessage(secondPart, message + split, true));
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_asyncPipelinedOrders() {
+    std::cout << "TEST ASYNC PIPELINED NEW ORDERS, DUPLICATE AND MODIFY <ACCEPTED, ACCEPTED, REJECTED, REPLIED>" << std::endl;
+    AsyncRiskClient client(PORT);
+    Header header;
+    NewOrder order1, order2, duplicate;
+    helper_createNewOrder(header, order1, 6, 31, 5, 10'0000, 'B');
+    helper_createNewOrder(header, order2, 6, 32, 5, 10'0000, 'B');
+    helper_createNewOrder(header, duplicate, 6, 31, 1, 10'0000, 'B');
+    ModifyOrderQuantity modify;
+    helper_modifyOrder(header, modify, 31, 6);
+
+    // Queued back to back, sent in one flush without waiting for replies.
+    std::future<OrderResponse> reply1 = client.submitNewOrder(order1);
+    std::future<OrderResponse> reply2 = client.submitNewOrder(order2);
+    std::future<OrderResponse> reply3 = client.submitNewOrder(duplicate);
+    uint64_t modifiedId = 0;
+    client.submitModifyOrderQuantity(modify, [&modifiedId](const OrderResponse *response) {
+        assert(response != NULL);
+        modifiedId = response->orderId;
+    });
+    assert(client.inFlight() == 4);
+    while (client.inFlight() > 0 && client.connected())
+        client.poll(1000);
+
+    assert(reply1.get().status == OrderResponse::Status::ACCEPTED);
+    assert(reply2.get().status == OrderResponse::Status::ACCEPTED);
+    OrderResponse rejected = reply3.get();
+    assert(rejected.orderId == 31 && rejected.status == OrderResponse::Status::REJECTED);
+    assert(modifiedId == 31);
+    assert(client.unmatched() == 0);
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_asyncPipelinedBurst() {
+    std::cout << "TEST 100000 PIPELINED NEW ORDERS, OVER 4 MB IN FLIGHT <100000 REPLIED, 20 ACCEPTED>" << std::endl;
+    AsyncRiskClient client(PORT);
+    Header header;
+    NewOrder order;
+
+    // 5.1 MB of frames sent in one go, more than the 256 16 KB receive
+    // buffers of --io=io_uring, the buy limit of 20 accepts the first 20.
+    size_t replies = 0, accepted = 0;
+    for (uint64_t orderId = 200'000; orderId < 300'000; orderId++) {
+        helper_createNewOrder(header, order, 14, orderId, 1, 10'0000, 'B');
+        client.submitNewOrder(order, [&replies, &accepted](const OrderResponse *response) {
+            assert(response != NULL);
+            replies++;
+            accepted += response->status == OrderResponse::Status::ACCEPTED;
+        });
+    }
+    while (client.inFlight() > 0 && client.connected())
+        client.poll(1000);
+    assert(replies == 100'000 && accepted == 20);
+    assert(client.unmatched() == 0);
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_batchMixedOrders() {
+    std::cout << "TEST BATCH OF MIXED MESSAGES <ACCEPTED, ACCEPTED, REJECTED, REPLIED, ACCEPTED>" << std::endl;
+    AsyncRiskClient client(PORT);
+    Header header;
+    NewOrder order1, order2, duplicate;
+    helper_createNewOrder(header, order1, 7, 41, 5, 10'0000, 'B');
+    helper_createNewOrder(header, order2, 7, 42, 5, 10'0000, 'B');
+    helper_createNewOrder(header, duplicate, 7, 41, 1, 10'0000, 'B');
+    DeleteOrder deleteOrder;
+    helper_deleteOrder(header, deleteOrder, 42);
+    ModifyOrderQuantity modify;
+    helper_modifyOrder(header, modify, 41, 6);
+    Trade trade;
+    helper_createTrade(header, trade, 7, 43, 2, 10'0000);
+
+    // Sub-messages are handled in order: 42 is deleted before it is reused.
+    assert(client.addToBatch(order1));
+    assert(client.addToBatch(order2));
+    assert(client.addToBatch(duplicate));
+    assert(client.addToBatch(deleteOrder));
+    assert(client.addToBatch(modify));
+    assert(client.addToBatch(trade));
+    assert(client.addToBatch(order2));
+    std::future<std::vector<BatchResponse::Entry>> reply = client.submitBatch();
+    while (client.inFlight() > 0 && client.connected())
+        client.poll(1000);
+
+    std::vector<BatchResponse::Entry> entries = reply.get();
+    assert(entries.size() == 5);
+    assert(entries[0].orderId == 41 && entries[0].status == (uint16_t)OrderResponse::Status::ACCEPTED);
+    assert(entries[1].orderId == 42 && entries[1].status == (uint16_t)OrderResponse::Status::ACCEPTED);
+    assert(entries[2].orderId == 41 && entries[2].status == (uint16_t)OrderResponse::Status::REJECTED);
+    assert(entries[3].orderId == 41);
+    assert(entries[4].orderId == 42 && entries[4].status == (uint16_t)OrderResponse::Status::ACCEPTED);
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_truncatedBatch() {
+    std::cout << "TEST BATCH SHORTER THAN ITS COUNT <EMPTY BATCH RESPONSE, ACCEPTED>" << std::endl;
+    u_long headerSize = sizeof(Header);
+    Header header;
+    NewOrder order;
+    helper_createNewOrder(header, order, 13, 101, 1, 10'0000, 'B');
+
+    // Claims two NewOrders but carries one.
+    Batch batch;
+    batch.messageType = Batch::MESSAGE_TYPE;
+    batch.count = 2;
+    header.payloadSize = sizeof(Batch) + sizeof(NewOrder);
+    char frame[sizeof(Header) + sizeof(Batch) + sizeof(NewOrder)];
+    std::memcpy(frame, &header, headerSize);
+    std::memcpy(frame + headerSize, &batch, sizeof(Batch));
+    std::memcpy(frame + headerSize + sizeof(Batch), &order, sizeof(NewOrder));
+    RiskClient client(PORT);
+    assert(client.transmit(frame, sizeof(frame)) == (ssize_t)sizeof(frame));
+
+    char reply[sizeof(Header) + sizeof(BatchResponse)];
+    size_t received = 0;
+    while (received < sizeof(reply)) {
+        ssize_t valread = client.receive(reply + received, sizeof(reply) - received);
+        assert(valread > 0);
+        received += valread;
+    }
+    Header responseHeader;
+    BatchResponse response;
+    std::memcpy(&responseHeader, reply, headerSize);
+    std::memcpy(&response, reply + headerSize, sizeof(BatchResponse));
+    assert(responseHeader.payloadSize == sizeof(BatchResponse));
+    assert(response.messageType == BatchResponse::MESSAGE_TYPE && response.count == 0);
+
+    // Nothing of it was handled, the order is still new.
+    helper_createNewOrder(header, order, 13, 101, 1, 10'0000, 'B');
+    char *message = new char[headerSize + header.payloadSize];
+    std::memcpy(message, &header, headerSize);
+    std::memcpy(message + headerSize, &order, header.payloadSize);
+    assert(client.sendMessage(header, message, true));
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_wrongSizeOrders() {
+    std::cout << "TEST NEW ORDER OF THE WRONG SIZE <REJECTED WITH ITS ID, OR 0>" << std::endl;
+    u_long headerSize = sizeof(Header);
+    Header header;
+    NewOrder order;
+    helper_createNewOrder(header, order, 14, 101, 1, 10'0000, 'B');
+
+    // Cut after the order id, then after the message type only.
+    RiskClient client(PORT);
+    const uint16_t sizes[] = {sizeof(uint16_t) + sizeof(uint64_t), sizeof(uint16_t)};
+    const uint64_t orderIds[] = {14, 0};
+    for (int i = 0; i < 2; ++i) {
+        header.payloadSize = sizes[i];
+        char frame[sizeof(Header) + sizeof(NewOrder)];
+        std::memcpy(frame, &header, headerSize);
+        std::memcpy(frame + headerSize, &order, sizes[i]);
+        assert(client.transmit(frame, headerSize + sizes[i]) == (ssize_t)(headerSize + sizes[i]));
+
+        char reply[sizeof(Header) + sizeof(OrderResponse)];
+        size_t received = 0;
+        while (received < sizeof(reply)) {
+            ssize_t valread = client.receive(reply + received, sizeof(reply) - received);
+            assert(valread > 0);
+            received += valread;
+        }
+        OrderResponse response;
+        std::memcpy(&response, reply + headerSize, sizeof(OrderResponse));
+        assert(response.messageType == OrderResponse::MESSAGE_TYPE);
+        assert(response.orderId == orderIds[i] && response.status == OrderResponse::Status::REJECTED);
+    }
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_logonAccountOrders() {
+    std::cout << "TEST LOGON THEN ORDERS OF TWO ACCOUNTS ON ONE LISTING <ACCEPTED, REJECTED>" << std::endl;
+    AsyncRiskClient account9(PORT), account0(PORT);
+    Header header;
+    NewOrder order1, order2;
+    helper_createNewOrder(header, order1, 8, 51, 20, 10'0000, 'B');
+    helper_createNewOrder(header, order2, 8, 52, 1, 10'0000, 'B');
+    Logon logon;
+    logon.account = 9;
+
+    // The logon is not answered, the next reply is the order's.
+    account9.submitLogon(logon);
+    std::future<OrderResponse> reply1 = account9.submitNewOrder(order1);
+    while (account9.inFlight() > 0 && account9.connected())
+        account9.poll(1000);
+    OrderResponse accepted = reply1.get();
+    assert(accepted.orderId == 51 && accepted.status == OrderResponse::Status::ACCEPTED);
+
+    // The instrument limit (the buy threshold) holds across accounts.
+    std::future<OrderResponse> reply2 = account0.submitNewOrder(order2);
+    while (account0.inFlight() > 0 && account0.connected())
+        account0.poll(1000);
+    OrderResponse rejected = reply2.get();
+    assert(rejected.orderId == 52 && rejected.status == OrderResponse::Status::REJECTED);
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_limitHierarchy() {
+    std::cout << "TEST ACCOUNT, ACCOUNT X INSTRUMENT, NOTIONAL AND PORTFOLIO LIMITS <REJECTED AT EACH LEVEL>" << std::endl;
+    AsyncRiskClient account21(PORT), account22(PORT), account0(PORT);
+    Header header;
+    NewOrder order;
+    Logon logon;
+    auto submit = [&header, &order](AsyncRiskClient &client, uint64_t listingId, uint64_t orderId, uint64_t quantity) {
+        helper_createNewOrder(header, order, listingId, orderId, quantity, 10'0000, 'B');
+        std::future<OrderResponse> reply = client.submitNewOrder(order);
+        while (client.inFlight() > 0 && client.connected())
+            client.poll(1000);
+        return reply.get().status;
+    };
+
+    // Account 21 may hold 30 lots over all of its instruments.
+    logon.account = 21;
+    account21.submitLogon(logon);
+    assert(submit(account21, 21, 601, 15) == OrderResponse::Status::ACCEPTED);
+    assert(submit(account21, 25, 602, 15) == OrderResponse::Status::ACCEPTED);
+    assert(submit(account21, 26, 603, 1) == OrderResponse::Status::REJECTED);
+
+    // Account 22 may hold 5 lots of listing 22.
+    logon.account = 22;
+    account22.submitLogon(logon);
+    assert(submit(account22, 22, 604, 6) == OrderResponse::Status::REJECTED);
+    assert(submit(account22, 22, 605, 5) == OrderResponse::Status::ACCEPTED);
+
+    // Listing 23 allows 1000000 of notional: 11 lots at 10'0000 exceed it.
+    assert(submit(account0, 23, 606, 11) == OrderResponse::Status::REJECTED);
+    assert(submit(account0, 23, 607, 10) == OrderResponse::Status::ACCEPTED);
+
+    // The portfolio may buy 100000 lots, listing 24 alone would allow more.
+    assert(submit(account0, 24, 608, 200'000) == OrderResponse::Status::REJECTED);
+    assert(submit(account0, 24, 609, 10) == OrderResponse::Status::ACCEPTED);
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_disconnectKeepsReusedOrderId() {
+    std::cout << "TEST DISCONNECT AFTER ANOTHER SESSION REUSED A DELETED ORDER ID <ACCEPTED>" << std::endl;
+    AsyncRiskClient owner(PORT);
+    Header header;
+    NewOrder order;
+    DeleteOrder deleteOrder;
+    ModifyOrderQuantity modify;
+    helper_createNewOrder(header, order, 10, 71, 1, 10'0000, 'B');
+    helper_deleteOrder(header, deleteOrder, 71);
+    helper_modifyOrder(header, modify, 71, 2);
+
+    {
+        // Creates and deletes order 71, then another session reuses the id.
+        AsyncRiskClient first(PORT);
+        std::future<OrderResponse> created = first.submitNewOrder(order);
+        first.submitDeleteOrder(deleteOrder);
+        while (first.inFlight() > 0 && first.connected())
+            first.poll(1000);
+        assert(created.get().status == OrderResponse::Status::ACCEPTED);
+
+        std::future<OrderResponse> reused = owner.submitNewOrder(order);
+        while (owner.inFlight() > 0 && owner.connected())
+            owner.poll(1000);
+        assert(reused.get().status == OrderResponse::Status::ACCEPTED);
+    }
+    usleep(50'000);
+
+    // The first session's disconnect must not roll back the owner's order.
+    std::future<OrderResponse> modified = owner.submitModifyOrderQuantity(modify);
+    while (owner.inFlight() > 0 && owner.connected())
+        owner.poll(1000);
+    assert(modified.get().status == OrderResponse::Status::ACCEPTED);
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_sharedMemoryOrders() {
+    std::cout << "TEST NEW ORDERS OVER SHARED MEMORY, SYNC AND PIPELINED PAST THE RING SIZE <ACCEPTED, REJECTED, REJECTED, 20 ACCEPTED>" << std::endl;
+    u_long headerSize = sizeof(Header);
+    Header header;
+    NewOrder order;
+
+    std::shared_ptr<RiskClient> client(new RiskClient(PORT, Transport::SHARED_MEMORY));
+    assert(client->sharedMemory());
+    helper_createNewOrder(header, order, 11, 81, 1, 10'0000, 'S');
+    char *message = new char[headerSize + header.payloadSize];
+    std::memcpy(message, &header, headerSize);
+    std::memcpy(message + headerSize, &order, header.payloadSize);
+    assert(client->sendMessage(header, message, true));
+
+    // A second attach, and one cut short on a TCP client, are refused.
+    SharedMemoryAttach attach;
+    attach.messageType = SharedMemoryAttach::MESSAGE_TYPE;
+    std::memset(attach.name, 0, sizeof(attach.name));
+    char attachFrame[sizeof(Header) + sizeof(SharedMemoryAttach)];
+    RiskClient::encodeMessage(attachFrame, 0, attach);
+    std::memcpy(&header, attachFrame, headerSize);
+    assert(!client->sendMessage(header, attachFrame, true));
+    RiskClient tcpClient(PORT);
+    header.payloadSize = sizeof(attach.messageType);
+    std::memcpy(attachFrame, &header, headerSize);
+    assert(!tcpClient.sendMessage(header, attachFrame, true));
+
+    // 6000 frames of 51 bytes wrap the 256 KB ring, the buy limit of 20
+    // accepts the first 20 orders of quantity 1.
+    AsyncRiskClient pipelined(PORT, Transport::SHARED_MEMORY);
+    assert(pipelined.sharedMemory());
+    size_t replies = 0, accepted = 0;
+    for (uint64_t orderId = 1000; orderId < 7000; orderId++) {
+        helper_createNewOrder(header, order, 11, orderId, 1, 10'0000, 'B');
+        pipelined.submitNewOrder(order, [&replies, &accepted](const OrderResponse *response) {
+            assert(response != NULL);
+            replies++;
+            accepted += response->status == OrderResponse::Status::ACCEPTED;
+        });
+    }
+    while (pipelined.inFlight() > 0 && pipelined.connected())
+        pipelined.poll(1000);
+    assert(replies == 6000 && accepted == 20);
+    assert(pipelined.unmatched() == 0);
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_unixSocketOrders() {
+    std::cout << "TEST NEW ORDERS OVER THE UNIX SOCKET <ACCEPTED, REJECTED>" << std::endl;
+    u_long headerSize = sizeof(Header);
+    Header header;
+    NewOrder order;
+
+    std::shared_ptr<RiskClient> client(new RiskClient(std::string(SOCKET_PATH)));
+    helper_createNewOrder(header, order, 12, 91, 20, 10'0000, 'B');
+    char *message = new char[headerSize + header.payloadSize];
+    std::memcpy(message, &header, headerSize);
+    std::memcpy(message + headerSize, &order, header.payloadSize);
+    assert(client->sendMessage(header, message, true));
+
+    helper_createNewOrder(header, order, 12, 92, 1, 10'0000, 'B');
+    std::memcpy(message, &header, headerSize);
+    std::memcpy(message + headerSize, &order, header.payloadSize);
+    assert(!client->sendMessage(header, message, true));
+    std::cout << "PASSED!" << std::endl;
+}
+
+void test_journalRestart() {
+    std::cout << "TEST ORDER RECOVERED AFTER A SERVER RESTART <ACCEPTED, REJECTED, REJECTED, ACCEPTED>" << std::endl;
+    Header header;
+    NewOrder order;
+    ModifyOrderQuantity modify;
+    helper_createNewOrder(header, order, 15, 701, 5, 10'0000, 'B');
+    helper_modifyOrder(header, modify, 701, 6);
+
+    {
+        // The order stays open: the session is still connected when the server stops.
+        AsyncRiskClient before(PORT);
+        std::future<OrderResponse> created = before.submitNewOrder(order);
+        while (before.inFlight() > 0 && before.connected())
+            before.poll(1000);
+        assert(created.get().status == OrderResponse::Status::ACCEPTED);
+
+        // A message after a second lets --snapshot-interval=1 fork a snapshot
+        // covering the order.
+        usleep(1'100'000);
+        std::future<OrderResponse> duplicate = before.submitNewOrder(order);
+        while (before.inFlight() > 0 && before.connected())
+            before.poll(1000);
+        assert(duplicate.get().status == OrderResponse::Status::REJECTED);
+        std::cout << "Restart the server with the same --journal" << std::endl;
+        while (before.connected())
+            before.poll(1000);
+    }
+
+    // Retried until the restarted server answers: the old listener can
+    // outlive the connection and take, then drop, the first attempts.
+    struct sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    OrderResponse::Status duplicate = OrderResponse::Status::ACCEPTED, modified = OrderResponse::Status::REJECTED;
+    bool answered = false;
+    for (int attempt = 0; attempt < 300 && !answered; attempt++) {
+        int probe = socket(AF_INET, SOCK_STREAM, 0);
+        bool listening = connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        close(probe);
+        if (!listening) {
+            usleep(100'000);
+            continue;
+        }
+
+        // Recovered, the id is taken and the order can be modified.
+        AsyncRiskClient after(PORT);
+        after.submitNewOrder(order, [&duplicate](const OrderResponse *response) {
+            if (response != NULL)
+                duplicate = response->status;
+        });
+        after.submitModifyOrderQuantity(modify, [&modified](const OrderResponse *response) {
+            if (response != NULL)
+                modified = response->status;
+        });
+        while (after.inFlight() > 0 && after.connected())
+            after.poll(1000);
+        answered = after.connected();
+    }
+    assert(answered);
+    assert(duplicate == OrderResponse::Status::REJECTED);
+    assert(modified == OrderResponse::Status::ACCEPTED);
+    std::cout << "PASSED!" << std::endl;
+}
+
 /* 
 * Simple main runner to test multiple cases.
 */
-int main() {
+int main(int argc, char **argv) {
+    // Run on its own, the server is restarted while it waits.
+    if (argc > 1 && std::string(argv[1]) == "--restart") {
+        test_journalRestart();
+        return 0;
+    }
     std::shared_ptr<RiskClient> client(new RiskClient(PORT));
     
     std::cout << "TEST NEW BUY ORDER <ACCEPTED>" << std::endl;
@@ -236,6 +779,20 @@ int main() {
     // Test custom cases
     test_newOrderDuplicateId(client);
     test_modifyNonExistingOrder(client);
+    test_newOrder64BitId(client);
+    test_newOrderNotionalOverflow(client);
+    test_newOrderInvalidSide(client);
+    test_splitAndPipelinedFrames(client);
+    test_asyncPipelinedOrders();
+    test_asyncPipelinedBurst();
+    test_batchMixedOrders();
+    test_truncatedBatch();
+    test_wrongSizeOrders();
+    test_logonAccountOrders();
+    test_limitHierarchy();
+    test_disconnectKeepsReusedOrderId();
+    test_sharedMemoryOrders();
+    test_unixSocketOrders();
 
     return 0;
 }
\ No newline at end of file